@@ -2,12 +2,216 @@
 
 #include "array_ref.h"
 #include "stream.h"
+#include <cstring>
+
+#if defined(GOLDFISH_HAS_AVX2)
+#include <immintrin.h>
+#elif defined(GOLDFISH_HAS_SSSE3)
+#include <tmmintrin.h>
+#endif
 
 namespace goldfish { namespace stream
 {
 	struct ill_formatted_base64_data : ill_formatted { using ill_formatted::ill_formatted; };
 
+	namespace details
+	{
+		inline constexpr char base64_alphabet[65] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			"abcdefghijklmnopqrstuvwxyz"
+			"0123456789+/";
+
+		// 6 bit value of each character, 64 for the characters that are not in the base64 alphabet
+		struct base64_values
+		{
+			constexpr base64_values()
+			{
+				for (auto& x : values)
+					x = 64;
+				for (byte i = 0; i < 64; ++i)
+					values[static_cast<byte>(base64_alphabet[i])] = i;
+			}
+			byte values[256] = {};
+		};
+		inline constexpr base64_values base64_decoding_table;
+
+		// Characters for each 12 bit value, so that the scalar encoder does one lookup for 2 characters
+		struct base64_character_pairs
+		{
+			constexpr base64_character_pairs()
+			{
+				for (int i = 0; i < 4096; ++i)
+				{
+					pairs[i][0] = static_cast<byte>(base64_alphabet[i >> 6]);
+					pairs[i][1] = static_cast<byte>(base64_alphabet[i & 63]);
+				}
+			}
+			byte pairs[4096][2] = {};
+		};
+		inline constexpr base64_character_pairs base64_encoding_table;
+
+		// The SIMD kernels are the ones described by Wojciech Muła and Daniel Lemire in "Faster Base64 Encoding and Decoding Using AVX2 Instructions"
+		// The same steps are used on 16 bytes (SSSE3) and on 32 bytes (AVX2), pshufb working on each 16 byte lane independently
+	#if defined(GOLDFISH_HAS_SSSE3)
+		// Encode the first 12 bytes of input as 16 characters
+		inline __m128i encode_base64_block(__m128i input)
+		{
+			// Spread each group of 3 bytes over 4 bytes, then move each 6 bit index to its own byte
+			input = _mm_shuffle_epi8(input, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+			auto indices = _mm_or_si128(
+				_mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040)),
+				_mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010)));
+
+			// Index ranges (A-Z, a-z, 0-9, +, /) are mapped to 0-13, which select the offset to add to the index
+			auto ranges = _mm_or_si128(
+				_mm_subs_epu8(indices, _mm_set1_epi8(51)),
+				_mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+			auto offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+			return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, ranges));
+		}
+
+		// Translate 16 characters to their 6 bit values and pack them in the first 12 bytes of the result
+		// Returns false if one of the characters isn't in the base64 alphabet
+		inline bool decode_base64_block(__m128i input, __m128i& output)
+		{
+			auto higher_nibbles = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0F));
+			auto lower_nibbles = _mm_and_si128(input, _mm_set1_epi8(0x0F));
+
+			// For each lower nibble, the set of higher nibbles that make a valid character
+			auto valid_higher_nibbles = _mm_setr_epi8(
+				static_cast<char>(0xA8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+				static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF0), 0x54, 0x50, 0x50, 0x50, 0x54);
+			auto higher_nibble_bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0);
+			auto invalid = _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(valid_higher_nibbles, lower_nibbles), _mm_shuffle_epi8(higher_nibble_bits, higher_nibbles)), _mm_setzero_si128());
+			if (_mm_movemask_epi8(invalid) != 0)
+				return false;
+
+			// The offset from character to value only depends on the higher nibble, except for '/'
+			auto offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+			auto slash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+			auto values = _mm_add_epi8(input, _mm_or_si128(_mm_andnot_si128(slash, _mm_shuffle_epi8(offsets, higher_nibbles)), _mm_and_si128(slash, _mm_set1_epi8(16))));
+
+			// Merge 4 values of 6 bits in 3 bytes
+			auto merged = _mm_madd_epi16(_mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+			output = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+			return true;
+		}
+	#endif
+	#if defined(GOLDFISH_HAS_AVX2)
+		// Encode bytes 0 to 11 of the lower lane and bytes 0 to 11 of the higher lane as 32 characters
+		inline __m256i encode_base64_block(__m256i input)
+		{
+			input = _mm256_shuffle_epi8(input, _mm256_setr_epi8(
+				1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+				1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+			auto indices = _mm256_or_si256(
+				_mm256_mulhi_epu16(_mm256_and_si256(input, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040)),
+				_mm256_mullo_epi16(_mm256_and_si256(input, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010)));
+
+			auto ranges = _mm256_or_si256(
+				_mm256_subs_epu8(indices, _mm256_set1_epi8(51)),
+				_mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+			auto offsets = _mm256_setr_epi8(
+				'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+				'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+			return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, ranges));
+		}
+
+		// Translate 32 characters to their 6 bit values and pack them in the first 24 bytes of the result
+		inline bool decode_base64_block(__m256i input, __m256i& output)
+		{
+			auto higher_nibbles = _mm256_and_si256(_mm256_srli_epi32(input, 4), _mm256_set1_epi8(0x0F));
+			auto lower_nibbles = _mm256_and_si256(input, _mm256_set1_epi8(0x0F));
+
+			auto valid_higher_nibbles = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+				static_cast<char>(0xA8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+				static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF0), 0x54, 0x50, 0x50, 0x50, 0x54));
+			auto higher_nibble_bits = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0));
+			auto invalid = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(valid_higher_nibbles, lower_nibbles), _mm256_shuffle_epi8(higher_nibble_bits, higher_nibbles)), _mm256_setzero_si256());
+			if (_mm256_movemask_epi8(invalid) != 0)
+				return false;
+
+			auto offsets = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+			auto slash = _mm256_cmpeq_epi8(input, _mm256_set1_epi8('/'));
+			auto values = _mm256_add_epi8(input, _mm256_or_si256(_mm256_andnot_si256(slash, _mm256_shuffle_epi8(offsets, higher_nibbles)), _mm256_and_si256(slash, _mm256_set1_epi8(16))));
+
+			auto merged = _mm256_madd_epi16(_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+			merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+			output = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+			return true;
+		}
+	#endif
+
+		// Encode c_groups groups of 3 bytes as groups of 4 characters
+		inline void encode_base64_blocks(const byte* input, size_t c_groups, byte* output)
+		{
+		#if defined(GOLDFISH_HAS_AVX2)
+			// Each lane loads 16 bytes and encodes 12 of them, so 4 bytes past the last group encoded must be readable
+			for (; c_groups >= 10; c_groups -= 8, input += 24, output += 32)
+			{
+				auto block = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input))), _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 12)), 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output), encode_base64_block(block));
+			}
+		#endif
+		#if defined(GOLDFISH_HAS_SSSE3)
+			for (; c_groups >= 6; c_groups -= 4, input += 12, output += 16)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output), encode_base64_block(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input))));
+		#endif
+			for (; c_groups > 0; --c_groups, input += 3, output += 4)
+			{
+				uint32_t x = (static_cast<uint32_t>(input[0]) << 16) | (static_cast<uint32_t>(input[1]) << 8) | input[2];
+				std::memcpy(output, base64_encoding_table.pairs[x >> 12], 2);
+				std::memcpy(output + 2, base64_encoding_table.pairs[x & 4095], 2);
+			}
+		}
+
+		// Decode c_groups groups of 4 characters (without padding) as groups of 3 bytes
+		// Returns false if one of the characters isn't in the base64 alphabet
+		inline bool decode_base64_blocks(const byte* input, size_t c_groups, byte* output)
+		{
+		#if defined(GOLDFISH_HAS_AVX2)
+			for (; c_groups >= 8; c_groups -= 8, input += 32, output += 24)
+			{
+				__m256i block;
+				if (!decode_base64_block(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input)), block))
+					return false;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm256_castsi256_si128(block));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(output + 16), _mm256_extracti128_si256(block, 1));
+			}
+		#endif
+		#if defined(GOLDFISH_HAS_SSSE3)
+			for (; c_groups >= 4; c_groups -= 4, input += 16, output += 12)
+			{
+				__m128i block;
+				if (!decode_base64_block(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input)), block))
+					return false;
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(output), block);
+				auto last_bytes = _mm_cvtsi128_si32(_mm_srli_si128(block, 8));
+				std::memcpy(output + 8, &last_bytes, sizeof(last_bytes));
+			}
+		#endif
+			// Invalid characters are detected once all the groups are decoded
+			uint32_t all_values = 0;
+			for (; c_groups > 0; --c_groups, input += 4, output += 3)
+			{
+				uint32_t a = base64_decoding_table.values[input[0]];
+				uint32_t b = base64_decoding_table.values[input[1]];
+				uint32_t c = base64_decoding_table.values[input[2]];
+				uint32_t d = base64_decoding_table.values[input[3]];
+				all_values |= a | b | c | d;
+				uint32_t x = (a << 18) | (b << 12) | (c << 6) | d;
+				output[0] = static_cast<byte>(x >> 16);
+				output[1] = static_cast<byte>(x >> 8);
+				output[2] = static_cast<byte>(x);
+			}
+			return all_values < 64;
+		}
+	}
+
 	// Reads binary data assuming inner reads base64
+	// Reads of 3 bytes or more are decoded by blocks of characters, smaller reads go through a buffer of 3 bytes
 	template <class inner> class base64_reader
 	{
 	public:
@@ -19,15 +223,15 @@ namespace goldfish { namespace stream
 		{
 			auto original_size = data.size();
 			read_from_already_parsed(data);
-			while (data.size() >= 3)
+			while (data.size() >= 3 && !m_end_of_stream)
 			{
-				auto c_read = deserialize_up_to_3_bytes(data);
-				remove_front(data, c_read);
-				if (c_read != 3)
-					return original_size - data.size();
+				byte buffer[typical_buffer_length];
+				auto cb_requested = std::min(data.size() / 3, sizeof(buffer) / 4) * 4;
+				auto cb_read = read_full_buffer(m_stream, std::span<byte>{ buffer, cb_requested });
+				remove_front(data, deserialize_block({ buffer, cb_read }, cb_read < cb_requested /*end_of_stream*/, data.data()));
 			}
 
-			if (!data.empty())
+			if (!data.empty() && !m_end_of_stream)
 			{
 				assert(m_cb_already_parsed == 0); // because there is left over in data, read_from_already_parsed emptied m_already_parsed
 				m_cb_already_parsed = deserialize_up_to_3_bytes(m_already_parsed);
@@ -44,21 +248,51 @@ namespace goldfish { namespace stream
 			std::copy(m_already_parsed.begin() + cb_to_copy, m_already_parsed.end(), m_already_parsed.begin());
 		}
 
-		// Read up to 4 characters (or the end of stream), remove the potential padding (base64 can be padded with '=' characters at the end)
-		// and generate up to 3 bytes of data
+		// Decode characters read from the stream (a multiple of 4 characters, unless the end of the stream was reached)
+		// and return the number of bytes written to output
+		size_t deserialize_block(std::span<const byte> characters, bool end_of_stream, byte* output)
+		{
+			// The last group goes through deserialize_group if it is incomplete or has padding
+			auto c_full_groups = characters.size() / 4;
+			if (characters.size() % 4 == 0 && c_full_groups > 0 && characters.back() == '=')
+				--c_full_groups;
+			if (!details::decode_base64_blocks(characters.data(), c_full_groups, output))
+				throw ill_formatted_base64_data{ "Invalid character in base64 stream" };
+
+			auto cb_written = c_full_groups * 3;
+			remove_front(characters, c_full_groups * 4);
+			if (!characters.empty())
+				cb_written += deserialize_group(characters, end_of_stream, output + cb_written);
+			if (end_of_stream)
+				m_end_of_stream = true;
+			return cb_written;
+		}
+
+		// Read up to 4 characters (or the end of stream) and generate up to 3 bytes of data
 		uint8_t deserialize_up_to_3_bytes(std::span<byte> output)
 		{
 			byte buffer[4];
 			auto c_read = read_full_buffer(m_stream, buffer);
-			if (c_read == 4 && buffer[3] == '=') // Presence of padding means the stream is made of blocks of 4 bytes
+			return deserialize_group({ buffer, c_read }, c_read < 4 /*end_of_stream*/, output.data());
+		}
+
+		// Decode a group of up to 4 characters, remove the potential padding (base64 can be padded with '=' characters at the end)
+		// and generate up to 3 bytes of data
+		uint8_t deserialize_group(std::span<const byte> characters, bool end_of_stream, byte* output)
+		{
+			auto c_read = characters.size();
+			if (c_read < 4)
+				m_end_of_stream = true;
+			if (c_read == 4 && characters[3] == '=') // Presence of padding means the stream is made of blocks of 4 bytes
 			{
-				if (buffer[2] == '=')
+				if (characters[2] == '=')
 					c_read = 2;
 				else
 					c_read = 3;
 
-				if (stream::seek(m_stream, 1) != 0)
+				if (!end_of_stream && stream::seek(m_stream, 1) != 0)
 					throw ill_formatted_base64_data{ "'=' is only allowed at the end of a base64 stream" };
+				m_end_of_stream = true;
 			}
 
 			if (c_read == 0)
@@ -66,8 +300,8 @@ namespace goldfish { namespace stream
 			if (c_read == 1)
 				throw ill_formatted_base64_data{ "Unexpected number of characters in base64 stream" };
 
-			auto a = character_to_6bits(buffer[0]);
-			auto b = character_to_6bits(buffer[1]);
+			auto a = character_to_6bits(characters[0]);
+			auto b = character_to_6bits(characters[1]);
 			output[0] = ((a << 2) | (b >> 4));
 			if (c_read == 2)
 			{
@@ -76,7 +310,7 @@ namespace goldfish { namespace stream
 				return 1;
 			}
 
-			auto c = character_to_6bits(buffer[2]);
+			auto c = character_to_6bits(characters[2]);
 			output[1] = (((b & 0xF) << 4) | (c >> 2));
 			if (c_read == 3)
 			{
@@ -85,42 +319,13 @@ namespace goldfish { namespace stream
 				return 2;
 			}
 
-			auto d = character_to_6bits(buffer[3]);
+			auto d = character_to_6bits(characters[3]);
 			output[2] = (((c & 0x3) << 6) | d);
 			return 3;
 		}
 		byte character_to_6bits(byte c)
 		{
-			static const byte lookup_table[] = {
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,62,64,64,64,63,52,53,
-				54,55,56,57,58,59,60,61,64,64,
-				64,65,64,64,64, 0, 1, 2, 3, 4,
-				 5, 6, 7, 8, 9,10,11,12,13,14,
-				15,16,17,18,19,20,21,22,23,24,
-				25,64,64,64,64,64,64,26,27,28,
-				29,30,31,32,33,34,35,36,37,38,
-				39,40,41,42,43,44,45,46,47,48,
-				49,50,51,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64,64,64,64,64,
-				64,64,64,64,64,64
-			};
-			static_assert(sizeof(lookup_table) == 256, "");
-			auto result = lookup_table[c];
+			auto result = details::base64_decoding_table.values[c];
 			if (result >= 64)
 				throw ill_formatted_base64_data{ "Invalid character in base64 stream" };
 			return result;
@@ -128,9 +333,11 @@ namespace goldfish { namespace stream
 		inner m_stream;
 		std::array<byte, 3> m_already_parsed;
 		uint8_t m_cb_already_parsed = 0;
+		bool m_end_of_stream = false;
 	};
 
 	// Write base64 data to inner when binary data is provided
+	// Data is encoded by blocks in a local buffer, which is written to inner with one call to write_buffer per block
 	template <class inner> class base64_writer
 	{
 	public:
@@ -170,8 +377,11 @@ namespace goldfish { namespace stream
 
 			while (data.size() >= 3)
 			{
-				write_triplet(data[0], data[1], data[2]);
-				remove_front(data, 3);
+				byte buffer[typical_buffer_length];
+				auto c_groups = std::min(data.size() / 3, sizeof(buffer) / 4);
+				details::encode_base64_blocks(data.data(), c_groups, buffer);
+				m_stream.write_buffer({ buffer, c_groups * 4 });
+				remove_front(data, c_groups * 3);
 			}
 
 			std::copy(data.begin(), data.end(), m_pending_encoding.begin());
@@ -194,34 +404,25 @@ namespace goldfish { namespace stream
 	private:
 		byte character_from_6bits(byte x)
 		{
-			static const char table[65] =
-				"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-				"abcdefghijklmnopqrstuvwxyz"
-				"0123456789+/";
-			return static_cast<byte>(table[x]);
+			return static_cast<byte>(details::base64_alphabet[x]);
 		}
-		void write_triplet(uint32_t a, uint32_t b, uint32_t c)
+		void write_triplet(byte a, byte b, byte c)
 		{
-			uint32_t x = (a << 16) | (b << 8) | c;
-			stream::write(m_stream, character_from_6bits((x >> 18) & 63));
-			stream::write(m_stream, character_from_6bits((x >> 12) & 63));
-			stream::write(m_stream, character_from_6bits((x >> 6 ) & 63));
-			stream::write(m_stream, character_from_6bits((x      ) & 63));
+			const byte triplet[] = { a, b, c };
+			byte characters[4];
+			details::encode_base64_blocks(triplet, 1, characters);
+			m_stream.write_buffer(characters);
 		}
 		void write_triplet_flush(uint32_t a)
 		{
-			stream::write(m_stream, character_from_6bits((a >> 2) & 63));
-			stream::write(m_stream, character_from_6bits((a & 3) << 4));
-			stream::write(m_stream, '=');
-			stream::write(m_stream, '=');
+			const byte characters[] = { character_from_6bits((a >> 2) & 63), character_from_6bits((a & 3) << 4), '=', '=' };
+			m_stream.write_buffer(characters);
 		}
 		void write_triplet_flush(uint32_t a, uint32_t b)
 		{
 			uint32_t x = (a << 8) | b;
-			stream::write(m_stream, character_from_6bits((x >> 10) & 63));
-			stream::write(m_stream, character_from_6bits((x >> 4) & 63));
-			stream::write(m_stream, character_from_6bits((x & 15) << 2));
-			stream::write(m_stream, '=');
+			const byte characters[] = { character_from_6bits((x >> 10) & 63), character_from_6bits((x >> 4) & 63), character_from_6bits((x & 15) << 2), '=' };
+			m_stream.write_buffer(characters);
 		}
 
 		inner m_stream;
@@ -231,4 +432,4 @@ namespace goldfish { namespace stream
 
 	template <class inner> enable_if_reader_t<inner, base64_reader<std::decay_t<inner>>> decode_base64(inner&& stream) { return{ std::forward<inner>(stream) }; }
 	template <class inner> enable_if_writer_t<inner, base64_writer<std::decay_t<inner>>> encode_base64_to(inner&& stream) { return{ std::forward<inner>(stream) }; }
-}}
\ No newline at end of file
+}}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include "stream.h"
 
 namespace goldfish { namespace stream
@@ -54,6 +55,15 @@ namespace goldfish { namespace stream
 				return skipped;
 			}
 		}
+
+		// Returns the bytes buffered and not read yet, after filling the buffer if it was empty (the span is empty at the end of the stream)
+		// The bytes are not consumed: seek past the ones that were used
+		std::span<const byte> peek_buffer()
+		{
+			if (m_buffered.empty())
+				fill_in_buffer();
+			return m_buffered;
+		}
 	private:
 		template <class T, size_t alignment> T read_helper(std::integral_constant<size_t, alignment>, std::bool_constant<false>)
 		{
@@ -126,18 +136,63 @@ namespace goldfish { namespace stream
 		std::array<byte, N> m_buffer_data;
 	};
 
-	template <size_t N, class inner>
+	// Flush policies decide when a buffered_writer sends its buffer to the inner stream before the buffer is full
+	// should_send(end_of_record) is called by end_of_record() and poll() when the buffer isn't empty, on_send() each time the buffer is sent
+
+	// Send only when the buffer is full (or on flush): best throughput, but small records can stay in the buffer indefinitely
+	struct flush_when_full
+	{
+		bool should_send(bool /*end_of_record*/) { return false; }
+		void on_send() {}
+	};
+
+	// Send at the end of each record: each record is sent as soon as it is complete, in as few calls to the inner stream as the buffer allows
+	struct flush_at_end_of_record
+	{
+		bool should_send(bool end_of_record) { return end_of_record; }
+		void on_send() {}
+	};
+
+	// Send complete records once the oldest buffered data is max_age old, so that records are batched but never wait much longer than max_age
+	// The clock is only read by end_of_record() and poll() while data is buffered: the age of the data is counted from the first of those calls
+	// after it was written. Clock can be a coarse clock (with a resolution of a few milliseconds) when max_age is large enough
+	template <class Clock = std::chrono::steady_clock> class latency_bounded
+	{
+	public:
+		latency_bounded(typename Clock::duration max_age)
+			: m_max_age(max_age)
+		{}
+		bool should_send(bool /*end_of_record*/)
+		{
+			auto now = Clock::now();
+			if (!m_data_buffered)
+			{
+				m_data_buffered = true;
+				m_oldest_data = now;
+			}
+			return now - m_oldest_data >= m_max_age;
+		}
+		void on_send() { m_data_buffered = false; }
+	private:
+		typename Clock::duration m_max_age;
+		typename Clock::time_point m_oldest_data;
+		bool m_data_buffered = false;
+	};
+
+	template <size_t N, class inner, class FlushPolicy = flush_when_full>
 	class buffered_writer
 	{
 	public:
-		buffered_writer(inner&& stream)
+		buffered_writer(inner&& stream, FlushPolicy policy = {})
 			: m_stream(std::move(stream))
 			, m_begin_free_space(m_buffer_data.data())
+			, m_policy(std::move(policy))
 		{}
 		buffered_writer(buffered_writer&& rhs)
 			: m_buffer_data(rhs.m_buffer_data)
 			, m_begin_free_space(m_buffer_data.data() + std::distance(rhs.m_buffer_data.data(), rhs.m_begin_free_space))
 			, m_stream(std::move(rhs.m_stream))
+			, m_policy(std::move(rhs.m_policy))
 		{}
 		buffered_writer& operator = (const buffered_writer&) = delete;
 
@@ -169,6 +224,60 @@ namespace goldfish { namespace stream
 			else
 				m_begin_free_space = std::copy(data.begin(), data.end(), m_begin_free_space);
 		}
+		byte* reserve(size_t cb)
+		{
+			if (cb_free() < cb)
+			{
+				if (cb > N)
+					return nullptr;
+				send_data();
+			}
+			return m_begin_free_space;
+		}
+		void commit(size_t cb)
+		{
+			assert(cb <= cb_free());
+			m_begin_free_space += cb;
+		}
+
+		// Marks are supported when the inner stream supports them: the position of a mark counts the bytes still in the buffer
+		// Rolling back to a mark that is still in the buffer doesn't touch the inner stream
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark())
+		{
+			auto m = m_stream.mark();
+			m.position += m_begin_free_space - m_buffer_data.data();
+			return m;
+		}
+		template <class T = inner> auto rollback(write_mark m) -> decltype(std::declval<T&>().rollback(m))
+		{
+			auto position_of_buffer = m_stream.mark().position;
+			if (m.position >= position_of_buffer)
+			{
+				assert(m.position - position_of_buffer <= static_cast<uint64_t>(m_begin_free_space - m_buffer_data.data()));
+				m_begin_free_space = m_buffer_data.data() + (m.position - position_of_buffer);
+			}
+			else
+			{
+				m_begin_free_space = m_buffer_data.data();
+				m_stream.rollback(m);
+			}
+		}
+		template <class T = inner> auto commit(write_mark m) -> decltype(std::declval<T&>().commit(m)) { return m_stream.commit(m); }
+
+		// Tell the stream that a record ends here: the buffer is sent to the inner stream if the flush policy asks for it
+		void end_of_record()
+		{
+			if (m_begin_free_space != m_buffer_data.data() && m_policy.should_send(true /*end_of_record*/))
+				send_data();
+		}
+
+		// Give the flush policy a chance to send the buffer while no data is written (for example from the idle loop of the writer)
+		// The buffer can end in the middle of a record
+		void poll()
+		{
+			if (m_begin_free_space != m_buffer_data.data() && m_policy.should_send(false /*end_of_record*/))
+				send_data();
+		}
 		auto flush()
 		{
 			send_data();
@@ -198,11 +307,17 @@ namespace goldfish { namespace stream
 				m_begin_free_space
 			});
 			m_begin_free_space = m_buffer_data.data();
+			m_policy.on_send();
 		}
 		std::array<byte, N> m_buffer_data;
 		byte* m_begin_free_space;
 		inner m_stream;
+		FlushPolicy m_policy;
 	};
 	template <size_t N, class inner> enable_if_reader_t<inner, buffered_reader<N, std::decay_t<inner>>> buffer(inner&& stream) { return{ std::forward<inner>(stream) }; }
 	template <size_t N, class inner> enable_if_writer_t<inner, buffered_writer<N, std::decay_t<inner>>> buffer(inner&& stream) { return{ std::forward<inner>(stream) }; }
+	template <size_t N, class inner, class FlushPolicy> enable_if_writer_t<inner, buffered_writer<N, std::decay_t<inner>, FlushPolicy>> buffer(inner&& stream, FlushPolicy policy)
+	{
+		return{ std::forward<inner>(stream), std::move(policy) };
+	}
 }}
@@ -1,13 +1,16 @@
 #pragma once
 
+#include "cbor_string_references.h"
 #include "common.h"
 #include "debug_checks_reader.h"
+#include "key_matcher.h"
 #include <optional>
 #include "sax_reader.h"
 #include "stream.h"
 #include "tags.h"
 #include <variant>
 #include <cmath>
+#include <vector>
 
 namespace goldfish { namespace cbor
 {
@@ -19,10 +22,14 @@ namespace goldfish { namespace cbor
 	template <class Stream> class array;
 	template <class Stream> class map;
 	template <class Stream> uint64_t read_integer(byte, Stream&);
+	template <class Stream> double read_half_point_float(Stream&);
+	inline float to_float(uint32_t);
+	inline double to_double(uint64_t);
+	template <class Stream> struct read_helper;
 
 	template <class Stream>
 	struct DocTraits {
-		using VariantT = std::variant<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
+		using VariantT = tagged_union<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
 			byte_string<Stream>, text_string<Stream>, array<Stream>, map<Stream>>;
 
 		template <class tag>
@@ -31,6 +38,7 @@ namespace goldfish { namespace cbor
 			byte_string<Stream>, text_string<Stream>, array<Stream>, map<Stream>>;
 
 		static constexpr bool does_json_conversions = false;
+		static constexpr bool does_string_conversions = true;
 	};
 
 	template <class Stream> struct document : document_impl<DocTraits<Stream>>
@@ -156,7 +164,105 @@ namespace goldfish { namespace cbor
 			}
 			return document;
 		}
+
+		// Number of elements left in the array, if the array has a definite length
+		std::optional<uint64_t> remaining_length() const
+		{
+			if (m_remaining_length == std::numeric_limits<uint64_t>::max())
+				return std::nullopt;
+			return m_remaining_length;
+		}
+
+		container_bookmark bookmark() const requires stream::has_bookmark<Stream>::value { return{ m_stream.bookmark(), m_remaining_length }; }
+		void rewind(container_bookmark b) requires stream::has_bookmark<Stream>::value
+		{
+			m_stream.rewind(b.position);
+			m_remaining_length = b.state;
+		}
+
+		// Bulk read of an array of numbers
+		// read_into fills the span and returns the number of elements read (less than the size of the span if the end of the array was reached)
+		// read_all_into appends all the remaining elements of the array to the vector
+		// Elements that are not numbers go through the document path (so tagged numbers are still accepted)
+		template <class T> size_t read_into(std::span<T> out)
+		{
+			size_t count = 0;
+			while (count != out.size())
+			{
+				if (m_remaining_length == 0)
+					break;
+
+				auto first_byte = stream::read<byte>(m_stream);
+				if (first_byte == 0xFF)
+				{
+					end_of_indefinite_array();
+					break;
+				}
+				out[count++] = read_number_element<T>(first_byte);
+				if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+					--m_remaining_length;
+			}
+			return count;
+		}
+		template <class T> void read_all_into(std::vector<T>& out)
+		{
+			if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+			{
+				// Only trust the length up to what could reasonably be in the stream, to avoid huge allocations on corrupted data
+				out.reserve(out.size() + static_cast<size_t>(std::min<uint64_t>(m_remaining_length, typical_buffer_length)));
+				for (; m_remaining_length != 0; --m_remaining_length)
+					out.push_back(read_number_element<T>(stream::read<byte>(m_stream)));
+			}
+			else
+			{
+				for (;;)
+				{
+					auto first_byte = stream::read<byte>(m_stream);
+					if (first_byte == 0xFF)
+					{
+						end_of_indefinite_array();
+						return;
+					}
+					out.push_back(read_number_element<T>(first_byte));
+				}
+			}
+		}
 	private:
+		void end_of_indefinite_array()
+		{
+			if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+				throw ill_formatted_cbor_data{ "CBOR array too large" };
+			m_remaining_length = 0;
+		}
+		template <class T> T read_number_element(byte first_byte)
+		{
+			switch (first_byte >> 5)
+			{
+			case 0:
+				return goldfish::details::cast_number<T>(read_integer(static_cast<byte>(first_byte & 31), m_stream));
+			case 1:
+			{
+				auto x = read_integer(static_cast<byte>(first_byte & 31), m_stream);
+				if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+					throw ill_formatted_cbor_data{ "CBOR signed integer too large" };
+				return goldfish::details::cast_number<T>(-1 - static_cast<int64_t>(x));
+			}
+			case 7:
+				switch (first_byte)
+				{
+				case 0xF9: return goldfish::details::cast_number<T>(read_half_point_float(m_stream));
+				case 0xFA: return goldfish::details::cast_number<T>(double{ to_float(from_big_endian(stream::read<uint32_t>(m_stream))) });
+				case 0xFB: return goldfish::details::cast_number<T>(to_double(from_big_endian(stream::read<uint64_t>(m_stream))));
+				}
+				break;
+			}
+
+			auto d = read_helper<stream::reader_ref_type_t<Stream>>::read(stream::ref(m_stream), first_byte);
+			if (!d)
+				throw ill_formatted_cbor_data{ "Unexpected break code found in finite length array" };
+			return goldfish::details::as_number<T>(*d);
+		}
+
 		Stream m_stream;
 		uint64_t m_remaining_length = std::numeric_limits<uint64_t>::max();
 	};
@@ -196,6 +302,49 @@ namespace goldfish { namespace cbor
 				--m_remaining_length;
 			return document;
 		}
+
+		// Reads the next key and returns the index of the matching key in the matcher (or key_matcher_base::no_match),
+		// without storing the key anywhere else than on the stack. Returns nullopt at the end of the map
+		// Definite length text keys are matched on their length first: keys that have a length no key of the matcher has are skipped without being read
+		template <class Matcher> std::optional<size_t> read_key_match(const Matcher& matcher)
+		{
+			if (m_remaining_length == 0)
+				return std::nullopt;
+
+			auto first_byte = stream::read<byte>(m_stream);
+			if ((first_byte >> 5) != 3 || (first_byte & 31) > 27)
+			{
+				auto key = read_helper<stream::reader_ref_type_t<Stream>>::read(stream::ref(m_stream), first_byte);
+				if (!key)
+				{
+					if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+						throw ill_formatted_cbor_data{ "Unexpected break code found in finite length map" };
+					m_remaining_length = 0;
+					return std::nullopt;
+				}
+				if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+					--m_remaining_length;
+				return goldfish::details::match_key_document(std::move(*key), matcher);
+			}
+
+			if (m_remaining_length != std::numeric_limits<uint64_t>::max())
+				--m_remaining_length;
+			auto cb = read_integer(static_cast<byte>(first_byte & 31), m_stream);
+			if constexpr (has_string_references<Stream>::value)
+				m_stream.string_references().add_string(3, cb);
+			if (!matcher.has_length(cb))
+			{
+				if (stream::seek(m_stream, cb) != cb)
+					throw stream::unexpected_end_of_stream();
+				return key_matcher_base::no_match;
+			}
+
+			char buffer[key_matcher_base::max_key_length];
+			if (stream::read_full_buffer(m_stream, { reinterpret_cast<byte*>(buffer), static_cast<size_t>(cb) }) != cb)
+				throw stream::unexpected_end_of_stream();
+			return matcher.match({ buffer, static_cast<size_t>(cb) });
+		}
+		template <size_t N> std::optional<size_t> read_key_match(const std::string_view(&keys)[N]) { return read_key_match(key_matcher<N>(keys)); }
 		document<stream::reader_ref_type_t<Stream>> read_value()
 		{
 			auto d = read_no_debug_check(stream::ref(m_stream));
@@ -203,6 +352,21 @@ namespace goldfish { namespace cbor
 				throw ill_formatted_cbor_data{ "Unexpected break code found as a map value" };
 			return std::move(*d);
 		}
+
+		// Number of key value pairs left in the map, if the map has a definite length
+		std::optional<uint64_t> remaining_length() const
+		{
+			if (m_remaining_length == std::numeric_limits<uint64_t>::max())
+				return std::nullopt;
+			return m_remaining_length;
+		}
+
+		container_bookmark bookmark() const requires stream::has_bookmark<Stream>::value { return{ m_stream.bookmark(), m_remaining_length }; }
+		void rewind(container_bookmark b) requires stream::has_bookmark<Stream>::value
+		{
+			m_stream.rewind(b.position);
+			m_remaining_length = b.state;
+		}
 	private:
 		Stream m_stream;
 		uint64_t m_remaining_length;
@@ -263,15 +427,47 @@ namespace goldfish { namespace cbor
 
 		static std::optional<document<Stream>> fn_tag(Stream&& s, byte first_byte)
 		{
-			// tags are skipped for now
+			// tags are skipped for now, except for string references when the stream supports them
+			bool string_reference = false;
 			do
 			{
-				read_integer(static_cast<byte>(first_byte & 31), s);
+				auto tag = read_integer(static_cast<byte>(first_byte & 31), s);
+				if constexpr (has_string_references<Stream>::value)
+				{
+					if (tag == 256 && !s.string_references().start_namespace())
+						throw ill_formatted_cbor_data{ "Nested CBOR string reference namespaces are not supported" };
+					else if (tag == 25)
+						string_reference = true;
+				}
 				first_byte = stream::read<byte>(s);
 			} while ((first_byte >> 5) == 6); // 6 is the major type for tags
 
+			if constexpr (has_string_references<Stream>::value)
+			{
+				if (string_reference)
+					return read_string_reference(std::move(s), first_byte);
+			}
 			return read(std::forward<Stream>(s), first_byte);
 		}
+		static std::optional<document<Stream>> read_string_reference(Stream&& s, byte first_byte)
+		{
+			if ((first_byte >> 5) != 0)
+				throw ill_formatted_cbor_data{ "CBOR string reference should be an unsigned integer" };
+			auto string = s.string_references().resolve(read_integer(static_cast<byte>(first_byte & 31), s));
+			if (!string)
+				throw ill_formatted_cbor_data{ "Invalid CBOR string reference" };
+
+			if (string->first == 2)
+				return document<Stream>(byte_string<Stream>{ std::move(s), string->second });
+			else
+				return document<Stream>(text_string<Stream>{ std::move(s), string->second });
+		}
+		template <byte major> static std::optional<document<Stream>> make_string(Stream&& s, uint64_t cb)
+		{
+			if constexpr (has_string_references<Stream>::value)
+				s.string_references().add_string(major, cb);
+			return document<Stream>(string<Stream, major, std::conditional_t<major == 2, tags::binary, tags::string>>{ std::move(s), cb });
+		}
 		static std::optional<document<Stream>> fn_false(Stream&&, byte) { return document<Stream>(false); }
 		static std::optional<document<Stream>> fn_true(Stream&&, byte) { return document<Stream>(true); }
 		static std::optional<document<Stream>> fn_null(Stream&&, byte) { return document<Stream>(nullptr); }
@@ -283,18 +479,18 @@ namespace goldfish { namespace cbor
 		static std::optional<document<Stream>> fn_float_64(Stream&& s, byte) { return document<Stream>(to_double(from_big_endian(stream::read<uint64_t>(s)))); }
 		static std::optional<document<Stream>> fn_ill_formatted(Stream&&, byte) { throw ill_formatted_cbor_data{ "Unexpected CBOR opcode" }; };
 
-		static std::optional<document<Stream>> fn_small_binary(Stream&& s, byte first_byte) { return document<Stream>(byte_string<Stream>{ std::move(s), static_cast<uint8_t>(first_byte & 31) }); };
-		static std::optional<document<Stream>> fn_8_binary(Stream&& s, byte) { return document<Stream>(byte_string<Stream>{ std::move(s), stream::read<uint8_t>(s) }); };
-		static std::optional<document<Stream>> fn_16_binary(Stream&& s, byte) { return document<Stream>(byte_string<Stream>{ std::move(s), from_big_endian(stream::read<uint16_t>(s)) }); };
-		static std::optional<document<Stream>> fn_32_binary(Stream&& s, byte) { return document<Stream>(byte_string<Stream>{ std::move(s), from_big_endian(stream::read<uint32_t>(s)) }); };
-		static std::optional<document<Stream>> fn_64_binary(Stream&& s, byte) { return document<Stream>(byte_string<Stream>{ std::move(s), from_big_endian(stream::read<uint64_t>(s)) }); };
+		static std::optional<document<Stream>> fn_small_binary(Stream&& s, byte first_byte) { return make_string<2>(std::move(s), static_cast<uint8_t>(first_byte & 31)); };
+		static std::optional<document<Stream>> fn_8_binary(Stream&& s, byte) { return make_string<2>(std::move(s), stream::read<uint8_t>(s)); };
+		static std::optional<document<Stream>> fn_16_binary(Stream&& s, byte) { return make_string<2>(std::move(s), from_big_endian(stream::read<uint16_t>(s))); };
+		static std::optional<document<Stream>> fn_32_binary(Stream&& s, byte) { return make_string<2>(std::move(s), from_big_endian(stream::read<uint32_t>(s))); };
+		static std::optional<document<Stream>> fn_64_binary(Stream&& s, byte) { return make_string<2>(std::move(s), from_big_endian(stream::read<uint64_t>(s))); };
 		static std::optional<document<Stream>> fn_null_terminated_binary(Stream&& s, byte) { return document<Stream>(byte_string<Stream>{ std::move(s) }); };
 
-		static std::optional<document<Stream>> fn_small_text(Stream&& s, byte first_byte) { return document<Stream>(text_string<Stream>{ std::move(s), static_cast<uint8_t>(first_byte & 31) }); };
-		static std::optional<document<Stream>> fn_8_text(Stream&& s, byte) { return document<Stream>(text_string<Stream>{ std::move(s), stream::read<uint8_t>(s) }); };
-		static std::optional<document<Stream>> fn_16_text(Stream&& s, byte) { return document<Stream>(text_string<Stream>{ std::move(s), from_big_endian(stream::read<uint16_t>(s)) }); };
-		static std::optional<document<Stream>> fn_32_text(Stream&& s, byte) { return document<Stream>(text_string<Stream>{ std::move(s), from_big_endian(stream::read<uint32_t>(s)) }); };
-		static std::optional<document<Stream>> fn_64_text(Stream&& s, byte) { return document<Stream>(text_string<Stream>{ std::move(s), from_big_endian(stream::read<uint64_t>(s)) }); };
+		static std::optional<document<Stream>> fn_small_text(Stream&& s, byte first_byte) { return make_string<3>(std::move(s), static_cast<uint8_t>(first_byte & 31)); };
+		static std::optional<document<Stream>> fn_8_text(Stream&& s, byte) { return make_string<3>(std::move(s), stream::read<uint8_t>(s)); };
+		static std::optional<document<Stream>> fn_16_text(Stream&& s, byte) { return make_string<3>(std::move(s), from_big_endian(stream::read<uint16_t>(s))); };
+		static std::optional<document<Stream>> fn_32_text(Stream&& s, byte) { return make_string<3>(std::move(s), from_big_endian(stream::read<uint32_t>(s))); };
+		static std::optional<document<Stream>> fn_64_text(Stream&& s, byte) { return make_string<3>(std::move(s), from_big_endian(stream::read<uint64_t>(s))); };
 		static std::optional<document<Stream>> fn_null_terminated_text(Stream&& s, byte) { return document<Stream>(text_string<Stream>{ std::move(s) }); };
 
 		static std::optional<document<Stream>> fn_small_array(Stream&& s, byte first_byte) { return document<Stream>(array<Stream>{ std::move(s), static_cast<uint8_t>(first_byte & 31) }); };
@@ -380,6 +576,8 @@ namespace goldfish { namespace cbor
 				fn_end_of_structure
 			};
 			static_assert(sizeof(functions) / sizeof(functions[0]) == 256, "The jump table should have 256 entries");
+			if constexpr (has_string_references<Stream>::value)
+				s.string_references().start_document();
 			return functions[first_byte](std::move(s), first_byte);
 		}
 	};
@@ -393,6 +591,8 @@ namespace goldfish { namespace cbor
 
 	template <class Stream, class error_handler> auto read(Stream&& s, error_handler e)
 	{
+		if constexpr (has_string_references<std::decay_t<Stream>>::value)
+			s.string_references().start_top_level_document();
 		auto d = read_no_debug_check(std::forward<Stream>(s));
 		if (!d)
 			throw ill_formatted_cbor_data{ "Unexpected break code in CBOR stream" };
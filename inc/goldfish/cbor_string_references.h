@@ -0,0 +1,269 @@
+#pragma once
+
+#include "array_ref.h"
+#include "common.h"
+#include "stream.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Support for the CBOR stringref extension (http://cbor.schmorp.de/stringref)
+// Tag 256 starts a namespace: from there, each definite length text or binary string that is long enough
+// gets the next index in a table, and tag 25 followed by an index refers to a string already in the table.
+// Documents that repeat the same map keys (like arrays of records) become much smaller.
+//
+// The table is carried by the stream: wrap the output stream with with_string_references before creating the CBOR writer,
+// and the input stream with with_string_references before creating the CBOR reader:
+//   auto data = cbor::create_writer(cbor::with_string_references(stream::vector_writer{})).write(x);
+//   auto document = cbor::read(cbor::with_string_references(stream::read_buffer_ref(data)));
+namespace goldfish { namespace cbor
+{
+	namespace details
+	{
+		// Minimum length of a string to be added to the table, given the number of strings already in the table
+		// (strings that are shorter than the reference would be are not added)
+		inline uint64_t min_string_reference_length(uint64_t table_size)
+		{
+			if (table_size < 24) return 3;
+			else if (table_size < 256) return 4;
+			else if (table_size < 65536) return 5;
+			else if (table_size < 4294967296ull) return 7;
+			else return 11;
+		}
+	}
+
+	template <class T> static std::true_type test_has_string_references(std::remove_reference_t<decltype(std::declval<T&>().string_references())>*) { return{}; }
+	template <class T> static std::false_type test_has_string_references(...) { return{}; }
+	template <class T> struct has_string_references : decltype(test_has_string_references<T>(nullptr)) {};
+
+	// Read stream that resolves string references
+	// Strings that are added to the table are read ahead of time into the table, and then served from there
+	// Nested namespaces are not supported: tag 256 inside a namespace throws ill_formatted_cbor_data (the table of the enclosing
+	// namespace would have to be restored at the end of the tagged document). Top level documents can each start a new namespace
+	template <class Stream> class string_references_reader
+	{
+	public:
+		string_references_reader(Stream&& s)
+			: m_stream(std::move(s))
+		{}
+
+		size_t read_partial_buffer(std::span<byte> buffer)
+		{
+			if (m_pending_size == 0)
+				return m_stream.read_partial_buffer(buffer);
+
+			auto cb = static_cast<size_t>(std::min<uint64_t>(buffer.size(), m_pending_size));
+			std::copy(m_data.data() + m_pending_offset, m_data.data() + m_pending_offset + cb, buffer.data());
+			m_pending_offset += cb;
+			m_pending_size -= cb;
+			return cb;
+		}
+		template <class T> T read()
+		{
+			if (m_pending_size == 0)
+				return stream::read<T>(m_stream);
+
+			T t;
+			if (stream::read_full_buffer(*this, { reinterpret_cast<byte*>(&t), sizeof(t) }) != sizeof(t))
+				throw stream::unexpected_end_of_stream();
+			return t;
+		}
+		uint64_t seek(uint64_t cb)
+		{
+			auto from_table = std::min<uint64_t>(cb, m_pending_size);
+			m_pending_offset += static_cast<size_t>(from_table);
+			m_pending_size -= from_table;
+			return from_table + stream::seek(m_stream, cb - from_table);
+		}
+
+		string_references_reader& string_references() { return *this; }
+
+		// Called by cbor::read before a top level document, whose tag 256 replaces the namespace of the previous documents
+		void start_top_level_document() { m_next_is_top_level = true; }
+		// Called when the first byte of a document (or of the document in a tag) has been read
+		void start_document() { m_top_level = std::exchange(m_next_is_top_level, false); }
+
+		// Returns false if the namespace would be nested in another one
+		bool start_namespace()
+		{
+			if (m_active && !m_top_level)
+				return false;
+			m_active = true;
+			m_entries.clear();
+			m_data.clear();
+			m_pending_offset = 0;
+			m_pending_size = 0;
+			return true;
+		}
+
+		// Called when a definite length string of cb bytes starts. If it belongs in the table, its content is read in the table
+		void add_string(byte major, uint64_t cb)
+		{
+			if (!m_active || cb < details::min_string_reference_length(m_entries.size()))
+				return;
+
+			auto offset = m_data.size();
+			for (auto remaining = cb; remaining > 0;)
+			{
+				// Grow the buffer as the data comes in, to avoid huge allocations on corrupted data
+				auto chunk = static_cast<size_t>(std::min<uint64_t>(remaining, typical_buffer_length));
+				auto current = m_data.size();
+				m_data.resize(current + chunk);
+				if (stream::read_full_buffer(m_stream, { m_data.data() + current, chunk }) != chunk)
+					throw stream::unexpected_end_of_stream();
+				remaining -= chunk;
+			}
+			m_entries.push_back({ major, offset, static_cast<size_t>(cb) });
+			m_pending_offset = offset;
+			m_pending_size = static_cast<size_t>(cb);
+		}
+
+		// Called for tag 25: the referenced string is served by the stream next
+		// Returns the major type (2 for binary, 3 for text) and the size of the string, or nullopt if the reference is not valid
+		std::optional<std::pair<byte, uint64_t>> resolve(uint64_t index)
+		{
+			if (!m_active || index >= m_entries.size())
+				return std::nullopt;
+
+			auto& entry = m_entries[static_cast<size_t>(index)];
+			m_pending_offset = entry.offset;
+			m_pending_size = entry.size;
+			return std::make_pair(entry.major, static_cast<uint64_t>(entry.size));
+		}
+
+	private:
+		struct entry
+		{
+			byte major;
+			size_t offset;
+			size_t size;
+		};
+
+		Stream m_stream;
+		bool m_active = false;
+		bool m_top_level = false;
+		bool m_next_is_top_level = false;
+		std::vector<byte> m_data;
+		std::vector<entry> m_entries;
+		size_t m_pending_offset = 0;
+		size_t m_pending_size = 0;
+	};
+
+	// Write stream that deduplicates strings
+	// The tag 256 is written when the stream is created, so the whole document written to this stream is one namespace
+	// Only strings of at most max_length bytes are deduplicated: they need to be buffered before being written
+	template <class Stream> class string_references_writer
+	{
+	public:
+		static const size_t default_max_length = 64;
+
+		string_references_writer(Stream&& s, size_t max_length = default_max_length)
+			: m_stream(std::move(s))
+			, m_max_length(max_length)
+		{
+			static const byte namespace_tag[] = { 0xd9, 0x01, 0x00 };
+			m_stream.write_buffer(namespace_tag);
+		}
+
+		void write_buffer(std::span<const byte> buffer) { m_stream.write_buffer(buffer); }
+		template <class T> auto write(const T& t) { return stream::write(m_stream, t); }
+		template <class T = Stream> auto reserve(size_t cb) -> decltype(std::declval<T&>().reserve(cb)) { return m_stream.reserve(cb); }
+		template <class T = Stream> auto commit(size_t cb) -> decltype(std::declval<T&>().commit(cb)) { return m_stream.commit(cb); }
+		auto flush() { return m_stream.flush(); }
+
+		string_references_writer& string_references() { return *this; }
+
+		// Called when a definite length string of cb bytes starts
+		// Returns true if the string should be buffered (using append) and then looked up in the table (using find_or_add)
+		bool start_string(uint64_t cb)
+		{
+			if (cb < details::min_string_reference_length(m_count))
+				return false;
+
+			if (cb > m_max_length)
+			{
+				// The reader adds the string to its table, but it is never referenced
+				++m_count;
+				return false;
+			}
+			m_pending.clear();
+			return true;
+		}
+		void append(std::span<const byte> buffer) { m_pending.insert(m_pending.end(), buffer.begin(), buffer.end()); }
+		std::span<const byte> pending() const { return m_pending; }
+
+		// Returns the index of the pending string if it was already written, or adds it to the table and returns nullopt
+		std::optional<uint64_t> find_or_add(byte major)
+		{
+			auto hash = std::hash<std::string_view>{}({ reinterpret_cast<const char*>(m_pending.data()), m_pending.size() }) * 31 + major;
+			if ((m_slots_used + 1) * 2 > m_slots.size())
+				grow();
+
+			auto mask = m_slots.size() - 1;
+			for (auto i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+			{
+				auto& slot = m_slots[i];
+				if (slot.index == empty_slot)
+				{
+					slot = { hash, m_count++, m_data.size(), m_pending.size(), major };
+					m_data.insert(m_data.end(), m_pending.begin(), m_pending.end());
+					++m_slots_used;
+					return std::nullopt;
+				}
+				if (slot.hash == hash && slot.major == major && slot.size == m_pending.size() &&
+					std::equal(m_pending.begin(), m_pending.end(), m_data.begin() + slot.offset))
+				{
+					return slot.index;
+				}
+			}
+		}
+
+	private:
+		// Open addressing hash table with linear probing, the strings are stored one after the other in m_data
+		static const uint64_t empty_slot = ~0ull;
+		struct slot
+		{
+			size_t hash;
+			uint64_t index;
+			size_t offset;
+			size_t size;
+			byte major;
+		};
+		void grow()
+		{
+			std::vector<slot> slots(std::max<size_t>(m_slots.size() * 2, 64), slot{ 0, empty_slot, 0, 0, 0 });
+			auto mask = slots.size() - 1;
+			for (auto&& s : m_slots)
+			{
+				if (s.index == empty_slot)
+					continue;
+				auto i = s.hash & mask;
+				while (slots[i].index != empty_slot)
+					i = (i + 1) & mask;
+				slots[i] = s;
+			}
+			m_slots = std::move(slots);
+		}
+
+		Stream m_stream;
+		size_t m_max_length;
+		uint64_t m_count = 0; // number of strings in the table of the reader
+		std::vector<byte> m_pending;
+		std::vector<byte> m_data;
+		std::vector<slot> m_slots;
+		size_t m_slots_used = 0;
+	};
+
+	template <class Stream> stream::enable_if_reader_t<Stream, string_references_reader<std::decay_t<Stream>>> with_string_references(Stream&& s)
+	{
+		return{ std::forward<Stream>(s) };
+	}
+	template <class Stream> stream::enable_if_writer_t<Stream, string_references_writer<std::decay_t<Stream>>> with_string_references(Stream&& s, size_t max_length = string_references_writer<std::decay_t<Stream>>::default_max_length)
+	{
+		return{ std::forward<Stream>(s), max_length };
+	}
+}}
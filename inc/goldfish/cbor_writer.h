@@ -2,42 +2,177 @@
 
 #include <exception>
 #include "array_ref.h"
+#include "cbor_string_references.h"
 #include "common.h"
 #include "debug_checks_writer.h"
+#include "encoded_key.h"
 #include <limits>
+#include <cmath>
+#include <cstring>
+#include <optional>
 #include "sax_writer.h"
 #include "stream.h"
 
 namespace goldfish { namespace cbor
 {
+	// Controls how numbers are encoded by the CBOR writer
+	struct write_options
+	{
+		// Encode floating point numbers as half precision floats (2 bytes) when no information is lost
+		static constexpr bool half_precision_floats = false;
+
+		// Encode floating point numbers with an integral value (like 1.0) as CBOR integers
+		// Readers see those numbers as integers, as_double still works on them
+		static constexpr bool integral_doubles_as_integers = false;
+	};
+
+	// Shortest encoding for numbers
+	struct compact_write_options
+	{
+		static constexpr bool half_precision_floats = true;
+		static constexpr bool integral_doubles_as_integers = true;
+	};
+
 	namespace details
 	{
+		// Fill buffer with a header byte followed by the big endian value, and return the number of bytes used
+		template <class T> size_t write_header(byte* buffer, byte header, T x)
+		{
+			buffer[0] = header;
+			if constexpr (sizeof(x) == 1)
+			{
+				buffer[1] = x;
+			}
+			else
+			{
+				auto big_endian = to_big_endian(x);
+				std::memcpy(buffer + 1, &big_endian, sizeof(big_endian));
+			}
+			return 1 + sizeof(x);
+		}
+
+		// Fill buffer with the shortest encoding of x for the major type, and return the number of bytes used (at most 9)
+		template <byte major> size_t encode_integer(byte* buffer, uint64_t x)
+		{
+			if (x <= 23)
+			{
+				buffer[0] = static_cast<byte>((major << 5) | x);
+				return 1;
+			}
+			else if (x <= std::numeric_limits<uint8_t>::max())
+				return write_header(buffer, (major << 5) | 24, static_cast<uint8_t>(x));
+			else if (x <= std::numeric_limits<uint16_t>::max())
+				return write_header(buffer, (major << 5) | 25, static_cast<uint16_t>(x));
+			else if (x <= std::numeric_limits<uint32_t>::max())
+				return write_header(buffer, (major << 5) | 26, static_cast<uint32_t>(x));
+			else
+				return write_header(buffer, (major << 5) | 27, x);
+		}
+
 		template <byte major, class Stream> void write_integer(Stream& s, uint64_t x)
 		{
 			if (x <= 23)
 			{
 				stream::write(s, static_cast<byte>((major << 5) | x));
+				return;
 			}
-			else if (x <= std::numeric_limits<uint8_t>::max())
+
+			stream::write_direct<9>(s, [&](byte* buffer) { return encode_integer<major>(buffer, x); });
+		}
+
+		// Returns true if x is an integer that can be encoded as a CBOR integer (-0.0 is excluded, it would lose its sign)
+		inline bool is_integral(double x)
+		{
+			if (x >= 0 ? x >= 18446744073709551616.0 : x < -9223372036854775808.0)
+				return false; // includes NaN
+			return std::trunc(x) == x && !(x == 0 && std::signbit(x));
+		}
+
+		// Returns the half precision encoding of x, or nullopt if x can't be represented exactly as a half precision float
+		inline std::optional<uint16_t> to_half_float(float x)
+		{
+			static_assert(sizeof(float) == sizeof(uint32_t), "Expect 32 bit floats");
+			uint32_t bits;
+			memcpy(&bits, &x, sizeof(bits));
+
+			auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+			auto exponent = static_cast<int>((bits >> 23) & 0xFF);
+			auto mantissa = bits & 0x7FFFFF;
+
+			if (exponent == 0xFF) // infinity or NaN, keep the 10 most significant bits of the payload
 			{
-				stream::write(s, static_cast<byte>((major << 5) | 24));
-				stream::write(s, static_cast<uint8_t>(x));
+				if (mantissa & 0x1FFF)
+					return std::nullopt;
+				return static_cast<uint16_t>(sign | 0x7C00 | (mantissa >> 13));
 			}
-			else if (x <= std::numeric_limits<uint16_t>::max())
+			if (exponent == 0) // zero or float denormal (much smaller than the smallest half)
 			{
-				stream::write(s, static_cast<byte>((major << 5) | 25));
-				stream::write(s, to_big_endian(static_cast<uint16_t>(x)));
+				if (mantissa != 0)
+					return std::nullopt;
+				return sign;
 			}
-			else if (x <= std::numeric_limits<uint32_t>::max())
+
+			exponent -= 127;
+			if (exponent > 15)
+				return std::nullopt;
+			if (exponent >= -14) // normal half
+			{
+				if (mantissa & 0x1FFF)
+					return std::nullopt;
+				return static_cast<uint16_t>(sign | ((exponent + 15) << 10) | (mantissa >> 13));
+			}
+			if (exponent >= -24) // denormal half: the implicit leading 1 becomes explicit
 			{
-				stream::write(s, static_cast<byte>((major << 5) | 26));
-				stream::write(s, to_big_endian(static_cast<uint32_t>(x)));
+				auto shift = -exponent - 1;
+				mantissa |= 0x800000;
+				if (mantissa & ((1u << shift) - 1))
+					return std::nullopt;
+				return static_cast<uint16_t>(sign | (mantissa >> shift));
 			}
+			return std::nullopt;
+		}
+
+		// Encodings of the numbers, used by the document writer and by write_array (each one uses at most 9 bytes)
+		template <class Options> size_t encode_number(byte* buffer, uint64_t x) { return encode_integer<0>(buffer, x); }
+		template <class Options> size_t encode_number(byte* buffer, int64_t x)
+		{
+			if (x < 0)
+				return encode_integer<1>(buffer, static_cast<uint64_t>(-1ll - x));
 			else
+				return encode_integer<0>(buffer, static_cast<uint64_t>(x));
+		}
+		template <class Options> size_t encode_float(byte* buffer, float x)
+		{
+			if constexpr (Options::half_precision_floats)
 			{
-				stream::write(s, static_cast<byte>((major << 5) | 27));
-				stream::write(s, to_big_endian(x));
+				// NaN payloads are not preserved, all NaNs are written as the canonical half precision NaN
+				if (std::isnan(x))
+					return write_header(buffer, (7 << 5) | 25, uint16_t{ 0x7E00 });
+				if (auto half = to_half_float(x))
+					return write_header(buffer, (7 << 5) | 25, *half);
 			}
+
+			static_assert(sizeof(float) == sizeof(uint32_t), "Expect 32 bit floats");
+			uint32_t i;
+			std::memcpy(&i, &x, sizeof(i));
+			return write_header(buffer, (7 << 5) | 26, i);
+		}
+		template <class Options> size_t encode_number(byte* buffer, double x)
+		{
+			if constexpr (Options::integral_doubles_as_integers)
+			{
+				if (is_integral(x))
+					return x < 0 ? encode_number<Options>(buffer, static_cast<int64_t>(x)) : encode_number<Options>(buffer, static_cast<uint64_t>(x));
+			}
+
+			// With half precision floats, NaNs are all written as the canonical half precision NaN by encode_float
+			if (static_cast<float>(x) == x || (Options::half_precision_floats && std::isnan(x)))
+				return encode_float<Options>(buffer, static_cast<float>(x));
+
+			static_assert(sizeof(double) == sizeof(uint64_t), "Expect 64 bit doubles");
+			uint64_t i;
+			std::memcpy(&i, &x, sizeof(i));
+			return write_header(buffer, (7 << 5) | 27, i);
 		}
 	}
 	
@@ -61,12 +196,52 @@ namespace goldfish { namespace cbor
 		Stream m_stream;
 	};
 
-	template <class Stream> class array_writer;
-	template <class Stream> class indefinite_array_writer;
-	template <class Stream> class map_writer;
-	template <class Stream> class indefinite_map_writer;
+	// Definite length string written to a stream that supports string references (see cbor_string_references.h)
+	// Strings that can be deduplicated are buffered until flush, and then written either as a reference or as a string
+	template <class Stream, byte major> class deduplicating_stream_writer
+	{
+	public:
+		deduplicating_stream_writer(Stream&& s, bool buffered)
+			: m_stream(std::move(s))
+			, m_buffered(buffered)
+		{}
+		void write_buffer(std::span<const byte> buffer)
+		{
+			if (m_buffered)
+				m_stream.string_references().append(buffer);
+			else
+				m_stream.write_buffer(buffer);
+		}
+		auto flush()
+		{
+			if (m_buffered)
+			{
+				auto& string_references = m_stream.string_references();
+				if (auto index = string_references.find_or_add(major))
+				{
+					stream::write(m_stream, static_cast<byte>((6 << 5) | 24));
+					stream::write(m_stream, static_cast<byte>(25));
+					details::write_integer<0>(m_stream, *index);
+				}
+				else
+				{
+					details::write_integer<major>(m_stream, string_references.pending().size());
+					m_stream.write_buffer(string_references.pending());
+				}
+			}
+			return m_stream.flush();
+		}
+	private:
+		Stream m_stream;
+		bool m_buffered;
+	};
+
+	template <class Stream, class Options> class array_writer;
+	template <class Stream, class Options> class indefinite_array_writer;
+	template <class Stream, class Options> class map_writer;
+	template <class Stream, class Options> class indefinite_map_writer;
 
-	template <class Stream> class document_writer
+	template <class Stream, class Options = write_options> class document_writer
 	{
 	public:
 		document_writer(Stream&& s)
@@ -85,28 +260,39 @@ namespace goldfish { namespace cbor
 		}
 		auto write(double x)
 		{
-			if (static_cast<float>(x) == x)
-				return write(static_cast<float>(x));
-
-			static_assert(sizeof(double) == sizeof(uint64_t), "Expect 64 bit doubles");
-			stream::write(m_stream, static_cast<byte>((7 << 5) | 27));
-			auto i = *reinterpret_cast<uint64_t*>(&x);
-			stream::write(m_stream, to_big_endian(i));
+			stream::write_direct<9>(m_stream, [&](byte* buffer) { return details::encode_number<Options>(buffer, x); });
 			return m_stream.flush();
 		}
 		auto write(float x)
 		{
-			static_assert(sizeof(float) == sizeof(uint32_t), "Expect 32 bit floats");
-			stream::write(m_stream, static_cast<byte>((7 << 5) | 26));
-			auto i = *reinterpret_cast<uint32_t*>(&x);
-			stream::write(m_stream, to_big_endian(i));
-			return m_stream.flush();
+			if constexpr (Options::integral_doubles_as_integers)
+			{
+				if (details::is_integral(x))
+					return x < 0 ? write(static_cast<int64_t>(x)) : write(static_cast<uint64_t>(x));
+			}
+			return write_float(x);
 		}
 		auto write(undefined) 
 		{
 			stream::write(m_stream, static_cast<byte>((7 << 5) | 23));
 			return m_stream.flush();
 		}
+		template <size_t N> auto write(const encoded_key<N>& x)
+		{
+			if constexpr (has_string_references<Stream>::value)
+			{
+				// The string needs to go through the string reference table, like any other string
+				auto text = x.text();
+				auto stream = start_string(text.size());
+				stream.write_buffer({ reinterpret_cast<const byte*>(text.data()), text.size() });
+				return stream.flush();
+			}
+			else
+			{
+				m_stream.write_buffer(x.cbor());
+				return m_stream.flush();
+			}
+		}
 
 		auto write(uint64_t x)
 		{
@@ -126,121 +312,161 @@ namespace goldfish { namespace cbor
 			}
 		}
 
-		auto start_binary(uint64_t cb)
+		// The elements are encoded in a local buffer, which is written to the stream each time it's full
+		template <class T> auto write_array(std::span<const T> x)
 		{
-			details::write_integer<2>(m_stream, cb);
-			return std::move(m_stream);
+			byte buffer[typical_buffer_length];
+			size_t cb = details::encode_integer<4>(buffer, x.size());
+			for (auto&& element : x)
+			{
+				if (sizeof(buffer) - cb < 9)
+				{
+					m_stream.write_buffer({ buffer, cb });
+					cb = 0;
+				}
+				cb += details::encode_number<Options>(buffer + cb, static_cast<sax::widened_number_t<T>>(element));
+			}
+			m_stream.write_buffer({ buffer, cb });
+			return m_stream.flush();
 		}
+
+		auto start_binary(uint64_t cb) { return start_definite_string<2>(cb); }
 		indefinite_stream_writer<Stream, 2> start_binary()
 		{
 			stream::write(m_stream, static_cast<byte>((2 << 5) | 31));
 			return{ std::move(m_stream) };
 		}
 
-		auto start_string(uint64_t cb)
-		{
-			details::write_integer<3>(m_stream, cb);
-			return std::move(m_stream);
-		}
+		auto start_string(uint64_t cb) { return start_definite_string<3>(cb); }
 		indefinite_stream_writer<Stream, 3> start_string()
 		{
 			stream::write(m_stream, static_cast<byte>((3 << 5) | 31));
 			return{ std::move(m_stream) };
 		}
 
-		array_writer<Stream> start_array(uint64_t size);
-		indefinite_array_writer<Stream> start_array();
+		array_writer<Stream, Options> start_array(uint64_t size);
+		indefinite_array_writer<Stream, Options> start_array();
 
-		map_writer<Stream> start_map(uint64_t size);
-		indefinite_map_writer<Stream> start_map();
+		map_writer<Stream, Options> start_map(uint64_t size);
+		indefinite_map_writer<Stream, Options> start_map();
 	private:
+		template <byte major> auto start_definite_string(uint64_t cb)
+		{
+			if constexpr (has_string_references<Stream>::value)
+			{
+				auto buffered = m_stream.string_references().start_string(cb);
+				if (!buffered)
+					details::write_integer<major>(m_stream, cb);
+				return deduplicating_stream_writer<Stream, major>{ std::move(m_stream), buffered };
+			}
+			else
+			{
+				details::write_integer<major>(m_stream, cb);
+				return std::move(m_stream);
+			}
+		}
+		auto write_float(float x)
+		{
+			stream::write_direct<5>(m_stream, [&](byte* buffer) { return details::encode_float<Options>(buffer, x); });
+			return m_stream.flush();
+		}
+
 		Stream m_stream;
 	};
-	template <class Stream> document_writer<std::decay_t<Stream>> create_writer_no_debug_check(Stream&& s)
+	template <class Options = write_options, class Stream> document_writer<std::decay_t<Stream>, Options> create_writer_no_debug_check(Stream&& s)
 	{
 		return{ std::forward<Stream>(s) };
 	}
-	template <class Stream, class error_handler> auto create_writer(Stream&& s, error_handler e)
+	template <class Options = write_options, class Stream, class error_handler> auto create_writer(Stream&& s, error_handler e)
 	{
-		return sax::make_writer(debug_checks::add_write_checks(create_writer_no_debug_check(std::forward<Stream>(s)), e));
+		return sax::make_writer(debug_checks::add_write_checks(create_writer_no_debug_check<Options>(std::forward<Stream>(s)), e));
 	}
-	template <class Stream> auto create_writer(Stream&& s)
+	template <class Options = write_options, class Stream> auto create_writer(Stream&& s)
 	{
-		return create_writer(std::forward<Stream>(s), debug_checks::default_error_handler{});
+		return create_writer<Options>(std::forward<Stream>(s), debug_checks::default_error_handler{});
 	}
 
-	template <class Stream> class array_writer
+	template <class Stream, class Options> class array_writer
 	{
 	public:
 		array_writer(Stream&& s)
 			: m_stream(std::move(s))
 		{}
 
-		auto append() { return create_writer_no_debug_check(stream::ref(m_stream)); }
+		auto append() { return create_writer_no_debug_check<Options>(stream::ref(m_stream)); }
 		auto flush() { return m_stream.flush(); }
 	private:
 		Stream m_stream;
 	};
-	template <class Stream> class indefinite_array_writer
+	template <class Stream, class Options> class indefinite_array_writer
 	{
 	public:
 		indefinite_array_writer(Stream&& s)
 			: m_stream(std::move(s))
 		{}
-		auto append() { return create_writer_no_debug_check(stream::ref(m_stream)); }
+		auto append() { return create_writer_no_debug_check<Options>(stream::ref(m_stream)); }
 		auto flush()
 		{
 			stream::write(m_stream, static_cast<byte>(0xFF));
 			return m_stream.flush();
 		}
+
+		// Marks (see stream::write_mark) are only supported by indefinite length arrays and maps: the size of the others is already written
+		template <class T = Stream> auto mark() -> decltype(std::declval<T&>().mark()) { return m_stream.mark(); }
+		void rollback(stream::write_mark m) { m_stream.rollback(m); }
+		void commit(stream::write_mark m) { m_stream.commit(m); }
 	private:
 		Stream m_stream;
 	};
-	template <class Stream> array_writer<Stream> document_writer<Stream>::start_array(uint64_t size)
+	template <class Stream, class Options> array_writer<Stream, Options> document_writer<Stream, Options>::start_array(uint64_t size)
 	{
 		details::write_integer<4>(m_stream, size);
 		return{ std::move(m_stream) };
 	}
-	template <class Stream> indefinite_array_writer<Stream> document_writer<Stream>::start_array()
+	template <class Stream, class Options> indefinite_array_writer<Stream, Options> document_writer<Stream, Options>::start_array()
 	{
 		stream::write(m_stream, static_cast<byte>((4 << 5) | 31));
 		return{ std::move(m_stream) };
 	}
 
-	template <class Stream> class map_writer
+	template <class Stream, class Options> class map_writer
 	{
 	public:
 		map_writer(Stream&& s)
 			: m_stream(std::move(s))
 		{}
-		document_writer<stream::writer_ref_type_t<Stream>> append_key() { return{ stream::ref(m_stream) }; }
-		document_writer<stream::writer_ref_type_t<Stream>> append_value() { return{ stream::ref(m_stream) }; }
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append_key() { return{ stream::ref(m_stream) }; }
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append_value() { return{ stream::ref(m_stream) }; }
 		auto flush() { return m_stream.flush(); }
 	private:
 		Stream m_stream;
 	};
-	template <class Stream> class indefinite_map_writer
+	template <class Stream, class Options> class indefinite_map_writer
 	{
 	public:
 		indefinite_map_writer(Stream&& s)
 			: m_stream(std::move(s))
 		{}
-		document_writer<stream::writer_ref_type_t<Stream>> append_key() { return{ stream::ref(m_stream) }; }
-		document_writer<stream::writer_ref_type_t<Stream>> append_value() { return{ stream::ref(m_stream) }; }
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append_key() { return{ stream::ref(m_stream) }; }
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append_value() { return{ stream::ref(m_stream) }; }
 		auto flush()
 		{
 			stream::write(m_stream, static_cast<byte>(0xFF));
 			return m_stream.flush();
 		}
+
+		template <class T = Stream> auto mark() -> decltype(std::declval<T&>().mark()) { return m_stream.mark(); }
+		void rollback(stream::write_mark m) { m_stream.rollback(m); }
+		void commit(stream::write_mark m) { m_stream.commit(m); }
 	private:
 		Stream m_stream;
 	};
-	template <class Stream> map_writer<Stream> document_writer<Stream>::start_map(uint64_t size)
+	template <class Stream, class Options> map_writer<Stream, Options> document_writer<Stream, Options>::start_map(uint64_t size)
 	{
 		details::write_integer<5>(m_stream, size);
 		return{ std::move(m_stream) };
 	}
-	template <class Stream> indefinite_map_writer<Stream> document_writer<Stream>::start_map()
+	template <class Stream, class Options> indefinite_map_writer<Stream, Options> document_writer<Stream, Options>::start_map()
 	{
 		stream::write(m_stream, static_cast<byte>((5 << 5) | 31));
 		return{ std::move(m_stream) };
@@ -17,6 +17,17 @@
 #include <byteswap.h>
 #endif
 
+// SIMD code paths are picked at compile time, based on the instruction sets the compiler is allowed to use
+#if defined(__AVX2__)
+#define GOLDFISH_HAS_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GOLDFISH_HAS_SSE2
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#define GOLDFISH_HAS_SSSE3
+#endif
+
 namespace goldfish
 {
 	using byte = uint8_t;
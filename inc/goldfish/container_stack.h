@@ -0,0 +1,196 @@
+#pragma once
+
+#include "common.h"
+#include "tags.h"
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Documents are skipped (seek_to_end) and copied (document_writer::write) with an explicit stack of the arrays and maps that are open
+// instead of one C++ stack frame per level of nesting, so that deep documents don't overflow the stack
+// The first levels are still handled recursively, which is faster for shallow documents
+// Documents nested deeper than GOLDFISH_MAX_NESTING_DEPTH throw document_too_deep
+#ifndef GOLDFISH_MAX_NESTING_DEPTH
+#define GOLDFISH_MAX_NESTING_DEPTH 100000
+#endif
+
+namespace goldfish
+{
+	struct document_too_deep : exception { document_too_deep() : exception("Document nested too deeply") {} };
+	constexpr size_t max_nesting_depth = GOLDFISH_MAX_NESTING_DEPTH;
+
+	namespace details
+	{
+		// Number of levels handled recursively before the explicit stack is used
+		constexpr size_t recursive_nesting_depth = 16;
+
+		template <class Document> using array_reader_t = typename Document::template type_with_tag_t<tags::array>;
+		template <class Document> using map_reader_t = typename Document::template type_with_tag_t<tags::map>;
+
+		// Type of the documents in an array (or of the keys of a map)
+		template <class Container> auto element_of(Container& c)
+		{
+			if constexpr (std::is_same_v<typename Container::tag, tags::array>)
+				return *c.read();
+			else
+				return *c.read_key();
+		}
+		template <class Container> using element_t = std::decay_t<decltype(element_of(std::declval<Container&>()))>;
+
+		// Arrays, and maps that have keys and values of the same type
+		template <class Container> concept uniform_container = std::is_same_v<typename Container::tag, tags::array> ||
+			std::is_same_v<element_t<Container>, std::decay_t<decltype(std::declval<Container&>().read_value())>>;
+
+		// Documents whose arrays and maps contain documents of the same type
+		// The readers of the first levels of a document can have their own types (for example, the top level document owns its
+		// stream while the others have a reference to it), but they end up repeating: from there, documents of any depth can be read
+		// with a single stack of arrays and maps
+		template <class Document> concept self_similar_document = requires
+		{
+			typename array_reader_t<Document>;
+			typename map_reader_t<Document>;
+		}
+			&& uniform_container<array_reader_t<Document>> && std::is_same_v<element_t<array_reader_t<Document>>, Document>
+			&& uniform_container<map_reader_t<Document>> && std::is_same_v<element_t<map_reader_t<Document>>, Document>;
+
+		// Reads the next element of an array, or the next key or value of a map (value_next tells which one comes next)
+		template <class Container> std::optional<element_t<Container>> read_element(Container& c, bool& value_next)
+		{
+			if constexpr (std::is_same_v<typename Container::tag, tags::array>)
+			{
+				return c.read();
+			}
+			else
+			{
+				if (value_next)
+				{
+					value_next = false;
+					return c.read_value();
+				}
+				auto key = c.read_key();
+				value_next = key.has_value();
+				return key;
+			}
+		}
+
+		// An array or a map of a self similar document, that is being read
+		template <class Document> class open_container
+		{
+		public:
+			open_container(array_reader_t<Document>&& a)
+				: m_container(std::in_place_index<0>, std::move(a))
+			{}
+			open_container(map_reader_t<Document>&& m)
+				: m_container(std::in_place_index<1>, std::move(m))
+			{}
+
+			std::optional<Document> read_element()
+			{
+				if (auto a = std::get_if<0>(&m_container))
+					return a->read();
+				return details::read_element(std::get<1>(m_container), m_value_next);
+			}
+
+			// True when the last element read was the key of a map
+			bool read_key_last() const { return m_value_next; }
+		private:
+			std::variant<array_reader_t<Document>, map_reader_t<Document>> m_container;
+			bool m_value_next = false;
+		};
+
+		// Writer of the next element of an array, or of the next value of a map
+		template <class ContainerWriter> auto append_element(ContainerWriter& w)
+		{
+			if constexpr (requires { w.append_value(); })
+				return w.append_value();
+			else
+				return w.append();
+		}
+		template <class Writer> using array_writer_t = decltype(std::declval<Writer&>().start_array());
+		template <class Writer> using map_writer_t = decltype(std::declval<Writer&>().start_map());
+
+		// Same as self_similar_document, for writers: the elements of arrays and the values of maps are written with the same writer type
+		// (keys can have their own writer, like in JSON where they can only be strings)
+		template <class Writer> concept self_similar_writer = requires(Writer& w)
+		{
+			w.start_array();
+			w.start_map();
+		}
+			&& std::is_same_v<decltype(append_element(std::declval<array_writer_t<Writer>&>())), Writer>
+			&& std::is_same_v<decltype(append_element(std::declval<map_writer_t<Writer>&>())), Writer>;
+
+		// An array or a map of a self similar document, that is being copied to the corresponding writer
+		template <class Document, class Writer> struct copied_container
+		{
+			copied_container(array_reader_t<Document>&& a, array_writer_t<Writer>&& w)
+				: reader(std::move(a))
+				, writer(std::in_place_index<0>, std::move(w))
+			{}
+			copied_container(map_reader_t<Document>&& m, map_writer_t<Writer>&& w)
+				: reader(std::move(m))
+				, writer(std::in_place_index<1>, std::move(w))
+			{}
+
+			open_container<Document> reader;
+			std::variant<array_writer_t<Writer>, map_writer_t<Writer>> writer;
+		};
+
+		// Stack of the arrays and maps that are open
+		// The first elements are stored inline, so that shallow documents don't allocate, and the others in blocks allocated when needed
+		// Elements never move once pushed, which the debug checks rely on (children keep the address of their parent)
+		template <class T, size_t inline_capacity = 8> class container_stack
+		{
+			static constexpr size_t block_size = 64;
+			struct slot { alignas(T) byte data[sizeof(T)]; };
+		public:
+			// depth is the number of arrays and maps the container that owns the stack is nested in
+			explicit container_stack(size_t depth = 0)
+				: m_max_size(depth + 1 < max_nesting_depth ? max_nesting_depth - depth - 1 : 0)
+			{}
+			container_stack(const container_stack&) = delete;
+			container_stack& operator = (const container_stack&) = delete;
+			~container_stack()
+			{
+				while (!empty())
+					pop();
+			}
+
+			bool empty() const { return m_size == 0; }
+			size_t size() const { return m_size; }
+			T& top() { return *std::launder(reinterpret_cast<T*>(address(m_size - 1))); }
+
+			template <class... Args> T& push(Args&&... args)
+			{
+				if (m_size == m_max_size)
+					throw document_too_deep{};
+				if (m_size >= inline_capacity && (m_size - inline_capacity) / block_size == m_blocks.size())
+					m_blocks.push_back(std::make_unique<slot[]>(block_size));
+				auto result = new (address(m_size)) T(std::forward<Args>(args)...);
+				++m_size;
+				return *result;
+			}
+			void pop()
+			{
+				top().~T();
+				--m_size;
+			}
+		private:
+			slot* address(size_t i)
+			{
+				if (i < inline_capacity)
+					return &m_inline[i];
+				i -= inline_capacity;
+				return &m_blocks[i / block_size][i % block_size];
+			}
+
+			slot m_inline[inline_capacity];
+			std::vector<std::unique_ptr<slot[]>> m_blocks;
+			size_t m_size = 0;
+			size_t m_max_size;
+		};
+	}
+}
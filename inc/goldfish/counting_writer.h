@@ -0,0 +1,224 @@
+#pragma once
+
+#include "array_ref.h"
+#include "common.h"
+#include "sax_writer.h"
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// Serialization with definite lengths of objects that don't know their size upfront (for example, objects that
+// use start_array() and then iterate over a container without a size)
+// The object is serialized twice:
+//  - the first pass goes to a counting writer that records the size of each array, map, string and binary string started without a size
+//  - the second pass goes to the actual writer, and the recorded sizes are used each time an array, map, string or binary string is started without a size
+// Only the sizes are kept in memory, not the output of the first pass
+// This requires the serialization to be deterministic (the same sequence of calls on both passes)
+namespace goldfish
+{
+	// Thrown when the sizes computed ahead of time don't match the document being written
+	struct size_table_mismatch : exception { size_table_mismatch() : exception("Size table doesn't match the document") {} };
+
+	namespace details
+	{
+		inline uint64_t next_size(std::span<const uint64_t>& sizes)
+		{
+			if (sizes.empty())
+				throw size_table_mismatch{};
+			return pop_front(sizes);
+		}
+	}
+}
+
+namespace goldfish { namespace counting
+{
+	static const size_t no_slot = std::numeric_limits<size_t>::max();
+
+	// Each writer that was started without a size owns a slot in the size table, which it increments as elements are added
+	class stream_writer
+	{
+	public:
+		stream_writer(std::vector<uint64_t>* sizes, size_t slot)
+			: m_sizes(sizes)
+			, m_slot(slot)
+		{}
+		void write_buffer(std::span<const byte> buffer)
+		{
+			if (m_slot != no_slot)
+				(*m_sizes)[m_slot] += buffer.size();
+		}
+		void flush() {}
+	private:
+		std::vector<uint64_t>* m_sizes;
+		size_t m_slot;
+	};
+
+	class array_writer;
+	class map_writer;
+
+	class document_writer
+	{
+	public:
+		document_writer(std::vector<uint64_t>* sizes)
+			: m_sizes(sizes)
+		{}
+
+		template <class T> void write(T&&) {}
+		template <class T> void write_array(std::span<const T>) {}
+
+		stream_writer start_binary(uint64_t) { return{ m_sizes, no_slot }; }
+		stream_writer start_binary() { return{ m_sizes, new_slot() }; }
+		stream_writer start_string(uint64_t) { return{ m_sizes, no_slot }; }
+		stream_writer start_string() { return{ m_sizes, new_slot() }; }
+		array_writer start_array(uint64_t);
+		array_writer start_array();
+		map_writer start_map(uint64_t);
+		map_writer start_map();
+	private:
+		size_t new_slot()
+		{
+			m_sizes->push_back(0);
+			return m_sizes->size() - 1;
+		}
+		std::vector<uint64_t>* m_sizes;
+	};
+
+	class array_writer
+	{
+	public:
+		array_writer(std::vector<uint64_t>* sizes, size_t slot)
+			: m_sizes(sizes)
+			, m_slot(slot)
+		{}
+		document_writer append()
+		{
+			if (m_slot != no_slot)
+				++(*m_sizes)[m_slot];
+			return{ m_sizes };
+		}
+		void flush() {}
+	private:
+		std::vector<uint64_t>* m_sizes;
+		size_t m_slot;
+	};
+
+	class map_writer
+	{
+	public:
+		map_writer(std::vector<uint64_t>* sizes, size_t slot)
+			: m_sizes(sizes)
+			, m_slot(slot)
+		{}
+		document_writer append_key()
+		{
+			if (m_slot != no_slot)
+				++(*m_sizes)[m_slot];
+			return{ m_sizes };
+		}
+		document_writer append_value() { return{ m_sizes }; }
+		void flush() {}
+	private:
+		std::vector<uint64_t>* m_sizes;
+		size_t m_slot;
+	};
+
+	inline array_writer document_writer::start_array(uint64_t) { return{ m_sizes, no_slot }; }
+	inline array_writer document_writer::start_array() { return{ m_sizes, new_slot() }; }
+	inline map_writer document_writer::start_map(uint64_t) { return{ m_sizes, no_slot }; }
+	inline map_writer document_writer::start_map() { return{ m_sizes, new_slot() }; }
+
+	// Returns a writer that doesn't output anything, but records the sizes of the arrays, maps and strings started without a size
+	inline auto create_writer(std::vector<uint64_t>& sizes) { return sax::make_writer(document_writer{ &sizes }); }
+
+	// Run the serialization of the object on a counting writer and return the size table
+	template <class T> std::vector<uint64_t> compute_sizes(const T& t)
+	{
+		std::vector<uint64_t> sizes;
+		create_writer(sizes).write(t);
+		return sizes;
+	}
+
+	// Writer that replaces calls to start_xxx() by calls to start_xxx(size) using the sizes of the size table
+	template <class inner> class sized_array_writer;
+	template <class inner> class sized_map_writer;
+
+	template <class inner> class sized_document_writer
+	{
+	public:
+		sized_document_writer(inner&& writer, std::span<const uint64_t>* sizes)
+			: m_writer(std::move(writer))
+			, m_sizes(sizes)
+		{}
+
+		template <class T> auto write(T&& t) { return m_writer.write(std::forward<T>(t)); }
+		template <class T> auto write_array(std::span<const T> x) { return m_writer.write_array(x); }
+
+		auto start_binary(uint64_t cb) { return m_writer.start_binary(cb); }
+		auto start_binary() { return m_writer.start_binary(next_size()); }
+		auto start_string(uint64_t cb) { return m_writer.start_string(cb); }
+		auto start_string() { return m_writer.start_string(next_size()); }
+		auto start_array(uint64_t size) { return make_sized_array_writer(m_writer.start_array(size)); }
+		auto start_array() { return make_sized_array_writer(m_writer.start_array(next_size())); }
+		auto start_map(uint64_t size) { return make_sized_map_writer(m_writer.start_map(size)); }
+		auto start_map() { return make_sized_map_writer(m_writer.start_map(next_size())); }
+	private:
+		uint64_t next_size() { return goldfish::details::next_size(*m_sizes); }
+		template <class T> sized_array_writer<std::decay_t<T>> make_sized_array_writer(T&& writer) { return{ std::forward<T>(writer), m_sizes }; }
+		template <class T> sized_map_writer<std::decay_t<T>> make_sized_map_writer(T&& writer) { return{ std::forward<T>(writer), m_sizes }; }
+
+		inner m_writer;
+		std::span<const uint64_t>* m_sizes;
+	};
+	template <class inner> sized_document_writer<std::decay_t<inner>> add_sizes(inner&& writer, std::span<const uint64_t>* sizes) { return{ std::forward<inner>(writer), sizes }; }
+
+	template <class inner> class sized_array_writer
+	{
+	public:
+		sized_array_writer(inner&& writer, std::span<const uint64_t>* sizes)
+			: m_writer(std::move(writer))
+			, m_sizes(sizes)
+		{}
+		auto append() { return add_sizes(m_writer.append(), m_sizes); }
+		auto flush() { return m_writer.flush(); }
+	private:
+		inner m_writer;
+		std::span<const uint64_t>* m_sizes;
+	};
+
+	template <class inner> class sized_map_writer
+	{
+	public:
+		sized_map_writer(inner&& writer, std::span<const uint64_t>* sizes)
+			: m_writer(std::move(writer))
+			, m_sizes(sizes)
+		{}
+		auto append_key() { return add_sizes(m_writer.append_key(), m_sizes); }
+		auto append_value() { return add_sizes(m_writer.append_value(), m_sizes); }
+		auto flush() { return m_writer.flush(); }
+	private:
+		inner m_writer;
+		std::span<const uint64_t>* m_sizes;
+	};
+
+	// Serialize the object to the writer (for example the result of cbor::create_writer) using only definite lengths
+	template <class Writer, class T> auto write_with_definite_sizes(Writer&& writer, const T& t)
+	{
+		auto sizes = compute_sizes(t);
+		std::span<const uint64_t> remaining_sizes = sizes;
+		auto writer_with_sizes = sax::make_writer(add_sizes(std::forward<Writer>(writer), &remaining_sizes));
+
+		if constexpr (std::is_void_v<decltype(writer_with_sizes.write(t))>)
+		{
+			writer_with_sizes.write(t);
+			if (!remaining_sizes.empty())
+				throw size_table_mismatch{};
+		}
+		else
+		{
+			auto result = writer_with_sizes.write(t);
+			if (!remaining_sizes.empty())
+				throw size_table_mismatch{};
+			return result;
+		}
+	}
+}}
@@ -0,0 +1,473 @@
+#pragma once
+
+#include "buffered_stream.h"
+#include "cbor_reader.h"
+#include "json_reader.h"
+#include "json_writer.h"
+#include "stream.h"
+#include <string_view>
+#include <vector>
+
+// Flat token cursors: the document is read as a sequence of tokens by a single state machine, without creating a document object
+// for each element. Nesting is only tracked by a stack of containers, so deep documents don't instantiate deep template chains
+//   auto c = json::create_cursor(stream::read_string_ref(text));
+//   while (c.next_token().type != token_type::end_of_document) ...
+// Unlike the document readers, the tokens are not converted: JSON strings are never read as numbers or base64 binary
+namespace goldfish
+{
+	enum class token_type : uint8_t
+	{
+		null,
+		undefined,
+		boolean,
+		unsigned_int,
+		signed_int,
+		floating_point,
+		string,
+		binary,
+		start_array,
+		end_array,
+		start_map,
+		end_map,
+		end_of_document,
+	};
+
+	struct token
+	{
+		token_type type = token_type::end_of_document;
+		bool key = false; // true for the keys of maps
+
+		// Value of the token, the member named after the type of the token is set
+		bool boolean = false;
+		uint64_t unsigned_int = 0;
+		int64_t signed_int = 0;
+		double floating_point = 0;
+		std::span<const byte> bytes; // strings (UTF8) and binary strings, only valid until the next call to next_token
+
+		// Like the document readers, numbers can be converted to any number type as long as no information is lost
+		bool as_bool() const
+		{
+			if (type != token_type::boolean)
+				throw std::bad_variant_access{};
+			return boolean;
+		}
+		uint64_t as_uint64() const
+		{
+			switch (type)
+			{
+			case token_type::unsigned_int: return unsigned_int;
+			case token_type::signed_int: return details::cast_signed_to_unsigned(signed_int);
+			case token_type::floating_point: return details::cast_double_to_unsigned(floating_point);
+			default: throw std::bad_variant_access{};
+			}
+		}
+		int64_t as_int64() const
+		{
+			switch (type)
+			{
+			case token_type::signed_int: return signed_int;
+			case token_type::unsigned_int: return details::cast_unsigned_to_signed(unsigned_int);
+			case token_type::floating_point: return details::cast_double_to_signed(floating_point);
+			default: throw std::bad_variant_access{};
+			}
+		}
+		double as_double() const
+		{
+			switch (type)
+			{
+			case token_type::floating_point: return floating_point;
+			case token_type::unsigned_int: return static_cast<double>(unsigned_int);
+			case token_type::signed_int: return static_cast<double>(signed_int);
+			default: throw std::bad_variant_access{};
+			}
+		}
+		std::string_view as_string() const
+		{
+			if (type != token_type::string)
+				throw std::bad_variant_access{};
+			return{ reinterpret_cast<const char*>(bytes.data()), bytes.size() };
+		}
+		std::span<const byte> as_binary() const
+		{
+			if (type != token_type::binary)
+				throw std::bad_variant_access{};
+			return bytes;
+		}
+	};
+
+	namespace details
+	{
+		// Read the next value of the cursor, with all its elements if it's an array or a map
+		template <class Cursor> void skip_value(Cursor& cursor)
+		{
+			auto depth = cursor.depth();
+			auto type = cursor.next_token().type;
+			if (type == token_type::start_array || type == token_type::start_map)
+			{
+				while (cursor.depth() > depth)
+					cursor.next_token();
+			}
+		}
+
+		// The cursors read the input through a buffer of this size, strings that fit in the buffer are not copied
+		template <class Stream> using cursor_input = stream::buffered_reader<typical_buffer_length, Stream>;
+
+		inline token make_token(token_type type, bool key)
+		{
+			token result;
+			result.type = type;
+			result.key = key;
+			return result;
+		}
+		template <class T> token make_number_token(T x, bool key)
+		{
+			token result;
+			result.key = key;
+			if constexpr (std::is_same_v<T, uint64_t>) { result.type = token_type::unsigned_int; result.unsigned_int = x; }
+			else if constexpr (std::is_same_v<T, int64_t>) { result.type = token_type::signed_int; result.signed_int = x; }
+			else { result.type = token_type::floating_point; result.floating_point = x; }
+			return result;
+		}
+		inline token make_bytes_token(token_type type, std::span<const byte> bytes, bool key)
+		{
+			auto result = make_token(type, key);
+			result.bytes = bytes;
+			return result;
+		}
+	}
+
+	namespace json
+	{
+		template <class Stream> class cursor
+		{
+		public:
+			cursor(Stream&& s)
+				: m_stream(std::move(s))
+			{}
+
+			// Returns the next token of the document, or a token of type end_of_document once the document is complete
+			// The keys of maps are strings, followed by the token of their value
+			token next_token()
+			{
+				switch (m_state)
+				{
+				case state::done:
+					return goldfish::details::make_token(token_type::end_of_document, false);
+
+				case state::after_key:
+					if (details::read_non_space(m_stream) != ':')
+						throw ill_formatted_json_data{ "':' expected between JSON key and value" };
+					return read_value(details::read_non_space(m_stream));
+
+				case state::first_element:
+				{
+					auto c = details::read_non_space(m_stream);
+					if (c == m_closing_characters.back())
+						return close_container();
+					return read_element(c);
+				}
+
+				case state::after_value:
+				{
+					if (m_closing_characters.empty())
+					{
+						m_state = state::done;
+						return goldfish::details::make_token(token_type::end_of_document, false);
+					}
+					auto c = details::read_non_space(m_stream);
+					if (c == m_closing_characters.back())
+						return close_container();
+					if (c != ',')
+						throw ill_formatted_json_data{ "Invalid delimiter in JSON array or map" };
+					return read_element(details::read_non_space(m_stream));
+				}
+
+				default:
+					return read_value(details::read_non_space(m_stream));
+				}
+			}
+
+			// Skip the next value (the whole array or map if the next token starts one)
+			void skip_value() { goldfish::details::skip_value(*this); }
+
+			// Number of arrays and maps started and not ended yet
+			size_t depth() const { return m_closing_characters.size(); }
+
+		private:
+			enum class state : uint8_t { start, first_element, after_key, after_value, done };
+
+			token close_container()
+			{
+				auto type = m_closing_characters.back() == ']' ? token_type::end_array : token_type::end_map;
+				m_closing_characters.pop_back();
+				m_state = state::after_value;
+				return goldfish::details::make_token(type, false);
+			}
+			token read_element(char c)
+			{
+				if (m_closing_characters.back() == ']')
+					return read_value(c);
+
+				if (c != '"')
+					throw ill_formatted_json_data{ "Only strings are supported for JSON keys" };
+				m_state = state::after_key;
+				return goldfish::details::make_bytes_token(token_type::string, read_string(), true /*key*/);
+			}
+			token read_value(char c)
+			{
+				m_state = state::after_value;
+				switch (c)
+				{
+				case '[':
+				case '{':
+					m_closing_characters.push_back(c == '[' ? ']' : '}');
+					m_state = state::first_element;
+					return goldfish::details::make_token(c == '[' ? token_type::start_array : token_type::start_map, false);
+				case '"':
+					return goldfish::details::make_bytes_token(token_type::string, read_string(), false);
+				case 't':
+				{
+					details::throw_if_stream_isnt(m_stream, { 'r', 'u', 'e' });
+					auto result = goldfish::details::make_token(token_type::boolean, false);
+					result.boolean = true;
+					return result;
+				}
+				case 'f':
+					details::throw_if_stream_isnt(m_stream, { 'a', 'l', 's', 'e' });
+					return goldfish::details::make_token(token_type::boolean, false);
+				case 'n':
+					details::throw_if_stream_isnt(m_stream, { 'u', 'l', 'l' });
+					return goldfish::details::make_token(token_type::null, false);
+				case '-':
+				case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+					return std::visit([](auto x) { return goldfish::details::make_number_token(x, false); }, read_number(m_stream, c));
+				default:
+					throw ill_formatted_json_data{ "Invalid first character for JSON document" };
+				}
+			}
+
+			// Read a string whose opening quote has been read
+			// Strings without escape sequences that end in the buffer are returned in place, the others are unescaped in m_string
+			std::span<const byte> read_string()
+			{
+				auto data = m_stream.peek_buffer();
+				auto special = details::find_escape<true>(data.data(), data.data() + data.size());
+				if (special != data.data() + data.size() && *special == '"')
+				{
+					auto cb = static_cast<size_t>(special - data.data());
+					stream::seek(m_stream, cb + 1);
+					return data.first(cb);
+				}
+
+				m_string.clear();
+				for (;;)
+				{
+					data = m_stream.peek_buffer();
+					if (data.empty())
+						throw stream::unexpected_end_of_stream{};
+					special = details::find_escape<true>(data.data(), data.data() + data.size());
+					m_string.insert(m_string.end(), data.data(), special);
+					stream::seek(m_stream, special - data.data());
+					if (special == data.data() + data.size())
+						continue;
+
+					auto c = stream::read<byte>(m_stream);
+					if (c == '"')
+						return m_string;
+					if (c != '\\')
+						throw ill_formatted_json_data{ "Invalid character in JSON string" };
+
+					byte converted[4];
+					m_string.insert(m_string.end(), converted, converted + details::read_escape_sequence(m_stream, converted));
+				}
+			}
+
+			goldfish::details::cursor_input<Stream> m_stream;
+			std::vector<char> m_closing_characters; // ']' or '}' for each array or map not closed yet
+			std::vector<byte> m_string;
+			state m_state = state::start;
+		};
+
+		// The input is read by blocks: bytes after the end of the document may be consumed
+		template <class Stream> cursor<std::decay_t<Stream>> create_cursor(Stream&& s) { return{ std::forward<Stream>(s) }; }
+	}
+
+	namespace cbor
+	{
+		template <class Stream> class cursor
+		{
+		public:
+			cursor(Stream&& s)
+				: m_stream(std::move(s))
+			{}
+
+			// Returns the next token of the document, or a token of type end_of_document once the document is complete
+			// Tags are skipped, keys of maps can be of any type
+			token next_token()
+			{
+				if (m_done)
+					return goldfish::details::make_token(token_type::end_of_document, false);
+
+				bool key = false;
+				byte b;
+				if (m_containers.empty())
+				{
+					b = stream::read<byte>(m_stream);
+				}
+				else
+				{
+					auto& top = m_containers.back();
+					if (top.remaining_items == 0)
+						return close_container();
+
+					b = stream::read<byte>(m_stream);
+					if (b == 0xFF)
+					{
+						if (top.remaining_items != indefinite)
+							throw ill_formatted_cbor_data{ top.map ? "Unexpected break code found in finite length map" : "Unexpected break code found in finite length array" };
+						if (top.map && top.items_read % 2 == 1)
+							throw ill_formatted_cbor_data{ "Unexpected break code found as a map value" };
+						return close_container();
+					}
+
+					key = top.map && top.items_read % 2 == 0;
+					++top.items_read;
+					if (top.remaining_items != indefinite)
+						--top.remaining_items;
+				}
+
+				// Tags are skipped
+				while ((b >> 5) == 6)
+				{
+					read_integer(static_cast<byte>(b & 31), m_stream);
+					b = stream::read<byte>(m_stream);
+				}
+
+				auto result = read_value(b, key);
+				m_done = m_containers.empty();
+				return result;
+			}
+
+			// Skip the next value (the whole array or map if the next token starts one)
+			void skip_value() { goldfish::details::skip_value(*this); }
+
+			// Number of arrays and maps started and not ended yet
+			size_t depth() const { return m_containers.size(); }
+
+		private:
+			static constexpr uint64_t indefinite = std::numeric_limits<uint64_t>::max();
+			struct container
+			{
+				uint64_t remaining_items; // for maps, keys and values are counted separately
+				uint64_t items_read;
+				bool map;
+			};
+
+			token close_container()
+			{
+				auto type = m_containers.back().map ? token_type::end_map : token_type::end_array;
+				m_containers.pop_back();
+				m_done = m_containers.empty();
+				return goldfish::details::make_token(type, false);
+			}
+			token read_value(byte b, bool key)
+			{
+				switch (b >> 5)
+				{
+				case 0:
+					return goldfish::details::make_number_token(read_integer(static_cast<byte>(b & 31), m_stream), key);
+				case 1:
+				{
+					auto x = read_integer(static_cast<byte>(b & 31), m_stream);
+					if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+						throw ill_formatted_cbor_data{ "CBOR signed integer too large" };
+					return goldfish::details::make_number_token(-1 - static_cast<int64_t>(x), key);
+				}
+				case 2:
+					return goldfish::details::make_bytes_token(token_type::binary, read_string<2>(b), key);
+				case 3:
+					return goldfish::details::make_bytes_token(token_type::string, read_string<3>(b), key);
+				case 4:
+				case 5:
+				{
+					bool map = (b >> 5) == 5;
+					uint64_t size = (b & 31) == 31 ? indefinite : read_integer(static_cast<byte>(b & 31), m_stream);
+					if (size != indefinite && (size == indefinite - 1 || (map && size > indefinite / 2)))
+						throw ill_formatted_cbor_data{ map ? "CBOR map too large" : "CBOR array too large" };
+					m_containers.push_back({ map && size != indefinite ? size * 2 : size, 0, map });
+					return goldfish::details::make_token(map ? token_type::start_map : token_type::start_array, key);
+				}
+				default:
+					switch (b)
+					{
+					case (7 << 5) | 20: return goldfish::details::make_token(token_type::boolean, key);
+					case (7 << 5) | 21:
+					{
+						auto result = goldfish::details::make_token(token_type::boolean, key);
+						result.boolean = true;
+						return result;
+					}
+					case (7 << 5) | 22: return goldfish::details::make_token(token_type::null, key);
+					case (7 << 5) | 23: return goldfish::details::make_token(token_type::undefined, key);
+					case (7 << 5) | 25: return goldfish::details::make_number_token(read_half_point_float(m_stream), key);
+					case (7 << 5) | 26: return goldfish::details::make_number_token(double{ to_float(from_big_endian(stream::read<uint32_t>(m_stream))) }, key);
+					case (7 << 5) | 27: return goldfish::details::make_number_token(to_double(from_big_endian(stream::read<uint64_t>(m_stream))), key);
+					case 0xFF: throw ill_formatted_cbor_data{ "Unexpected break code in CBOR stream" };
+					default: throw ill_formatted_cbor_data{ "Unexpected CBOR opcode" };
+					}
+				}
+			}
+
+			// Read a string whose first byte has been read
+			// Definite length strings that are in the buffer are returned in place, the others are copied in m_string
+			template <byte major> std::span<const byte> read_string(byte first_byte)
+			{
+				if ((first_byte & 31) != 31)
+				{
+					auto cb = read_integer(static_cast<byte>(first_byte & 31), m_stream);
+					auto data = m_stream.peek_buffer();
+					if (cb <= data.size())
+					{
+						stream::seek(m_stream, cb);
+						return data.first(static_cast<size_t>(cb));
+					}
+					m_string.clear();
+					append_to_string(cb);
+					return m_string;
+				}
+
+				m_string.clear();
+				for (;;)
+				{
+					auto b = stream::read<byte>(m_stream);
+					if (b == 0xFF)
+						return m_string;
+					if ((b >> 5) != major)
+						throw ill_formatted_cbor_data{ "Unexpected type in CBOR string block" };
+					append_to_string(read_integer(static_cast<byte>(b & 31), m_stream));
+				}
+			}
+			void append_to_string(uint64_t cb)
+			{
+				while (cb != 0)
+				{
+					auto data = m_stream.peek_buffer();
+					if (data.empty())
+						throw stream::unexpected_end_of_stream{};
+					auto part = data.first(static_cast<size_t>(std::min<uint64_t>(cb, data.size())));
+					m_string.insert(m_string.end(), part.begin(), part.end());
+					stream::seek(m_stream, part.size());
+					cb -= part.size();
+				}
+			}
+
+			goldfish::details::cursor_input<Stream> m_stream;
+			std::vector<container> m_containers;
+			std::vector<byte> m_string;
+			bool m_done = false;
+		};
+
+		// The input is read by blocks: bytes after the end of the document may be consumed
+		template <class Stream> cursor<std::decay_t<Stream>> create_cursor(Stream&& s) { return{ std::forward<Stream>(s) }; }
+	}
+}
@@ -18,7 +18,11 @@ namespace goldfish { namespace debug_checks
 		#define GOLDFISH_DEFAULT_SHIP_ERROR_HANDLER no_check
 	#endif
 
-	#ifndef NDEBUG
+	// With no_check, add_read_checks and add_write_checks return the readers and writers unchanged (no wrapper, no bookkeeping)
+	// Defining GOLDFISH_NO_DEBUG_CHECKS uses no_check by default even when NDEBUG isn't defined
+	#if defined(GOLDFISH_NO_DEBUG_CHECKS)
+	using default_error_handler = no_check;
+	#elif !defined(NDEBUG)
 	using default_error_handler = terminate_on_error;
 	#else
 	using default_error_handler = GOLDFISH_DEFAULT_SHIP_ERROR_HANDLER;
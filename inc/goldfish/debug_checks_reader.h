@@ -2,9 +2,11 @@
 
 #include "array_ref.h"
 #include "debug_checks.h"
+#include "key_matcher.h"
 #include "sax_reader.h"
 #include "tags.h"
 #include <type_traits>
+#include <vector>
 
 namespace goldfish { namespace debug_checks
 {
@@ -14,7 +16,7 @@ namespace goldfish { namespace debug_checks
 
 	template <bool does_json_conversions_, class Document, class error_handler>
 	struct DocTraits {
-		using VariantT = std::variant<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
+		using VariantT = tagged_union<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
 			string<error_handler, typename Document::template type_with_tag_t<tags::string>, tags::string>,
 			string<error_handler, typename Document::template type_with_tag_t<tags::binary>, tags::binary>,
 			array<error_handler, typename Document::template type_with_tag_t<tags::array>>,
@@ -28,6 +30,7 @@ namespace goldfish { namespace debug_checks
 			map<error_handler, typename Document::template type_with_tag_t<tags::map>>>;
 
 		static constexpr bool does_json_conversions = does_json_conversions_;
+		static constexpr bool does_string_conversions = Document::does_string_conversions;
 	};
 
 	template <class error_handler, class Document> struct document : document_impl<DocTraits<Document::does_json_conversions, Document, error_handler>>
@@ -73,6 +76,7 @@ namespace goldfish { namespace debug_checks
 	template <class error_handler, class T> class array : private container_base<error_handler>
 	{
 		using container_base<error_handler>::unlock_parent;
+		using container_base<error_handler>::lock_parent;
 		using container_base<error_handler>::err_if_locked;
 	public:
 		using tag = tags::array;
@@ -97,6 +101,37 @@ namespace goldfish { namespace debug_checks
 				return std::nullopt;
 			}
 		}
+		template <class U> size_t read_into(std::span<U> out)
+		{
+			err_if_locked();
+
+			auto count = m_inner.read_into(out);
+			if (count < out.size())
+				unlock_parent();
+			return count;
+		}
+		template <class U> void read_all_into(std::vector<U>& out)
+		{
+			err_if_locked();
+
+			m_inner.read_all_into(out);
+			unlock_parent();
+		}
+		std::optional<uint64_t> remaining_length() const { return m_inner.remaining_length(); }
+
+		// The elements read before the bookmark and after it must be finished (read to their end) before bookmarking and rewinding
+		// Rewinding an array that reached its end locks the parent again
+		template <class U = T> auto bookmark() const -> decltype(std::declval<const U&>().bookmark())
+		{
+			err_if_locked();
+			return m_inner.bookmark();
+		}
+		template <class U = T> auto rewind(container_bookmark b) -> decltype(std::declval<U&>().rewind(b))
+		{
+			err_if_locked();
+			lock_parent();
+			m_inner.rewind(b);
+		}
 	private:
 		T m_inner;
 	};
@@ -106,6 +141,7 @@ namespace goldfish { namespace debug_checks
 	template <class error_handler, class T> class map : public container_base<error_handler>
 	{
 		using container_base<error_handler>::unlock_parent;
+		using container_base<error_handler>::lock_parent;
 		using container_base<error_handler>::err_if_locked;
 		using container_base<error_handler>::err_if_flag_set;
 		using container_base<error_handler>::err_if_flag_not_set;
@@ -135,6 +171,35 @@ namespace goldfish { namespace debug_checks
 				return std::nullopt;
 			}
 		}
+		template <class Matcher> std::optional<size_t> read_key_match(const Matcher& matcher)
+		{
+			err_if_locked();
+			err_if_flag_set();
+
+			auto index = m_inner.read_key_match(matcher);
+			if (index)
+				set_flag();
+			else
+				unlock_parent();
+			return index;
+		}
+		template <size_t N> std::optional<size_t> read_key_match(const std::string_view(&keys)[N]) { return read_key_match(key_matcher<N>(keys)); }
+		std::optional<uint64_t> remaining_length() const { return m_inner.remaining_length(); }
+
+		// Maps can only be bookmarked between a value and the next key, once that value is finished
+		template <class U = T> auto bookmark() const -> decltype(std::declval<const U&>().bookmark())
+		{
+			err_if_locked();
+			err_if_flag_set();
+			return m_inner.bookmark();
+		}
+		template <class U = T> auto rewind(container_bookmark b) -> decltype(std::declval<U&>().rewind(b))
+		{
+			err_if_locked();
+			clear_flag();
+			lock_parent();
+			m_inner.rewind(b);
+		}
 		auto read_value()
 		{
 			err_if_locked();
@@ -85,6 +85,19 @@ namespace goldfish { namespace debug_checks
 			unlock_parent_and_lock_self();
 			return m_writer.flush();
 		}
+
+		// Marks can only be taken and rolled back between elements (not while an element is being written)
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark())
+		{
+			err_if_locked();
+			return m_writer.mark();
+		}
+		template <class Mark> void rollback(const Mark& m)
+		{
+			err_if_locked();
+			m_writer.rollback(m);
+		}
+		template <class Mark> void commit(const Mark& m) { m_writer.commit(m); }
 	private:
 		inner m_writer;
 	};
@@ -153,6 +166,21 @@ namespace goldfish { namespace debug_checks
 			unlock_parent_and_lock_self();
 			return m_writer.flush();
 		}
+
+		// Marks can only be taken and rolled back between key value pairs
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark())
+		{
+			err_if_locked();
+			err_if_flag_set();
+			return m_writer.mark();
+		}
+		template <class Mark> void rollback(const Mark& m)
+		{
+			err_if_locked();
+			clear_flag();
+			m_writer.rollback(m);
+		}
+		template <class Mark> void commit(const Mark& m) { m_writer.commit(m); }
 	private:
 		inner m_writer;
 	};
@@ -207,6 +235,12 @@ namespace goldfish { namespace debug_checks
 			unlock_parent_and_lock_self();
 			return m_writer.write(std::forward<T>(t));
 		}
+		template <class T> auto write_array(std::span<const T> x)
+		{
+			err_if_locked();
+			unlock_parent_and_lock_self();
+			return m_writer.write_array(x);
+		}
 
 		auto start_binary(uint64_t cb)
 		{
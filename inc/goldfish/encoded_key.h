@@ -0,0 +1,113 @@
+#pragma once
+
+#include "array_ref.h"
+#include "common.h"
+#include <string_view>
+
+// Strings encoded ahead of time for the JSON and CBOR writers
+// Objects often use the same keys over and over: an encoded_key holds the JSON encoding (quoted and escaped) and the
+// CBOR encoding (header and text) of a string, and the writers copy those bytes to the stream instead of encoding the string each time
+// Encoded keys can be written as map keys or as string values:
+//   static constexpr encoded_key name_key("name");
+//   map.write(name_key, "John");
+//   map.write("type", encoded_key("person"));
+namespace goldfish
+{
+	namespace json { namespace details
+	{
+		// Escape sequences of the characters that need to be escaped in a JSON string (the size is 0 for the other characters)
+		struct escape_sequences
+		{
+			constexpr escape_sequences()
+			{
+				for (int c = 0; c < 0x20; ++c)
+				{
+					const char data[6] = { '\\', 'u', '0', '0', "0123456789ABCDEF"[c / 16], "0123456789ABCDEF"[c % 16] };
+					for (int i = 0; i < 6; ++i)
+						sequences[c][i] = static_cast<byte>(data[i]);
+					sizes[c] = 6;
+				}
+				set_short('\b', 'b');
+				set_short('\n', 'n');
+				set_short('\r', 'r');
+				set_short('\t', 't');
+				set_short('"', '"');
+				set_short('\\', '\\');
+			}
+			constexpr void set_short(byte c, char escaped)
+			{
+				sequences[c][0] = '\\';
+				sequences[c][1] = static_cast<byte>(escaped);
+				sizes[c] = 2;
+			}
+			byte sequences[0x60][6] = {};
+			byte sizes[0x60] = {};
+		};
+		inline constexpr escape_sequences escape_table;
+	}}
+
+	// Thrown when the text doesn't fit in the encoded_key
+	struct encoded_key_too_long : exception { encoded_key_too_long() : exception("Text too long for encoded_key") {} };
+
+	// N is the maximum length of the text (the length of the literal when created from a literal)
+	template <size_t N> class encoded_key
+	{
+	public:
+		constexpr encoded_key(const char(&text)[N + 1])
+			: encoded_key(std::string_view{ text, N })
+		{}
+		constexpr explicit encoded_key(std::string_view text)
+		{
+			if (text.size() > N)
+				throw encoded_key_too_long{};
+
+			for (auto c : text)
+				m_text[m_text_size++] = c;
+
+			m_json[m_json_size++] = '"';
+			for (auto c : text)
+			{
+				auto x = static_cast<byte>(c);
+				if (x < 0x60 && json::details::escape_table.sizes[x] != 0)
+				{
+					for (int i = 0; i < json::details::escape_table.sizes[x]; ++i)
+						m_json[m_json_size++] = json::details::escape_table.sequences[x][i];
+				}
+				else
+				{
+					m_json[m_json_size++] = x;
+				}
+			}
+			m_json[m_json_size++] = '"';
+
+			// Major type 3 (text string), shortest header for the length
+			uint64_t cb = text.size();
+			auto write_header = [&](byte additional_info, int cb_length)
+			{
+				m_cbor[m_cbor_size++] = static_cast<byte>((3 << 5) | additional_info);
+				for (int i = cb_length - 1; i >= 0; --i)
+					m_cbor[m_cbor_size++] = static_cast<byte>(cb >> (8 * i));
+			};
+			if (cb <= 23) write_header(static_cast<byte>(cb), 0);
+			else if (cb <= 0xFF) write_header(24, 1);
+			else if (cb <= 0xFFFF) write_header(25, 2);
+			else if (cb <= 0xFFFFFFFF) write_header(26, 4);
+			else write_header(27, 8);
+			for (auto c : text)
+				m_cbor[m_cbor_size++] = static_cast<byte>(c);
+		}
+
+		constexpr std::string_view text() const { return{ m_text, m_text_size }; }
+		constexpr std::span<const byte> json() const { return{ m_json, m_json_size }; }
+		constexpr std::span<const byte> cbor() const { return{ m_cbor, m_cbor_size }; }
+
+	private:
+		char m_text[N == 0 ? 1 : N] = {};
+		size_t m_text_size = 0;
+		byte m_json[N * 6 + 2] = {};
+		size_t m_json_size = 0;
+		byte m_cbor[N + 9] = {};
+		size_t m_cbor_size = 0;
+	};
+	template <size_t N> encoded_key(const char(&)[N]) -> encoded_key<N - 1>;
+}
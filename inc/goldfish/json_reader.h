@@ -2,6 +2,7 @@
 
 #include "base64_stream.h"
 #include "debug_checks_reader.h"
+#include "key_matcher.h"
 #include "tags.h"
 #include <variant>
 #include "stream.h"
@@ -10,32 +11,50 @@
 #include <cmath>
 #include <charconv>
 #include <cstdlib>
+#include <bit>
+#include <vector>
 
 namespace goldfish { namespace json
 {
 	struct integer_overflow_in_json : ill_formatted_json_data { using ill_formatted_json_data::ill_formatted_json_data; };
 
+	// Reader policies, picked with json::read<Policy>(stream)
+	// relaxed (the default) reads numbers and booleans out of strings (as_double on "1.5"), and binary data out of base64 strings
+	// strict only reads documents as their own type (numbers can still be converted to other numeric types), which keeps
+	// the accessors down to a type check and a load
+	struct relaxed
+	{
+		static constexpr bool does_json_conversions = true;
+		static constexpr bool does_string_conversions = true;
+	};
+	struct strict
+	{
+		static constexpr bool does_json_conversions = false;
+		static constexpr bool does_string_conversions = false;
+	};
+
 	class byte_string;
 	template <class Stream> class text_string;
-	template <class Stream> class array;
-	template <class Stream> class map;
+	template <class Stream, class Policy = relaxed> class array;
+	template <class Stream, class Policy = relaxed> class map;
 
-	template <class Stream>
+	template <class Stream, class Policy>
 	struct DocTraits {
-		using VariantT = std::variant<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
-			byte_string, text_string<Stream>, array<Stream>, map<Stream>>;
+		using VariantT = tagged_union<bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
+			byte_string, text_string<Stream>, array<Stream, Policy>, map<Stream, Policy>>;
 
 		template <class tag> using type_with_tag_t = ::goldfish::tags::type_with_tag_t<tag,
 			bool, std::nullptr_t, uint64_t, int64_t, double, undefined,
-			byte_string, text_string<Stream>, array<Stream>, map<Stream>>;
+			byte_string, text_string<Stream>, array<Stream, Policy>, map<Stream, Policy>>;
 
-		static constexpr bool does_json_conversions = true;
+		static constexpr bool does_json_conversions = Policy::does_json_conversions;
+		static constexpr bool does_string_conversions = Policy::does_string_conversions;
 	};
-	template <class Stream> struct document : document_impl<DocTraits<Stream>>
+	template <class Stream, class Policy = relaxed> struct document : document_impl<DocTraits<Stream, Policy>>
 	{
-		using document_impl<DocTraits<Stream>>::document_impl;
+		using document_impl<DocTraits<Stream, Policy>>::document_impl;
 	};
-	template <class Stream> document<std::decay_t<Stream>> read_no_debug_check(Stream&& s);
+	template <class Policy = relaxed, class Stream> document<std::decay_t<Stream>, Policy> read_no_debug_check(Stream&& s);
 
 	namespace details
 	{
@@ -67,6 +86,106 @@ namespace goldfish { namespace json
 					throw ill_formatted_json_data{ "Unexpected JSON document value" };
 			}
 		}
+
+		inline uint8_t parse_hex(char c)
+		{
+			if ('0' <= c && c <= '9') return c - '0';
+			else if ('a' <= c && c <= 'f') return c - 'a' + 10;
+			else if ('A' <= c && c <= 'F') return c - 'A' + 10;
+			else throw ill_formatted_json_data{ "Invalid hexadecimal digit" };
+		}
+		template <class Stream> uint16_t read_utf16_character(Stream& s)
+		{
+			uint16_t value = 0;
+			value = (value << 4) | parse_hex(stream::read<char>(s));
+			value = (value << 4) | parse_hex(stream::read<char>(s));
+			value = (value << 4) | parse_hex(stream::read<char>(s));
+			value = (value << 4) | parse_hex(stream::read<char>(s));
+			return value;
+		}
+		template <class Stream> uint32_t read_utf32_character(Stream& s)
+		{
+			uint32_t a = read_utf16_character(s);
+			if (0xD800 <= a && a <= 0xDFFF)
+			{
+				if (a > 0xDBFF)
+					throw ill_formatted_json_data{ "Invalid UTF32 encoding" };
+
+				// We need a second character
+				if (stream::read<char>(s) != '\\') throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
+				if (stream::read<char>(s) != 'u') throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
+				uint32_t b = read_utf16_character(s);
+				if (b < 0xDC00 || b > 0xDFFF)
+					throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
+
+				a -= 0xD800;
+				b -= 0xDC00;
+				return 0x10000 | (a << 10) | b;
+			}
+			else
+			{
+				return a;
+			}
+		}
+
+		// Write the UTF8 encoding of codepoint to output and return the number of bytes used (at most 4)
+		inline size_t encode_utf8(uint32_t codepoint, byte* output)
+		{
+			auto get_6_bits = [&](int offset)
+			{
+				return static_cast<byte>(0b10000000 | ((codepoint >> offset) & 0b111111));
+			};
+
+			if (codepoint <= 0x7F)
+			{
+				output[0] = static_cast<byte>(codepoint);
+				return 1;
+			}
+			else if (codepoint <= 0x7FF)
+			{
+				output[0] = static_cast<byte>(0b11000000 | (codepoint >> 6));
+				output[1] = get_6_bits(0);
+				return 2;
+			}
+			else if (codepoint <= 0xFFFF)
+			{
+				output[0] = static_cast<byte>(0b11100000 | (codepoint >> 12));
+				output[1] = get_6_bits(6);
+				output[2] = get_6_bits(0);
+				return 3;
+			}
+			else if (codepoint <= 0x10FFFF)
+			{
+				output[0] = static_cast<byte>(0b11110000 | (codepoint >> 18));
+				output[1] = get_6_bits(12);
+				output[2] = get_6_bits(6);
+				output[3] = get_6_bits(0);
+				return 4;
+			}
+			else
+			{
+				throw ill_formatted_json_data{ "Invalid UTF32 encoding" };
+			}
+		}
+
+		// Read the escape sequence that follows a \\ in a JSON string, write the UTF8 text it stands for to output,
+		// and return the number of bytes used (at most 4)
+		template <class Stream> size_t read_escape_sequence(Stream& s, byte* output)
+		{
+			switch (stream::read<byte>(s))
+			{
+			case '"':  output[0] = '"';  return 1;
+			case '\\': output[0] = '\\'; return 1;
+			case '/':  output[0] = '/';  return 1;
+			case 'b':  output[0] = '\b'; return 1;
+			case 'f':  output[0] = '\f'; return 1;
+			case 'n':  output[0] = '\n'; return 1;
+			case 'r':  output[0] = '\r'; return 1;
+			case 't':  output[0] = '\t'; return 1;
+			case 'u':  return encode_utf8(read_utf32_character(s), output);
+			default: throw ill_formatted_json_data("Invalid escape sequence in JSON string");
+			}
+		}
 	}
 
 	class byte_string
@@ -141,27 +260,14 @@ namespace goldfish { namespace json
 				switch (lookup[c])
 				{
 				case E:
-					switch (stream::read<byte>(m_stream))
-					{
-					case '"':  pop_front(buffer) = '"';  break;
-					case '\\': pop_front(buffer) = '\\'; break;
-					case '/':  pop_front(buffer) = '/';  break;
-					case 'b':  pop_front(buffer) = '\b'; break;
-					case 'f':  pop_front(buffer) = '\f'; break;
-					case 'n':  pop_front(buffer) = '\n'; break;
-					case 'r':  pop_front(buffer) = '\r'; break;
-					case 't':  pop_front(buffer) = '\t'; break;
-					case 'u':
-					{
-						auto converted = compute_converted(read_utf32_character());
-						std::copy(converted.begin() + 1, converted.end(), m_converted.begin());
-						pop_front(buffer) = converted.front();
-						copy_from_converted(buffer);
-						break;
-					}
-					default: throw ill_formatted_json_data("Invalid escape sequence in JSON string");
-					}
+				{
+					byte converted[4];
+					auto cb = details::read_escape_sequence(m_stream, converted);
+					std::copy(converted + 1, converted + cb, m_converted.begin());
+					pop_front(buffer) = converted[0];
+					copy_from_converted(buffer);
 					break;
+				}
 
 				case Q:
 					m_converted.front() = end_of_stream; // Indicate we reached the end
@@ -188,64 +294,6 @@ namespace goldfish { namespace json
 				m_converted.back() = invalid_char;
 			}
 		}
-		static uint8_t parse_hex(char c)
-		{
-			if ('0' <= c && c <= '9') return c - '0';
-			else if ('a' <= c && c <= 'f') return c - 'a' + 10;
-			else if ('A' <= c && c <= 'F') return c - 'A' + 10;
-			else throw ill_formatted_json_data{ "Invalid hexadecimal digit" };
-		}
-		uint16_t read_utf16_character()
-		{
-			uint16_t value = 0;
-			value = (value << 4) | parse_hex(stream::read<char>(m_stream));
-			value = (value << 4) | parse_hex(stream::read<char>(m_stream));
-			value = (value << 4) | parse_hex(stream::read<char>(m_stream));
-			value = (value << 4) | parse_hex(stream::read<char>(m_stream));
-			return value;
-		}
-		uint32_t read_utf32_character()
-		{
-			uint32_t a = read_utf16_character();
-			if (0xD800 <= a && a <= 0xDFFF)
-			{
-				if (a > 0xDBFF)
-					throw ill_formatted_json_data{ "Invalid UTF32 encoding" };
-
-				// We need a second character
-				if (stream::read<char>(m_stream) != '\\') throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
-				if (stream::read<char>(m_stream) != 'u') throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
-				uint32_t b = read_utf16_character();
-				if (b < 0xDC00 || b > 0xDFFF)
-					throw ill_formatted_json_data{ "Invalid serialization of surrogate pair" };
-
-				a -= 0xD800;
-				b -= 0xDC00;
-				return 0x10000 | (a << 10) | b;
-			}
-			else
-			{
-				return a;
-			}
-		}
-		std::array<byte, 4> compute_converted(uint32_t codepoint)
-		{
-			auto get_6_bits = [&](uint32_t codepoint, int offset)
-			{
-				return static_cast<byte>(0b10000000 | ((codepoint >> offset) & 0b111111));
-			};
-
-			if (codepoint <= 0x7F)
-				return { static_cast<byte>(codepoint), invalid_char, invalid_char, invalid_char };
-			else if (codepoint <= 0x7FF)
-				return{ static_cast<byte>(0b11000000 | (codepoint >> 6)), get_6_bits(codepoint, 0), invalid_char, invalid_char };
-			else if (codepoint <= 0xFFFF)
-				return{ static_cast<byte>(0b11100000 | (codepoint >> 12)), get_6_bits(codepoint, 6), get_6_bits(codepoint, 0), invalid_char };
-			else if (codepoint <= 0x10FFFF)
-				return{ static_cast<byte>(0b11110000 | (codepoint >> 18)), get_6_bits(codepoint, 12), get_6_bits(codepoint, 6), get_6_bits(codepoint, 0) };
-			else
-				throw ill_formatted_json_data{ "Invalid UTF32 encoding" };
-		}
 
 		Stream m_stream;
 
@@ -256,13 +304,14 @@ namespace goldfish { namespace json
 		std::array<byte, 3> m_converted{ invalid_char, invalid_char, invalid_char };
 	};
 
-	template <class Stream, char end_character> class comma_separated_reader
+	template <class Stream, class Policy, char end_character> class comma_separated_reader
 	{
 	public:
 		comma_separated_reader(Stream&& s)
 			: m_stream(std::move(s))
 		{}
-		std::optional<document<stream::reader_ref_type_t<Stream>>> read_comma_separated()
+		// Moves the stream to the beginning of the next element, or returns false if the end of the array or map was reached
+		bool move_to_next_element()
 		{
 			switch (m_state)
 			{
@@ -276,12 +325,12 @@ namespace goldfish { namespace json
 					{
 						stream::read<char>(m_stream);
 						m_state = state::ended;
-						return std::nullopt;
+						return false;
 					}
 					else
 					{
 						m_state = state::middle;
-						return read_no_debug_check(stream::ref(m_stream));
+						return true;
 					}
 				}
 
@@ -289,18 +338,31 @@ namespace goldfish { namespace json
 				{
 					switch (details::read_non_space(m_stream))
 					{
-					case ',': return read_no_debug_check(stream::ref(m_stream));
-					case end_character: m_state = state::ended; return std::nullopt;
+					case ',': return true;
+					case end_character: m_state = state::ended; return false;
 					default: throw ill_formatted_json_data{ "Invalid delimiter in JSON array or map" };
 					}
 				}
 
 				case state::ended:
-					return std::nullopt;
+					return false;
 
 				default: std::terminate();
 			}
 		}
+		std::optional<document<stream::reader_ref_type_t<Stream>, Policy>> read_comma_separated()
+		{
+			if (!move_to_next_element())
+				return std::nullopt;
+			return read_no_debug_check<Policy>(stream::ref(m_stream));
+		}
+
+		container_bookmark bookmark() const requires stream::has_bookmark<Stream>::value { return{ m_stream.bookmark(), static_cast<uint64_t>(m_state) }; }
+		void rewind(container_bookmark b) requires stream::has_bookmark<Stream>::value
+		{
+			m_stream.rewind(b.position);
+			m_state = static_cast<state>(b.state);
+		}
 
 		Stream m_stream;
 		enum class state : uint8_t
@@ -310,21 +372,54 @@ namespace goldfish { namespace json
 			ended,
 		} m_state = state::first;
 	};
-	template <class Stream> class array : public comma_separated_reader<Stream, ']'>
+	template <class Stream, class Policy> class array : public comma_separated_reader<Stream, Policy, ']'>
 	{
-		using comma_separated_reader<Stream, ']'>::read_comma_separated;
+		using comma_separated_reader<Stream, Policy, ']'>::read_comma_separated;
+		using comma_separated_reader<Stream, Policy, ']'>::move_to_next_element;
+		using comma_separated_reader<Stream, Policy, ']'>::m_stream;
 	public:
 		using tag = tags::array;
-		using comma_separated_reader<Stream, ']'>::comma_separated_reader;
+		using comma_separated_reader<Stream, Policy, ']'>::comma_separated_reader;
 		auto read() { return read_comma_separated(); }
+
+		// JSON arrays don't announce their length
+		std::optional<uint64_t> remaining_length() const { return std::nullopt; }
+
+		// Bulk read of an array of numbers
+		// read_into fills the span and returns the number of elements read (less than the size of the span if the end of the array was reached)
+		// read_all_into appends all the remaining elements of the array to the vector
+		// Elements that are not numbers go through the document path (so strings like "12" are still accepted)
+		template <class T> size_t read_into(std::span<T> out)
+		{
+			size_t count = 0;
+			while (count != out.size() && move_to_next_element())
+				out[count++] = read_number_element<T>();
+			return count;
+		}
+		template <class T> void read_all_into(std::vector<T>& out)
+		{
+			while (move_to_next_element())
+				out.push_back(read_number_element<T>());
+		}
+	private:
+		template <class T> T read_number_element()
+		{
+			auto c = details::peek_non_space(m_stream);
+			if (c && (*c == '-' || ('0' <= *c && *c <= '9')))
+			{
+				stream::read<char>(m_stream);
+				return std::visit([](auto x) { return goldfish::details::cast_number<T>(x); }, read_number(m_stream, *c));
+			}
+			return goldfish::details::as_number<T>(read_no_debug_check<Policy>(stream::ref(m_stream)));
+		}
 	};
-	template <class Stream> class map : public comma_separated_reader<Stream, '}'>
+	template <class Stream, class Policy> class map : public comma_separated_reader<Stream, Policy, '}'>
 	{
-		using comma_separated_reader<Stream, '}'>::read_comma_separated;
-		using comma_separated_reader<Stream, '}'>::m_stream;
+		using comma_separated_reader<Stream, Policy, '}'>::read_comma_separated;
+		using comma_separated_reader<Stream, Policy, '}'>::m_stream;
 	public:
 		using tag = tags::map;
-		using comma_separated_reader<Stream, '}'>::comma_separated_reader;
+		using comma_separated_reader<Stream, Policy, '}'>::comma_separated_reader;
 
 		auto read_key()
 		{
@@ -333,12 +428,26 @@ namespace goldfish { namespace json
 				throw ill_formatted_json_data{ "Only strings are supported for JSON keys" };
 			return key;
 		}
-		document<stream::reader_ref_type_t<Stream>> read_value()
+
+		// Reads the next key and returns the index of the matching key in the matcher (or key_matcher_base::no_match),
+		// without storing the key anywhere else than on the stack. Returns nullopt at the end of the map
+		template <class Matcher> std::optional<size_t> read_key_match(const Matcher& matcher)
+		{
+			auto key = read_key();
+			if (!key)
+				return std::nullopt;
+			return goldfish::details::read_and_match(matcher, key->as_string());
+		}
+		template <size_t N> std::optional<size_t> read_key_match(const std::string_view(&keys)[N]) { return read_key_match(key_matcher<N>(keys)); }
+		document<stream::reader_ref_type_t<Stream>, Policy> read_value()
 		{
 			if (details::read_non_space(m_stream) != ':')
 				throw ill_formatted_json_data{ "':' expected between JSON key and value" };
-			return read_no_debug_check(stream::ref(m_stream));
+			return read_no_debug_check<Policy>(stream::ref(m_stream));
 		}
+
+		// JSON maps don't announce their length
+		std::optional<uint64_t> remaining_length() const { return std::nullopt; }
 	};
 
 	template <class Stream> uint64_t read_unsigned_integer(Stream& s, char first, bool allow_leading_zeroes)
@@ -358,6 +467,32 @@ namespace goldfish { namespace json
 		}
 
 		uint64_t result = (first - '0');
+		if constexpr (stream::has_peek<Stream, uint64_t>::value)
+		{
+			// Process the digits 8 at a time (SWAR)
+			// This relies on the machine being little endian (the first character is the least significant byte)
+			static const uint64_t powers_of_10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+			while (auto chunk = s.template peek<uint64_t>())
+			{
+				// A byte is a digit if its high nibble is 3 and adding 6 to it doesn't change the high nibble
+				auto non_digits = ((*chunk & 0xF0F0F0F0F0F0F0F0ull) | (((*chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ^ 0x3333333333333333ull;
+				auto digit_count = non_digits ? std::countr_zero(non_digits) / 8 : 8;
+				if (digit_count == 0)
+					return result;
+
+				// Keep the digits in the most significant bytes, the least significant bytes become leading zeroes
+				auto value = (*chunk - 0x3030303030303030ull) << (8 * (8 - digit_count));
+				value = (value * 10 + (value >> 8)) & 0x00FF00FF00FF00FFull;
+				value = (((value & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) + (((value >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+
+				if (result > (std::numeric_limits<uint64_t>::max() - value) / powers_of_10[digit_count])
+					throw integer_overflow_in_json{ "JSON integer too large" };
+				result = result * powers_of_10[digit_count] + value;
+				stream::seek(s, digit_count);
+				if (digit_count != 8)
+					return result;
+			}
+		}
 		for (;;)
 		{
 			auto c = s.template peek<char>();
@@ -438,29 +573,29 @@ namespace goldfish { namespace json
 		return read_double(s, negative, integer);
 	}
 
-	template <class Stream> document<std::decay_t<Stream>> read_no_debug_check(Stream&& s)
+	template <class Policy, class Stream> document<std::decay_t<Stream>, Policy> read_no_debug_check(Stream&& s)
 	{
 		auto c = details::read_non_space(s);
 
 		switch (c)
 		{
-			case '[': return array<std::decay_t<Stream>>{ std::forward<Stream>(s) };
-			case '{': return map<std::decay_t<Stream>>{ std::forward<Stream>(s) };
+			case '[': return array<std::decay_t<Stream>, Policy>{ std::forward<Stream>(s) };
+			case '{': return map<std::decay_t<Stream>, Policy>{ std::forward<Stream>(s) };
 			case 't': details::throw_if_stream_isnt(s, { 'r', 'u', 'e' }); return true;
 			case 'f': details::throw_if_stream_isnt(s, { 'a', 'l', 's', 'e' }); return false;
 			case 'n': details::throw_if_stream_isnt(s, { 'u', 'l', 'l' }); return nullptr;
 			case '"': return text_string<std::decay_t<Stream>>{ std::forward<Stream>(s) };
 			case '-':
 			case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
-				return std::visit([&](auto&& x) -> document<Stream> {  return x; }, read_number(s, c));
+				return std::visit([&](auto&& x) -> document<std::decay_t<Stream>, Policy> {  return x; }, read_number(s, c));
 
 			default: throw ill_formatted_json_data{ "Invalid first character for JSON document" };
 		}
 	}
 
-	template <class Stream, class error_handler> auto read(Stream&& s, error_handler e)
+	template <class Policy = relaxed, class Stream, class error_handler> auto read(Stream&& s, error_handler e)
 	{
-		return debug_checks::add_read_checks(read_no_debug_check(std::forward<Stream>(s)), e);
+		return debug_checks::add_read_checks(read_no_debug_check<Policy>(std::forward<Stream>(s)), e);
 	}
-	template <class Stream> auto read(Stream&& s) { return read(std::forward<Stream>(s), debug_checks::default_error_handler{}); }
+	template <class Policy = relaxed, class Stream> auto read(Stream&& s) { return read<Policy>(std::forward<Stream>(s), debug_checks::default_error_handler{}); }
 }}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "json_writer.h"
+#include "sax_reader.h"
+#include "stream.h"
+#include <string_view>
+#include <vector>
+
+// Reformatting of JSON text without parsing it: only the nesting of arrays and maps and the boundaries of strings are tracked,
+// numbers, literals and strings (escape sequences included) are copied byte for byte
+//   json::minify(stream::read_string_ref(text), stream::string_writer{}) removes the whitespace between tokens
+//   json::indent(stream::read_string_ref(text), stream::string_writer{}) writes each element of arrays and maps on its own line
+// The nesting of arrays and maps and the termination of strings are checked (ill_formatted_json_data is thrown otherwise),
+// but the rest of the document isn't validated: a document that isn't valid JSON is reformatted to a document that isn't valid JSON
+namespace goldfish { namespace json
+{
+	namespace details
+	{
+		// Classes of the bytes of a JSON document outside of strings: whitespace, structural characters and the rest (numbers and literals)
+		enum class character_class : byte { other, whitespace, structural };
+		struct character_classes
+		{
+			constexpr character_classes()
+			{
+				for (char c : { ' ', '\t', '\n', '\r' })
+					classes[static_cast<byte>(c)] = character_class::whitespace;
+				for (char c : { '"', '[', ']', '{', '}', ',', ':' })
+					classes[static_cast<byte>(c)] = character_class::structural;
+			}
+			character_class classes[256] = {};
+		};
+		inline constexpr character_classes character_class_table;
+
+		inline bool is_whitespace(byte c) { return character_class_table.classes[c] == character_class::whitespace; }
+
+		// Returns a pointer to the first byte in [it, end) that isn't whitespace, or end
+		inline const byte* skip_whitespace(const byte* it, const byte* end)
+		{
+		#if defined(GOLDFISH_HAS_AVX2)
+			for (; end - it >= 32; it += 32)
+			{
+				auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+				auto whitespace = _mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+					_mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+				auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(whitespace));
+				if (mask != 0)
+					return it + std::countr_zero(mask);
+			}
+		#endif
+		#if defined(GOLDFISH_HAS_SSE2)
+			for (; end - it >= 16; it += 16)
+			{
+				auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+				auto whitespace = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+				auto mask = ~static_cast<uint32_t>(_mm_movemask_epi8(whitespace)) & 0xFFFF;
+				if (mask != 0)
+					return it + std::countr_zero(mask);
+			}
+		#endif
+			while (it != end && is_whitespace(*it))
+				++it;
+			return it;
+		}
+
+		// Reformats a document given in chunks of any size, and writes the result to output through a local buffer
+		template <class Writer, bool indented> class reformatter
+		{
+		public:
+			reformatter(Writer& output, std::string_view indentation)
+				: m_output(output)
+				, m_indentation(indentation)
+			{}
+
+			void write(std::span<const byte> input)
+			{
+				auto it = input.data();
+				auto end = it + input.size();
+				while (it != end)
+				{
+					if (m_in_string)
+					{
+						if (m_escaped)
+						{
+							append(*it++);
+							m_escaped = false;
+							continue;
+						}
+
+						// Copy up to the closing quote or the next escape sequence
+						auto special = find_escape(it, end);
+						append({ it, special });
+						it = special;
+						if (it == end)
+							break;
+
+						auto c = *it++;
+						append(c);
+						if (c == '"')
+							m_in_string = false;
+						else if (c == '\\')
+							m_escaped = true;
+						continue;
+					}
+
+					auto c = *it;
+					if (is_whitespace(c))
+					{
+						it = skip_whitespace(it, end);
+						continue;
+					}
+					++it;
+
+					if (c == ']' || c == '}')
+					{
+						if (m_closing_characters.empty() || m_closing_characters.back() != c)
+							throw ill_formatted_json_data{ "Unexpected closing character in JSON document" };
+						m_closing_characters.pop_back();
+						if (indented && !m_container_just_opened)
+							new_line();
+						m_container_just_opened = false;
+						append(c);
+						continue;
+					}
+
+					if (indented && m_container_just_opened)
+						new_line();
+					m_container_just_opened = false;
+
+					switch (c)
+					{
+					case '"':
+						append(c);
+						m_in_string = true;
+						break;
+					case '[':
+					case '{':
+						append(c);
+						m_closing_characters.push_back(c == '[' ? ']' : '}');
+						m_container_just_opened = true;
+						break;
+					case ',':
+						append(c);
+						if (indented)
+							new_line();
+						break;
+					case ':':
+						append(c);
+						if (indented)
+							append(' ');
+						break;
+					default:
+						{
+							// Number or literal: copy up to the next whitespace or structural character
+							auto token_end = it;
+							while (token_end != end && character_class_table.classes[*token_end] == character_class::other)
+								++token_end;
+							append(c);
+							append({ it, token_end });
+							it = token_end;
+						}
+						break;
+					}
+				}
+			}
+			void flush()
+			{
+				if (m_in_string || !m_closing_characters.empty())
+					throw ill_formatted_json_data{ "Unexpected end of JSON document" };
+				m_output.write_buffer({ m_buffer, m_cb_buffer });
+				m_cb_buffer = 0;
+			}
+
+		private:
+			void new_line()
+			{
+				append('\n');
+				for (size_t i = 0; i < m_closing_characters.size(); ++i)
+					append({ reinterpret_cast<const byte*>(m_indentation.data()), m_indentation.size() });
+			}
+			void append(byte c)
+			{
+				if (m_cb_buffer == sizeof(m_buffer))
+				{
+					m_output.write_buffer(m_buffer);
+					m_cb_buffer = 0;
+				}
+				m_buffer[m_cb_buffer++] = c;
+			}
+			void append(std::span<const byte> data)
+			{
+				if (data.size() > sizeof(m_buffer) - m_cb_buffer)
+				{
+					m_output.write_buffer({ m_buffer, m_cb_buffer });
+					m_cb_buffer = 0;
+					if (data.size() >= sizeof(m_buffer))
+					{
+						// Long strings go straight to the output
+						m_output.write_buffer(data);
+						return;
+					}
+				}
+				std::copy(data.begin(), data.end(), m_buffer + m_cb_buffer);
+				m_cb_buffer += data.size();
+			}
+
+			Writer& m_output;
+			std::string_view m_indentation;
+			std::vector<byte> m_closing_characters;
+			bool m_in_string = false;
+			bool m_escaped = false;
+			bool m_container_just_opened = false;
+			byte m_buffer[typical_buffer_length];
+			size_t m_cb_buffer = 0;
+		};
+
+		template <bool indented, class Reader, class Writer> auto reformat(Reader& input, Writer& output, std::string_view indentation)
+		{
+			reformatter<Writer, indented> r(output, indentation);
+			byte buffer[typical_buffer_length];
+			while (auto cb = input.read_partial_buffer(buffer))
+				r.write({ buffer, cb });
+			r.flush();
+			return output.flush();
+		}
+	}
+
+	// Remove the whitespace between the tokens of the JSON document read from input, and return output.flush()
+	template <class Reader, class Writer> auto minify(Reader&& input, Writer&& output)
+	{
+		return details::reformat<false /*indented*/>(input, output, {});
+	}
+
+	// Write each element of the arrays and each key of the maps of the JSON document read from input on its own line,
+	// indented by the nesting level, and return output.flush()
+	// Empty arrays and maps are written [] and {}
+	template <class Reader, class Writer> auto indent(Reader&& input, Writer&& output, std::string_view indentation = "  ")
+	{
+		return details::reformat<true /*indented*/>(input, output, indentation);
+	}
+}}
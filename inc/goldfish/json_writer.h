@@ -1,20 +1,157 @@
 #pragma once
 
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <string>
 
-#include <milo/dtoa_milo.h>
-
 #include "array_ref.h"
 #include "base64_stream.h"
 #include "debug_checks_writer.h"
+#include "encoded_key.h"
 #include "sax_writer.h"
 #include "stream.h"
 
+#if defined(GOLDFISH_HAS_AVX2)
+#include <immintrin.h>
+#elif defined(GOLDFISH_HAS_SSE2)
+#include <emmintrin.h>
+#endif
+
 namespace goldfish { namespace json
 {
 	struct invalid_key_type : exception { using exception::exception; };
-	template <class Stream> class document_writer;
-	template <class Stream> class key_writer;
+
+	// Formats of the doubles written by the JSON writer
+	// format(first, x) writes x in [first, first + max_length) and returns the end of the text
+
+	// Shortest text that reads back as the same double
+	struct shortest_doubles
+	{
+		static constexpr size_t max_length = 24; // -2.2250738585072014e-308
+		static char* format(char* first, double x) { return std::to_chars(first, first + max_length, x).ptr; }
+	};
+
+	// At most significant_digits significant digits (like printf's %g), for values that don't need to round trip, such as metrics
+	template <int significant_digits> struct fixed_precision_doubles
+	{
+		static_assert(significant_digits > 0 && significant_digits <= 17, "A double has at most 17 significant digits");
+		static constexpr size_t max_length = significant_digits + 7; // sign, decimal point and exponent
+		static char* format(char* first, double x) { return std::to_chars(first, first + max_length, x, std::chars_format::general, significant_digits).ptr; }
+	};
+
+	// Shortest text that reads back as the same float, for doubles that hold float values (0.1f is written 0.1 instead of 0.10000000149011612)
+	// Doubles that are not representable as floats lose precision, doubles outside of the range of floats are written as doubles
+	struct shortest_float_doubles
+	{
+		static constexpr size_t max_length = shortest_doubles::max_length;
+		static char* format(char* first, double x)
+		{
+			if (std::abs(x) <= std::numeric_limits<float>::max())
+				return std::to_chars(first, first + max_length, static_cast<float>(x)).ptr;
+			else
+				return shortest_doubles::format(first, x);
+		}
+	};
+
+	// Controls how numbers are written by the JSON writer
+	struct write_options
+	{
+		using double_format = shortest_doubles;
+	};
+
+	template <class Stream, class Options = write_options> class document_writer;
+	template <class Stream, class Options> class key_writer;
+
+	// Mark on a JSON array or map (see stream::write_mark): it also saves whether the next element needs a separator
+	struct write_mark
+	{
+		stream::write_mark position;
+		bool first;
+	};
+
+	namespace details
+	{
+		// Control characters, quotes and backslashes need to be escaped in JSON strings
+		inline bool needs_escape(byte c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+		// Returns a pointer to the first byte in [it, end) that needs to be escaped, or end
+		// With check_utf8, also stops on the bytes that never appear in UTF-8 (0xF8 to 0xFF), which the readers reject in strings
+		template <bool check_utf8 = false> const byte* find_escape(const byte* it, const byte* end)
+		{
+		#if defined(GOLDFISH_HAS_AVX2)
+			{
+				const auto quote = _mm256_set1_epi8('"');
+				const auto backslash = _mm256_set1_epi8('\\');
+				const auto max_control = _mm256_set1_epi8(0x1F);
+				const auto min_invalid = _mm256_set1_epi8(static_cast<char>(0xF8));
+				for (; end - it >= 32; it += 32)
+				{
+					auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+					auto control = _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, max_control), max_control); // chunk <= 0x1F
+					if constexpr (check_utf8)
+						control = _mm256_or_si256(control, _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, min_invalid), chunk)); // chunk >= 0xF8
+					auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(control,
+						_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)))));
+					if (mask != 0)
+						return it + std::countr_zero(mask);
+				}
+			}
+		#endif
+		#if defined(GOLDFISH_HAS_SSE2)
+			{
+				const auto quote = _mm_set1_epi8('"');
+				const auto backslash = _mm_set1_epi8('\\');
+				const auto max_control = _mm_set1_epi8(0x1F);
+				const auto min_invalid = _mm_set1_epi8(static_cast<char>(0xF8));
+				for (; end - it >= 16; it += 16)
+				{
+					auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+					auto control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, max_control), max_control); // chunk <= 0x1F
+					if constexpr (check_utf8)
+						control = _mm_or_si128(control, _mm_cmpeq_epi8(_mm_max_epu8(chunk, min_invalid), chunk)); // chunk >= 0xF8
+					auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(control,
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)))));
+					if (mask != 0)
+						return it + std::countr_zero(mask);
+				}
+			}
+		#else
+			if constexpr (std::endian::native == std::endian::little)
+			{
+				// 8 bytes at a time: the lowest flagged byte is always exact (false positives can only appear above a true positive)
+				const uint64_t ones = 0x0101010101010101ull;
+				const uint64_t high_bits = 0x8080808080808080ull;
+				for (; end - it >= 8; it += 8)
+				{
+					uint64_t x;
+					memcpy(&x, it, sizeof(x));
+					auto quote = x ^ (ones * '"');
+					auto backslash = x ^ (ones * '\\');
+					auto found = (((x - ones * 0x20) & ~x) | ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash)) & high_bits;
+					if constexpr (check_utf8)
+					{
+						auto invalid = ~x & (ones * 0xF8); // 0 for the bytes >= 0xF8
+						found |= (invalid - ones) & ~invalid & high_bits;
+					}
+					if (found != 0)
+						return it + std::countr_zero(found) / 8;
+				}
+			}
+		#endif
+			while (it != end && !needs_escape(*it) && !(check_utf8 && *it >= 0xF8))
+				++it;
+			return it;
+		}
+
+		// Returns the escape sequence of a byte for which needs_escape is true
+		inline std::span<const byte> escape_sequence(byte c)
+		{
+			return{ escape_table.sequences[c], escape_table.sizes[c] };
+		}
+	}
 
 	template <class Stream> class text_writer
 	{
@@ -26,64 +163,17 @@ namespace goldfish { namespace json
 		}
 		void write_buffer(std::span<const byte> buffer)
 		{
-			enum category : uint8_t
-			{
-				F, /* forward to inner stream */
-				B, /* \b */
-				N, /* \n */
-				R, /* \r */
-				T, /* \t */
-				Q, /* \" */
-				S, /* \\ */
-				U, /* \u00?? */
-			};
-			static const category lookup[] = {
-				/*       0 1 2 3 4 5 6 7 8 9 A B C D E F */
-				/*0x00*/ U,U,U,U,U,U,U,U,B,T,N,U,U,R,U,U,
-				/*0x10*/ U,U,U,U,U,U,U,U,U,U,U,U,U,U,U,U,
-				/*0x20*/ F,F,Q,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x30*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x40*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x50*/ F,F,F,F,F,F,F,F,F,F,F,F,S,F,F,F,
-				/*0x60*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x70*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x80*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0x90*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xA0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xB0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xC0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xD0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xE0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-				/*0xF0*/ F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,F,
-			};
-			static_assert(sizeof(lookup) / sizeof(lookup[0]) == 256, "The lookup table should have 256 entries");
-
-			auto it = buffer.begin();
+			auto it = buffer.data();
+			auto end = it + buffer.size();
 			for (;;)
 			{
-				auto prev = it;
-				while (it != buffer.end() && lookup[*it] == F)
-					++it;
-				m_stream.write_buffer(buffer.subspan(prev - buffer.begin(), it - prev));
-				if (it == buffer.end())
+				auto next = details::find_escape(it, end);
+				m_stream.write_buffer({ it, next });
+				if (next == end)
 					break;
 
-				switch (lookup[*it])
-				{
-					case B: stream::write(m_stream, '\\'); stream::write(m_stream, 'b'); break;
-					case N: stream::write(m_stream, '\\'); stream::write(m_stream, 'n'); break;
-					case R: stream::write(m_stream, '\\'); stream::write(m_stream, 'r'); break;
-					case T: stream::write(m_stream, '\\'); stream::write(m_stream, 't'); break;
-					case Q: stream::write(m_stream, '\\'); stream::write(m_stream, '"'); break;
-					case S: stream::write(m_stream, '\\'); stream::write(m_stream, '\\'); break;
-					case U:
-					{
-						char data[6] = { '\\', 'u', '0', '0', "0123456789ABCDEF"[*it / 16], "0123456789ABCDEF"[*it % 16] };
-						m_stream.write_buffer({ reinterpret_cast<const byte*>(data), 6 });
-					}
-					break;
-				}
-				++it;
+				m_stream.write_buffer(details::escape_sequence(*next));
+				it = next + 1;
 			}
 		}
 		auto flush()
@@ -117,7 +207,7 @@ namespace goldfish { namespace json
 		stream::base64_writer<Stream> m_stream;
 	};
 
-	template <class Stream> class array_writer
+	template <class Stream, class Options> class array_writer
 	{
 	public:
 		array_writer(Stream&& s)
@@ -126,12 +216,20 @@ namespace goldfish { namespace json
 			stream::write(m_stream, '[');
 		}
 
-		document_writer<stream::writer_ref_type_t<Stream>> append();
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append();
 		auto flush()
 		{
 			stream::write(m_stream, ']');
 			return m_stream.flush();
 		}
+
+		template <class T = Stream> auto mark() -> decltype(std::declval<T&>().mark(), write_mark{}) { return{ m_stream.mark(), m_first }; }
+		void rollback(const write_mark& m)
+		{
+			m_stream.rollback(m.position);
+			m_first = m.first;
+		}
+		void commit(const write_mark& m) { m_stream.commit(m.position); }
 	private:
 		Stream m_stream;
 		bool m_first = true;
@@ -151,16 +249,20 @@ namespace goldfish { namespace json
 			std::to_chars_result result = std::to_chars(buffer, buffer + sizeof buffer, x);
 			s.write_buffer(std::span<const byte>(reinterpret_cast<const byte*>(buffer), result.ptr - buffer));
 		}
-		template <class Stream> void serialize_number(Stream& s, double x)
+		template <class Format, class Stream> void serialize_number(Stream& s, double x)
 		{
-
-			char buffer[dtoa_milo::MinBufferSize];
-			std::to_chars_result result = dtoa_milo::to_chars(buffer, buffer + sizeof buffer, x);
-			s.write_buffer(std::span<const byte>(reinterpret_cast<const byte*>(buffer), result.ptr - buffer));
+			char buffer[Format::max_length];
+			auto end = Format::format(buffer, x);
+			s.write_buffer(std::span<const byte>(reinterpret_cast<const byte*>(buffer), end - buffer));
 		}
+
+		// Same as serialize_number, without the stream: format x at first and return the end of the text
+		template <class Format> char* format_number(char* first, uint64_t x) { return std::to_chars(first, first + "18446744073709551615"sv.size(), x).ptr; }
+		template <class Format> char* format_number(char* first, int64_t x) { return std::to_chars(first, first + "-9223372036854775808"sv.size(), x).ptr; }
+		template <class Format> char* format_number(char* first, double x) { return Format::format(first, x); }
 	}
 
-	template <class Stream> class map_writer
+	template <class Stream, class Options> class map_writer
 	{
 	public:
 		map_writer(Stream&& s)
@@ -169,19 +271,27 @@ namespace goldfish { namespace json
 			stream::write(m_stream, '{');
 		}
 
-		key_writer<stream::writer_ref_type_t<Stream>> append_key();
-		document_writer<stream::writer_ref_type_t<Stream>> append_value();
+		key_writer<stream::writer_ref_type_t<Stream>, Options> append_key();
+		document_writer<stream::writer_ref_type_t<Stream>, Options> append_value();
 		auto flush()
 		{
 			stream::write(m_stream, '}');
 			return m_stream.flush();
 		}
+
+		template <class T = Stream> auto mark() -> decltype(std::declval<T&>().mark(), write_mark{}) { return{ m_stream.mark(), m_first }; }
+		void rollback(const write_mark& m)
+		{
+			m_stream.rollback(m.position);
+			m_first = m.first;
+		}
+		void commit(const write_mark& m) { m_stream.commit(m.position); }
 	private:
 		Stream m_stream;
 		bool m_first = true;
 	};
 
-	template <class Stream> class key_writer
+	template <class Stream, class Options> class key_writer
 	{
 	public:
 		key_writer(Stream&& s)
@@ -219,26 +329,31 @@ namespace goldfish { namespace json
 		auto write(double x)
 		{
 			stream::write(m_stream, '"');
-			details::serialize_number(m_stream, x);
+			details::serialize_number<typename Options::double_format>(m_stream, x);
 			stream::write(m_stream, '"');
 			return m_stream.flush();
 		}
+		template <size_t N> auto write(const encoded_key<N>& x)
+		{
+			m_stream.write_buffer(x.json());
+			return m_stream.flush();
+		}
 
 		auto start_binary(uint64_t cb) { return start_binary(); }
 		auto start_string(uint64_t cb) { return start_string(); }
 		binary_writer<Stream> start_binary() { return{ std::move(m_stream) }; }
 		text_writer<Stream> start_string() { return{ std::move(m_stream) }; }
 
-		array_writer<Stream> start_array(uint64_t size) { throw invalid_key_type{ "An array cannot be a JSON key" }; }
-		array_writer<Stream> start_array() { throw invalid_key_type{ "An array cannot be a JSON key" }; }
-		map_writer<Stream> start_map(uint64_t size) { throw invalid_key_type{ "A map cannot be a JSON key" }; }
-		map_writer<Stream> start_map() { throw invalid_key_type{ "A map cannot be a JSON key" }; }
+		array_writer<Stream, Options> start_array(uint64_t size) { throw invalid_key_type{ "An array cannot be a JSON key" }; }
+		array_writer<Stream, Options> start_array() { throw invalid_key_type{ "An array cannot be a JSON key" }; }
+		map_writer<Stream, Options> start_map(uint64_t size) { throw invalid_key_type{ "A map cannot be a JSON key" }; }
+		map_writer<Stream, Options> start_map() { throw invalid_key_type{ "A map cannot be a JSON key" }; }
 
 	private:
 		Stream m_stream;
 	};
 
-	template <class Stream> class document_writer
+	template <class Stream, class Options> class document_writer
 	{
 	public:
 		document_writer(Stream&& s)
@@ -271,7 +386,38 @@ namespace goldfish { namespace json
 		}
 		auto write(double x)
 		{
-			details::serialize_number(m_stream, x);
+			details::serialize_number<typename Options::double_format>(m_stream, x);
+			return m_stream.flush();
+		}
+		template <size_t N> auto write(const encoded_key<N>& x)
+		{
+			m_stream.write_buffer(x.json());
+			return m_stream.flush();
+		}
+
+		// The elements are formatted in a local buffer, which is written to the stream each time it's full
+		template <class T> auto write_array(std::span<const T> x)
+		{
+			using double_format = typename Options::double_format;
+			constexpr ptrdiff_t max_element_length = largest<"-9223372036854775808"sv.size(), double_format::max_length>::value + 1 /*separator*/;
+
+			char buffer[typical_buffer_length];
+			auto it = buffer;
+			*it++ = '[';
+			for (size_t i = 0; i < x.size(); ++i)
+			{
+				// Keep room for the element, its separator and the closing bracket
+				if (buffer + sizeof(buffer) - it <= max_element_length)
+				{
+					m_stream.write_buffer({ reinterpret_cast<const byte*>(buffer), static_cast<size_t>(it - buffer) });
+					it = buffer;
+				}
+				if (i != 0)
+					*it++ = ',';
+				it = details::format_number<double_format>(it, static_cast<sax::widened_number_t<T>>(x[i]));
+			}
+			*it++ = ']';
+			m_stream.write_buffer({ reinterpret_cast<const byte*>(buffer), static_cast<size_t>(it - buffer) });
 			return m_stream.flush();
 		}
 
@@ -281,25 +427,25 @@ namespace goldfish { namespace json
 		text_writer<Stream> start_string() { return{ std::move(m_stream) }; }
 
 		auto start_array(uint64_t size) { return start_array(); }
-		array_writer<Stream> start_array() { return{ std::move(m_stream) }; }
+		array_writer<Stream, Options> start_array() { return{ std::move(m_stream) }; }
 
 		auto start_map(uint64_t size) { return start_map(); }
-		map_writer<Stream> start_map() { return{ std::move(m_stream) }; }
+		map_writer<Stream, Options> start_map() { return{ std::move(m_stream) }; }
 
 	private:
 		Stream m_stream;
 	};
-	template <class Stream> document_writer<std::decay_t<Stream>> create_writer_no_debug_check(Stream&& s) { return{ std::forward<Stream>(s) }; }
-	template <class Stream, class error_handler> auto create_writer(Stream&& s, error_handler e)
+	template <class Options = write_options, class Stream> document_writer<std::decay_t<Stream>, Options> create_writer_no_debug_check(Stream&& s) { return{ std::forward<Stream>(s) }; }
+	template <class Options = write_options, class Stream, class error_handler> auto create_writer(Stream&& s, error_handler e)
 	{
-		return sax::make_writer(debug_checks::add_write_checks(create_writer_no_debug_check(std::forward<Stream>(s)), e));
+		return sax::make_writer(debug_checks::add_write_checks(create_writer_no_debug_check<Options>(std::forward<Stream>(s)), e));
 	}
-	template <class Stream> auto create_writer(Stream&& s)
+	template <class Options = write_options, class Stream> auto create_writer(Stream&& s)
 	{
-		return create_writer(std::forward<Stream>(s), debug_checks::default_error_handler{});
+		return create_writer<Options>(std::forward<Stream>(s), debug_checks::default_error_handler{});
 	}
 
-	template <class Stream> document_writer<stream::writer_ref_type_t<Stream>> array_writer<Stream>::append()
+	template <class Stream, class Options> document_writer<stream::writer_ref_type_t<Stream>, Options> array_writer<Stream, Options>::append()
 	{
 		if (m_first)
 			m_first = false;
@@ -309,7 +455,7 @@ namespace goldfish { namespace json
 		return{ stream::ref(m_stream) };
 	}
 
-	template <class Stream> key_writer<stream::writer_ref_type_t<Stream>> map_writer<Stream>::append_key()
+	template <class Stream, class Options> key_writer<stream::writer_ref_type_t<Stream>, Options> map_writer<Stream, Options>::append_key()
 	{
 		if (m_first)
 			m_first = false;
@@ -317,7 +463,7 @@ namespace goldfish { namespace json
 			stream::write(m_stream, ',');
 		return{ stream::ref(m_stream) };
 	}
-	template <class Stream> document_writer<stream::writer_ref_type_t<Stream>> map_writer<Stream>::append_value()
+	template <class Stream, class Options> document_writer<stream::writer_ref_type_t<Stream>, Options> map_writer<Stream, Options>::append_value()
 	{
 		stream::write(m_stream, ':');
 		return{ stream::ref(m_stream) };
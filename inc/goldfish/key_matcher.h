@@ -0,0 +1,284 @@
+#pragma once
+
+#include "common.h"
+#include "sax_reader.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <string_view>
+
+// Matching of map keys against a fixed set of strings, without materializing the key in a std::string
+// The maps of the JSON and CBOR readers have a read_key_match function that reads the next key and returns the index
+// of the matching string (or key_matcher_base::no_match), or nullopt at the end of the map:
+//   static constexpr key_matcher keys{ "id", "ts", "payload" };
+//   while (auto k = map.read_key_match(keys))
+//   {
+//       switch (*k)
+//       {
+//       case 0: id = map.read_value().as_uint64(); break;
+//       ...
+//       default: seek_to_end(map.read_value()); break;
+//       }
+//   }
+// For a few keys, the keys can also be given inline: map.read_key_match({ "id", "ts", "payload" })
+// For many keys, perfect_hash_key_matcher finds the candidate key with a hash instead of comparing the key with all the keys of the same length
+namespace goldfish
+{
+	// Thrown when a key_matcher is created with a key longer than key_matcher_base::max_key_length
+	struct key_matcher_key_too_long : exception { key_matcher_key_too_long() : exception("Key too long for key_matcher") {} };
+
+	// Thrown when a key_matcher or a perfect_hash_key_matcher is created with the same key twice
+	struct key_matcher_duplicate_key : exception { key_matcher_duplicate_key() : exception("Duplicate key in key_matcher") {} };
+
+	// Thrown when no perfect hash is found for the keys of a perfect_hash_key_matcher (distinct keys with the same 64 bit hash)
+	struct key_matcher_construction_failed : exception { key_matcher_construction_failed() : exception("No perfect hash found for the keys of perfect_hash_key_matcher") {} };
+
+	struct key_matcher_base
+	{
+		static constexpr size_t no_match = std::numeric_limits<size_t>::max();
+
+		// Keys are read in a buffer on the stack before being compared, which limits their size
+		static constexpr size_t max_key_length = 64;
+	};
+
+	// The keys are sorted by length, and compared with their length and their first 8 bytes before comparing the rest
+	// The strings are not copied: they need to outlive the key_matcher (which is the case for literals)
+	template <size_t N> class key_matcher : public key_matcher_base
+	{
+	public:
+		template <class... T> constexpr key_matcher(const T&... keys)
+			: key_matcher(std::array<std::string_view, N>{ std::string_view{ keys }... })
+		{}
+		constexpr key_matcher(const std::string_view(&keys)[N])
+			: key_matcher(std::to_array(keys))
+		{}
+		constexpr key_matcher(const std::array<std::string_view, N>& keys)
+		{
+			for (size_t i = 0; i < N; ++i)
+			{
+				if (keys[i].size() > max_key_length)
+					throw key_matcher_key_too_long{};
+				for (size_t j = 0; j < i; ++j)
+				{
+					if (keys[i] == keys[j])
+						throw key_matcher_duplicate_key{};
+				}
+				m_entries[i] = { keys[i], prefix(keys[i]), i };
+				m_max_length = std::max(m_max_length, keys[i].size());
+			}
+			std::sort(m_entries.begin(), m_entries.end(), [](const entry& a, const entry& b) { return a.key.size() < b.key.size(); });
+		}
+
+		// Index of the key equal to text, or no_match
+		constexpr size_t match(std::string_view text) const
+		{
+			if (text.size() > m_max_length)
+				return no_match;
+
+			auto text_prefix = prefix(text);
+			for (auto& e : m_entries)
+			{
+				if (e.key.size() < text.size())
+					continue;
+				if (e.key.size() > text.size())
+					break;
+				if (e.prefix == text_prefix && (text.size() <= 8 || e.key.substr(8) == text.substr(8)))
+					return e.index;
+			}
+			return no_match;
+		}
+
+		// Whether one of the keys has a length of cb bytes (used to skip keys without reading them when the length is known upfront)
+		constexpr bool has_length(uint64_t cb) const
+		{
+			return std::any_of(m_entries.begin(), m_entries.end(), [&](const entry& e) { return e.key.size() == cb; });
+		}
+		constexpr size_t max_length() const { return m_max_length; }
+
+	private:
+		// First 8 bytes of the string, little endian
+		static constexpr uint64_t prefix(std::string_view text)
+		{
+			uint64_t result = 0;
+			for (size_t i = 0; i < std::min<size_t>(text.size(), 8); ++i)
+				result |= static_cast<uint64_t>(static_cast<byte>(text[i])) << (8 * i);
+			return result;
+		}
+
+		struct entry
+		{
+			std::string_view key;
+			uint64_t prefix = 0;
+			size_t index = 0;
+		};
+		std::array<entry, N> m_entries{};
+		size_t m_max_length = 0;
+	};
+	template <class... T> key_matcher(const T&...) -> key_matcher<sizeof...(T)>;
+
+	// Hash and displace: the keys are split in buckets by their hash, and each bucket gets a displacement that sends
+	// its keys to free slots of the table. A lookup hashes the key once, reads the displacement of its bucket, and compares
+	// the key with the only candidate of its slot
+	// The table is built when the matcher is created (at compile time for a constexpr matcher)
+	template <size_t N> class perfect_hash_key_matcher : public key_matcher_base
+	{
+		static constexpr size_t table_size = std::bit_ceil(2 * N + 1);
+		static constexpr size_t bucket_count = std::bit_ceil(N / 2 + 1);
+		static_assert(N < std::numeric_limits<uint16_t>::max(), "Too many keys for perfect_hash_key_matcher");
+
+	public:
+		template <class... T> constexpr perfect_hash_key_matcher(const T&... keys)
+			: perfect_hash_key_matcher(std::array<std::string_view, N>{ std::string_view{ keys }... })
+		{}
+		constexpr perfect_hash_key_matcher(const std::array<std::string_view, N>& keys)
+			: m_keys(keys)
+		{
+			std::array<uint64_t, N> hashes{};
+			std::array<size_t, bucket_count> bucket_sizes{};
+			for (size_t i = 0; i < N; ++i)
+			{
+				if (keys[i].size() > max_key_length)
+					throw key_matcher_key_too_long{};
+				for (size_t j = 0; j < i; ++j)
+				{
+					if (keys[i] == keys[j])
+						throw key_matcher_duplicate_key{};
+				}
+				m_lengths[keys[i].size()] = true;
+				m_max_length = std::max(m_max_length, keys[i].size());
+				hashes[i] = hash(keys[i]);
+				++bucket_sizes[bucket(hashes[i])];
+			}
+
+			// The largest buckets are placed first, while the table is mostly empty
+			std::array<size_t, bucket_count> buckets{};
+			std::iota(buckets.begin(), buckets.end(), size_t{ 0 });
+			std::sort(buckets.begin(), buckets.end(), [&](size_t a, size_t b) { return bucket_sizes[a] > bucket_sizes[b]; });
+			for (auto b : buckets)
+			{
+				if (bucket_sizes[b] == 0)
+					break;
+
+				// Distinct keys with the same 64 bit hash can't be separated (duplicate keys were rejected above)
+				for (uint32_t displacement = 1;; ++displacement)
+				{
+					if (displacement == 0x10000)
+						throw key_matcher_construction_failed{};
+
+					std::array<size_t, N> slots{};
+					size_t count = 0;
+					bool fits = true;
+					for (size_t i = 0; i < N && fits; ++i)
+					{
+						if (bucket(hashes[i]) != b)
+							continue;
+						auto slot = position(hashes[i], displacement);
+						fits = m_table[slot] == 0 && std::find(slots.begin(), slots.begin() + count, slot) == slots.begin() + count;
+						slots[count++] = slot;
+					}
+					if (!fits)
+						continue;
+
+					for (size_t i = 0; i < N; ++i)
+					{
+						if (bucket(hashes[i]) == b)
+							m_table[position(hashes[i], displacement)] = static_cast<uint16_t>(i + 1);
+					}
+					m_displacements[b] = displacement;
+					break;
+				}
+			}
+		}
+
+		// Index of the key equal to text, or no_match
+		constexpr size_t match(std::string_view text) const
+		{
+			if (text.size() > m_max_length)
+				return no_match;
+
+			auto h = hash(text);
+			auto candidate = m_table[position(h, m_displacements[bucket(h)])];
+			if (candidate == 0 || m_keys[candidate - 1] != text)
+				return no_match;
+			return candidate - 1;
+		}
+
+		constexpr bool has_length(uint64_t cb) const { return cb <= max_key_length && m_lengths[cb]; }
+		constexpr size_t max_length() const { return m_max_length; }
+
+	private:
+		// Little endian load of up to 8 bytes
+		static constexpr uint64_t load(const char* data, size_t cb)
+		{
+			if (!std::is_constant_evaluated() && cb == 8)
+			{
+				uint64_t result;
+				std::memcpy(&result, data, 8);
+				return result;
+			}
+			uint64_t result = 0;
+			for (size_t i = 0; i < cb; ++i)
+				result |= static_cast<uint64_t>(static_cast<byte>(data[i])) << (8 * i);
+			return result;
+		}
+
+		// Keys are short, so they are hashed 8 bytes at a time (the last word overlaps the previous one when the size isn't a multiple of 8)
+		// The low bits of a product are weak, so the bucket and the slot are taken from the high bits
+		static constexpr uint64_t hash(std::string_view text)
+		{
+			uint64_t h = text.size() * 0x9e3779b97f4a7c15ull;
+			if (text.size() < 8)
+				return mix(h, load(text.data(), text.size()));
+
+			for (size_t i = 0; i + 8 < text.size(); i += 8)
+				h = mix(h, load(text.data() + i, 8));
+			return mix(h, load(text.data() + text.size() - 8, 8));
+		}
+		static constexpr uint64_t mix(uint64_t h, uint64_t word)
+		{
+			h = (h ^ word) * 0xff51afd7ed558ccdull;
+			return h ^ (h >> 32);
+		}
+		static constexpr size_t bucket(uint64_t h) { return static_cast<size_t>(h >> 40) & (bucket_count - 1); }
+		static constexpr size_t position(uint64_t h, uint32_t displacement)
+		{
+			return static_cast<size_t>(((h ^ displacement) * 0x9e3779b97f4a7c15ull) >> 40) & (table_size - 1);
+		}
+
+		std::array<std::string_view, N> m_keys;
+		std::array<uint16_t, table_size> m_table{};
+		std::array<uint32_t, bucket_count> m_displacements{};
+		std::array<bool, max_key_length + 1> m_lengths{};
+		size_t m_max_length = 0;
+	};
+	template <class... T> perfect_hash_key_matcher(const T&...) -> perfect_hash_key_matcher<sizeof...(T)>;
+
+	namespace details
+	{
+		// Reads the key from the string stream s (until its end) and matches it
+		template <class Matcher, class Stream> size_t read_and_match(const Matcher& matcher, Stream&& s)
+		{
+			char buffer[key_matcher_base::max_key_length + 1];
+			auto cb = stream::read_full_buffer(s, { reinterpret_cast<byte*>(buffer), matcher.max_length() + 1 });
+			if (cb > matcher.max_length())
+			{
+				stream::seek(s, std::numeric_limits<uint64_t>::max());
+				return key_matcher_base::no_match;
+			}
+			return matcher.match({ buffer, cb });
+		}
+
+		// Reads the next key of a map out of its document and matches it (keys that are not strings never match)
+		template <class Document, class Matcher> size_t match_key_document(Document&& key, const Matcher& matcher)
+		{
+			if (key.template is_exactly<tags::string>())
+				return read_and_match(matcher, key.as_string());
+
+			seek_to_end(std::forward<Document>(key));
+			return key_matcher_base::no_match;
+		}
+	}
+}
@@ -5,7 +5,12 @@
 #include <optional>
 #include "base64_stream.h"
 #include "buffered_stream.h"
+#include "container_stack.h"
+#include "tagged_union.h"
+#include <cassert>
+#include <charconv>
 #include <limits>
+#include <string_view>
 #include <type_traits>
 #include <variant>
 
@@ -18,6 +23,256 @@ namespace goldfish
 	}
 	struct integer_overflow_while_casting : exception { integer_overflow_while_casting() : exception("Integer too large") {} };
 
+	// Reasons why a try_as_* accessor couldn't convert a document
+	enum class conversion_error : uint8_t
+	{
+		none,
+		type_mismatch,      // the document has a type that can't be converted (as_* throw std::bad_variant_access)
+		invalid_string,     // the document is a string that doesn't contain a valid number or boolean (as_* throw std::bad_variant_access)
+		integer_overflow,   // the number doesn't fit in the requested type (as_* throw integer_overflow_while_casting)
+	};
+
+	// Position of an array or map reader, returned by bookmark() and passed to rewind()
+	// Arrays and maps can be bookmarked when they read from a stream that can be bookmarked (see stream::read_bookmark)
+	// The bookmark holds the position in the stream and the state of the parser (like the number of elements left in a CBOR array)
+	// Documents read after the bookmark become invalid when the container is rewound
+	struct container_bookmark
+	{
+		stream::read_bookmark position;
+		uint64_t state;
+	};
+
+	namespace details
+	{
+		[[noreturn]] inline void throw_conversion_error(conversion_error error)
+		{
+			if (error == conversion_error::integer_overflow)
+				throw integer_overflow_while_casting{};
+			throw std::bad_variant_access{};
+		}
+	}
+
+	// Value returned by the try_as_* accessors of documents: either the converted value, or the reason of the failure
+	// For invalid_string, error_offset() is the offset of the first invalid byte in the string
+	template <class T> class conversion_result
+	{
+	public:
+		conversion_result(T value) noexcept
+			: m_value(value)
+		{}
+		conversion_result(conversion_error error, uint64_t offset = 0) noexcept
+			: m_error(error)
+			, m_offset(offset)
+		{
+			assert(error != conversion_error::none);
+		}
+
+		bool has_value() const noexcept { return m_error == conversion_error::none; }
+		explicit operator bool() const noexcept { return has_value(); }
+		const T& operator*() const noexcept { assert(has_value()); return m_value; }
+
+		// Throws the same exceptions as the as_* accessors if the conversion failed
+		T value() const
+		{
+			if (!has_value())
+				details::throw_conversion_error(m_error);
+			return m_value;
+		}
+		T value_or(T default_value) const noexcept { return has_value() ? m_value : default_value; }
+
+		conversion_error error() const noexcept { return m_error; }
+		uint64_t error_offset() const noexcept { return m_offset; }
+
+	private:
+		T m_value{};
+		conversion_error m_error = conversion_error::none;
+		uint64_t m_offset = 0;
+	};
+
+	namespace details
+	{
+		inline uint64_t cast_signed_to_unsigned(int64_t x)
+		{
+			if (x < 0)
+				throw integer_overflow_while_casting{};
+			return static_cast<uint64_t>(x);
+		}
+		inline int64_t cast_unsigned_to_signed(uint64_t x)
+		{
+			if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+				throw integer_overflow_while_casting{};
+			return static_cast<int64_t>(x);
+		}
+		inline uint64_t cast_double_to_unsigned(double x)
+		{
+			if (x == static_cast<uint64_t>(x))
+				return static_cast<uint64_t>(x);
+			else
+				throw integer_overflow_while_casting{};
+		}
+		inline int64_t cast_double_to_signed(double x)
+		{
+			if (x == static_cast<int64_t>(x))
+				return static_cast<int64_t>(x);
+			else
+				throw integer_overflow_while_casting{};
+		}
+
+		// Converts a decoded number (uint64_t, int64_t or double) to T, with the same rules as the document::as_* accessors
+		template <class T, class U> conversion_result<T> try_cast_number(U x) noexcept
+		{
+			static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "cast_number only supports numeric types");
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				return static_cast<T>(x);
+			}
+			else if constexpr (std::is_unsigned_v<T>)
+			{
+				uint64_t result;
+				if constexpr (std::is_same_v<U, uint64_t>)
+				{
+					result = x;
+				}
+				else if constexpr (std::is_same_v<U, int64_t>)
+				{
+					if (x < 0)
+						return conversion_error::integer_overflow;
+					result = static_cast<uint64_t>(x);
+				}
+				else
+				{
+					// The range check comes first, casting a double that doesn't fit is undefined behavior
+					if (!(x >= 0 && x < 18446744073709551616.0) || x != static_cast<double>(static_cast<uint64_t>(x)))
+						return conversion_error::integer_overflow;
+					result = static_cast<uint64_t>(x);
+				}
+
+				if (result > std::numeric_limits<T>::max())
+					return conversion_error::integer_overflow;
+				return static_cast<T>(result);
+			}
+			else
+			{
+				int64_t result;
+				if constexpr (std::is_same_v<U, int64_t>)
+				{
+					result = x;
+				}
+				else if constexpr (std::is_same_v<U, uint64_t>)
+				{
+					if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+						return conversion_error::integer_overflow;
+					result = static_cast<int64_t>(x);
+				}
+				else
+				{
+					if (!(x >= -9223372036854775808.0 && x < 9223372036854775808.0) || x != static_cast<double>(static_cast<int64_t>(x)))
+						return conversion_error::integer_overflow;
+					result = static_cast<int64_t>(x);
+				}
+
+				if (result < std::numeric_limits<T>::min() || result > std::numeric_limits<T>::max())
+					return conversion_error::integer_overflow;
+				return static_cast<T>(result);
+			}
+		}
+		template <class T, class U> T cast_number(U x)
+		{
+			return try_cast_number<T>(x).value();
+		}
+
+		// Parses a JSON number out of text (which must contain only the number) and converts it to T, without throwing
+		template <class T> conversion_result<T> try_parse_number(std::string_view text) noexcept
+		{
+			auto is_digit = [&](size_t i) { return i < text.size() && text[i] >= '0' && text[i] <= '9'; };
+
+			size_t i = 0;
+			bool negative = !text.empty() && text[0] == '-';
+			if (negative)
+				++i;
+			if (!is_digit(i))
+				return{ conversion_error::invalid_string, i };
+
+			// Integers larger than 64 bits are rejected, like the JSON reader does
+			uint64_t integer = 0;
+			bool integer_too_large = false;
+			if (text[i] == '0')
+			{
+				++i;
+			}
+			else
+			{
+				for (; is_digit(i); ++i)
+				{
+					auto digit = static_cast<uint64_t>(text[i] - '0');
+					if (integer > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+						integer_too_large = true;
+					integer = integer * 10 + digit;
+				}
+			}
+
+			bool is_integer = true;
+			if (i < text.size() && text[i] == '.')
+			{
+				is_integer = false;
+				if (!is_digit(++i))
+					return{ conversion_error::invalid_string, i };
+				while (is_digit(i))
+					++i;
+			}
+			if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
+			{
+				is_integer = false;
+				++i;
+				if (i < text.size() && (text[i] == '+' || text[i] == '-'))
+					++i;
+				if (!is_digit(i))
+					return{ conversion_error::invalid_string, i };
+				while (is_digit(i))
+					++i;
+			}
+			if (i != text.size())
+				return{ conversion_error::invalid_string, i };
+
+			if (is_integer)
+			{
+				if (integer_too_large || (negative && integer > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1))
+					return{ conversion_error::invalid_string, 0 };
+				if (negative)
+					return try_cast_number<T>(static_cast<int64_t>(0 - integer));
+				return try_cast_number<T>(integer);
+			}
+
+			double result;
+			auto parsed = std::from_chars(text.data(), text.data() + text.size(), result);
+			if (parsed.ec != std::errc{})
+				return{ conversion_error::invalid_string, 0 };
+			return try_cast_number<T>(result);
+		}
+
+		// Same as above, for a string stream (which is read until its end)
+		// The string is copied on the stack, so strings of more than 1079 characters (the longest useful representation of a double) are rejected
+		template <class T, class Stream> conversion_result<T> try_parse_number_stream(Stream& s)
+		{
+			char buffer[1080];
+			auto cb = stream::read_full_buffer(s, { reinterpret_cast<byte*>(buffer), sizeof(buffer) });
+			if (cb == sizeof(buffer))
+			{
+				stream::seek(s, std::numeric_limits<uint64_t>::max());
+				return{ conversion_error::invalid_string, cb };
+			}
+			return try_parse_number<T>({ buffer, cb });
+		}
+
+		// Reads a number of type T out of any document, going through the as_* accessors
+		template <class T, class Document> T as_number(Document&& d)
+		{
+			if constexpr (std::is_floating_point_v<T>) return static_cast<T>(d.as_double());
+			else if constexpr (std::is_unsigned_v<T>) return cast_number<T>(d.as_uint64());
+			else return cast_number<T>(d.as_int64());
+		}
+	}
+
 	template <class DocTraitsT>
 	class document_impl
 	{
@@ -25,6 +280,7 @@ namespace goldfish
 		using tag = tags::document;
 		template <class tag> using type_with_tag_t = typename DocTraitsT::template type_with_tag_t<tag>;
 		static constexpr bool does_json_conversions = DocTraitsT::does_json_conversions;
+		static constexpr bool does_string_conversions = DocTraitsT::does_string_conversions;
 
 		template <class... Args> document_impl(Args&&... args)
 			: m_data(std::forward<Args>(args)...)
@@ -33,12 +289,12 @@ namespace goldfish
 		template <class Lambda> decltype(auto) visit(Lambda&& l) &
 		{
 			assert(!m_moved_from);
-			return std::visit(l, m_data);
+			return m_data.visit(l);
 		}
 		template <class Lambda> decltype(auto) visit(Lambda&& l) &&
 		{
 			assert(!m_moved_from);
-			return std::visit(l, std::move(m_data));
+			return std::move(m_data).visit(l);
 		}
 		type_with_tag_t<tags::string> as_string()
 		{
@@ -46,7 +302,7 @@ namespace goldfish
 			#ifndef NDEBUG
 			m_moved_from = true;
 			#endif
-			return std::get<type_with_tag_t<tags::string>>(std::move(m_data));
+			return std::move(m_data).template get<type_with_tag_t<tags::string>>();
 		}
 		auto as_binary()
 		{
@@ -58,7 +314,7 @@ namespace goldfish
 				#ifndef NDEBUG
 				m_moved_from = true;
 				#endif
-				return std::get<type_with_tag_t<tags::binary>>(std::move(m_data));
+				return std::move(m_data).template get<type_with_tag_t<tags::binary>>();
 			}
 		}
 		type_with_tag_t<tags::array> as_array()
@@ -67,7 +323,7 @@ namespace goldfish
 			#ifndef NDEBUG
 			m_moved_from = true;
 			#endif
-			return std::get<type_with_tag_t<tags::array>>(std::move(m_data));
+			return std::move(m_data).template get<type_with_tag_t<tags::array>>();
 		}
 		type_with_tag_t<tags::map> as_map()
 		{
@@ -75,237 +331,151 @@ namespace goldfish
 			#ifndef NDEBUG
 			m_moved_from = true;
 			#endif
-			return std::get<type_with_tag_t<tags::map>>(std::move(m_data));
+			return std::move(m_data).template get<type_with_tag_t<tags::map>>();
 		}
 		template <class... Args> auto as_object(Args&&... args) { return as_map(std::forward<Args>(args)...); }
 
-		// Floating point can be converted from an int
-		double as_double()
+		// The as_* accessors convert the document to the requested type, and throw std::bad_variant_access if the document
+		// can't be converted (or integer_overflow_while_casting if it doesn't fit)
+		// The try_as_* accessors do the same conversions without throwing, and return a conversion_result instead. Documents
+		// that can't be converted are skipped, so that the rest of the parent array or map can still be read (a document
+		// that is not well formed still throws)
+		// The as_* accessors don't skip documents of another type (arrays, maps, null...), which can still be read after the exception
+		// Floating point can be converted from an int, unsigned ints from signed ints and signed ints from unsigned ints,
+		// ints from floating point if they have no fractional part, and (if does_string_conversions) numbers and booleans
+		// from strings that contain a JSON number, true or false
+		double as_double() { return convert_number<double>(false /*skip_mismatch*/).value(); }
+		uint64_t as_uint64() { return convert_number<uint64_t>(false /*skip_mismatch*/).value(); }
+		uint32_t as_uint32() { return convert_number<uint32_t>(false /*skip_mismatch*/).value(); }
+		uint16_t as_uint16() { return convert_number<uint16_t>(false /*skip_mismatch*/).value(); }
+		uint8_t as_uint8() { return convert_number<uint8_t>(false /*skip_mismatch*/).value(); }
+		int64_t as_int64() { return convert_number<int64_t>(false /*skip_mismatch*/).value(); }
+		int32_t as_int32() { return convert_number<int32_t>(false /*skip_mismatch*/).value(); }
+		int16_t as_int16() { return convert_number<int16_t>(false /*skip_mismatch*/).value(); }
+		int8_t as_int8() { return convert_number<int8_t>(false /*skip_mismatch*/).value(); }
+		bool as_bool() { return convert_bool(false /*skip_mismatch*/).value(); }
+
+		conversion_result<double> try_as_double() { return try_as_number<double>(); }
+		conversion_result<uint64_t> try_as_uint64() { return try_as_number<uint64_t>(); }
+		conversion_result<uint32_t> try_as_uint32() { return try_as_number<uint32_t>(); }
+		conversion_result<uint16_t> try_as_uint16() { return try_as_number<uint16_t>(); }
+		conversion_result<uint8_t> try_as_uint8() { return try_as_number<uint8_t>(); }
+		conversion_result<int64_t> try_as_int64() { return try_as_number<int64_t>(); }
+		conversion_result<int32_t> try_as_int32() { return try_as_number<int32_t>(); }
+		conversion_result<int16_t> try_as_int16() { return try_as_number<int16_t>(); }
+		conversion_result<int8_t> try_as_int8() { return try_as_number<int8_t>(); }
+
+		template <class T> conversion_result<T> try_as_number() { return convert_number<T>(true /*skip_mismatch*/); }
+		conversion_result<bool> try_as_bool() { return convert_bool(true /*skip_mismatch*/); }
+
+		bool is_undefined_or_null() const { return m_data.template holds<undefined>() || m_data.template holds<std::nullptr_t>(); }
+		bool is_null() const { return m_data.template holds<std::nullptr_t>(); }
+
+		template <class tag> bool is_exactly() { return m_data.template holds<type_with_tag_t<tag>>(); }
+
+	private:
+		template <class T> conversion_result<T> convert_number(bool skip_mismatch)
 		{
 			assert(!m_moved_from);
-			double result = std::visit([&](auto&& arg) -> double {
-				using Ti = std::decay_t<decltype(arg)>;
-				auto& x = const_cast<Ti&>(arg);
-				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::floating_point>) { return x; }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::unsigned_int>) { return static_cast<double>(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::signed_int>) { return static_cast<double>(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
-				{
- 					// We need to buffer the stream because read_number uses "peek<char>"
- 					auto s = stream::buffer<1>(stream::ref(x));
- 					try
- 					{
-						double result = std::visit([](auto&& x) -> double { return static_cast<double>(x); }, json::read_number(s, stream::read<char>(s)));
- 						if (stream::seek(s, 1) != 0)
- 							throw std::bad_variant_access{};
- 						return result;
+
+			// The type that the document most likely has when it's read as a T
+			using likely_type = std::conditional_t<std::is_floating_point_v<T>, double, std::conditional_t<std::is_unsigned_v<T>, uint64_t, int64_t>>;
+			if (auto x = m_data.template get_if<likely_type>()) [[likely]]
+			{
+				#ifndef NDEBUG
+				m_moved_from = true;
+				#endif
+				return details::try_cast_number<T>(*x);
+			}
+
+			if constexpr (!does_string_conversions)
+			{
+				// Only the two other numeric types are left to check
+				auto result = [&]() -> conversion_result<T> {
+					if constexpr (!std::is_same_v<likely_type, uint64_t>)
+					{
+						if (auto x = m_data.template get_if<uint64_t>())
+							return details::try_cast_number<T>(*x);
 					}
-					catch (const json::ill_formatted_json_data&)
+					if constexpr (!std::is_same_v<likely_type, int64_t>)
 					{
-						throw std::bad_variant_access{};
+						if (auto x = m_data.template get_if<int64_t>())
+							return details::try_cast_number<T>(*x);
 					}
-					catch (const stream::unexpected_end_of_stream&)
+					if constexpr (!std::is_same_v<likely_type, double>)
 					{
-						throw std::bad_variant_access{};
+						if (auto x = m_data.template get_if<double>())
+							return details::try_cast_number<T>(*x);
 					}
- 				}
-				else
-				{
-					throw std::bad_variant_access{};
-				}
-			}, m_data);
-			#ifndef NDEBUG
-			m_moved_from = true;
-			#endif
-			return result;
-		}
-
-		// Unsigned ints can be converted from signed ints
-		uint64_t as_uint64()
-		{
-			assert(!m_moved_from);
-			uint64_t result = std::visit([](auto&& x) -> uint64_t {
-				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::unsigned_int>) { return x; }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::signed_int>) { return cast_signed_to_unsigned(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::floating_point>) { return cast_double_to_unsigned(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
-				{
-					// We need to buffer the stream because read_number uses "peek<char>"
-					auto s = stream::buffer<1>(stream::ref(x));
-					try
+					return conversion_error::type_mismatch;
+				}();
+				return finish_conversion(result, skip_mismatch);
+			}
+			else
+			{
+				return finish_conversion(m_data.visit([](auto&& x) -> conversion_result<T> {
+					using tag = decltype(tags::get_tag(x));
+					if constexpr (std::is_same_v<tag, tags::unsigned_int> || std::is_same_v<tag, tags::signed_int> || std::is_same_v<tag, tags::floating_point>)
 					{
-						auto num = json::read_number(s, stream::read<char>(s));
-						uint64_t result = 0;
-						if (std::holds_alternative<uint64_t>(num)) { result = std::get<int64_t>(num); }
-						else if (std::holds_alternative<int64_t>(num)) { result = cast_signed_to_unsigned(std::get<int64_t>(num)); }
-						else if (std::holds_alternative<double>(num)) { result = cast_double_to_unsigned(std::get<double>(num)); }
-						if (stream::seek(s, 1) != 0)
-							throw std::bad_variant_access{};
-						return result;
+						return details::try_cast_number<T>(static_cast<std::decay_t<decltype(x)>>(x));
 					}
-					catch (const json::ill_formatted_json_data&)
+					else if constexpr (std::is_same_v<tag, tags::string>)
 					{
-						throw std::bad_variant_access{};
+						return details::try_parse_number_stream<T>(x);
 					}
-					catch (const stream::unexpected_end_of_stream&)
+					else
 					{
-						throw std::bad_variant_access{};
+						return conversion_error::type_mismatch;
 					}
-				}
-				else
-				{
-					throw std::bad_variant_access{};
-				}
-			}, m_data);
-			#ifndef NDEBUG
-			m_moved_from = true;
-			#endif
-			return result;
-		}
-		uint32_t as_uint32()
-		{
-			auto x = as_uint64();
-			if (x > std::numeric_limits<uint32_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<uint32_t>(x);
-		}
-		uint16_t as_uint16()
-		{
-			auto x = as_uint64();
-			if (x > std::numeric_limits<uint16_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<uint16_t>(x);
-		}
-		uint8_t as_uint8()
-		{
-			auto x = as_uint64();
-			if (x > std::numeric_limits<uint8_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<uint8_t>(x);
+				}), skip_mismatch);
+			}
 		}
 
-		// Signed ints can be converted from unsigned ints
-		int64_t as_int64()
+		conversion_result<bool> convert_bool(bool skip_mismatch)
 		{
 			assert(!m_moved_from);
-			int64_t result = std::visit([](auto&& x) -> int64_t {
-				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::signed_int>) { return x; }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::unsigned_int>) { return cast_unsigned_to_signed(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::floating_point>) { return cast_double_to_signed(x); }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
-				{
-					// We need to buffer the stream because read_number uses "peek<char>"
-					auto s = stream::buffer<1>(stream::ref(x));
-					try
-					{
-						auto num = json::read_number(s, stream::read<char>(s));
-						int64_t result = 0;
-						if (std::holds_alternative<int64_t>(num)) { result = std::get<int64_t>(num); }
-						else if (std::holds_alternative<uint64_t>(num)) { result = cast_unsigned_to_signed(std::get<uint64_t>(num)); }
-						else if (std::holds_alternative<double>(num)) { result = cast_double_to_signed(std::get<double>(num)); }
-						if (stream::seek(s, 1) != 0)
-							throw std::bad_variant_access{};
-						return result;
-					}
-					catch (const json::ill_formatted_json_data&)
+			if constexpr (!does_string_conversions)
+			{
+				auto x = m_data.template get_if<bool>();
+				return finish_conversion(x ? conversion_result<bool>(*x) : conversion_error::type_mismatch, skip_mismatch);
+			}
+			else
+			{
+				return finish_conversion(m_data.visit([](auto&& x) -> conversion_result<bool> {
+					if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::boolean>) { return static_cast<bool>(x); }
+					else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
 					{
-						throw std::bad_variant_access{};
+						byte buffer[6];
+						auto cb = read_full_buffer(x, buffer);
+						if (cb == 4 && std::equal(buffer, buffer + 4, "true"))
+							return true;
+						else if (cb == 5 && std::equal(buffer, buffer + 5, "false"))
+							return false;
+						stream::seek(x, std::numeric_limits<uint64_t>::max());
+						return conversion_error::invalid_string;
 					}
-					catch (const stream::unexpected_end_of_stream&)
+					else
 					{
-					 	throw std::bad_variant_access{};
+						return conversion_error::type_mismatch;
 					}
-				}
-				else
-				{
-					throw std::bad_variant_access{};
-				}
-			}, m_data);
-			#ifndef NDEBUG
-			m_moved_from = true;
-			#endif
-			return result;
-		}
-		int32_t as_int32()
-		{
-			auto x = as_int64();
-			if (x < std::numeric_limits<int32_t>::min() || x > std::numeric_limits<int32_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<int32_t>(x);
-		}
-		int16_t as_int16()
-		{
-			auto x = as_int64();
-			if (x < std::numeric_limits<int16_t>::min() || x > std::numeric_limits<int16_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<int16_t>(x);
-		}
-		int8_t as_int8()
-		{
-			auto x = as_int64();
-			if (x < std::numeric_limits<int8_t>::min() || x > std::numeric_limits<int8_t>::max())
-				throw integer_overflow_while_casting{};
-			return static_cast<int8_t>(x);
+				}), skip_mismatch);
+			}
 		}
 
-		bool as_bool()
+		// Documents of another type are skipped by try_as_*, and left unread by as_*
+		template <class T> conversion_result<T> finish_conversion(conversion_result<T> result, bool skip_mismatch)
 		{
-			assert(!m_moved_from);
-			bool result = std::visit([](auto&& x) -> bool{
-				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::boolean>) { return x; }
-				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
-				{
-					byte buffer[6];
-					auto cb = read_full_buffer(x, buffer);
-					if (cb == 4 && std::equal(buffer, buffer + 4, "true"))
-						return true;
-					else if (cb == 5 && std::equal(buffer, buffer + 5, "false"))
-						return false;
-					else
-						throw std::bad_variant_access{};
-				}
-				else
-				{
-					throw std::bad_variant_access{};
-				}
-			}, m_data);
+			if (result.error() == conversion_error::type_mismatch)
+			{
+				if (!skip_mismatch)
+					return result;
+				seek_to_end(*this);
+			}
 			#ifndef NDEBUG
 			m_moved_from = true;
 			#endif
 			return result;
 		}
-		bool is_undefined_or_null() const { return std::holds_alternative<undefined>(m_data) || std::holds_alternative<std::nullptr_t>(m_data); }
-		bool is_null() const { return std::holds_alternative<std::nullptr_t>(m_data); }
-
-		template <class tag> bool is_exactly() { return std::holds_alternative<type_with_tag_t<tag>>(m_data); }
-
-	private:
-		static uint64_t cast_signed_to_unsigned(int64_t x)
-		{
-			if (x < 0)
-				throw integer_overflow_while_casting{};
-			return static_cast<uint64_t>(x);
-		}
-		static int64_t cast_unsigned_to_signed(uint64_t x)
-		{
-			if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
-				throw integer_overflow_while_casting{};
-			return static_cast<int64_t>(x);
-		}
-		static uint64_t cast_double_to_unsigned(double x)
-		{
-			if (x == static_cast<uint64_t>(x))
-				return static_cast<uint64_t>(x);
-			else
-				throw integer_overflow_while_casting{};
-		}
-		static int64_t cast_double_to_signed(double x)
-		{
-			if (x == static_cast<int64_t>(x))
-				return static_cast<int64_t>(x);
-			else
-				throw integer_overflow_while_casting{};
-		}
 
 		#ifndef NDEBUG
 		bool m_moved_from = false;
@@ -313,24 +483,18 @@ namespace goldfish
 		typename DocTraitsT::VariantT m_data;
 	};
 
+	namespace details
+	{
+		template <class Container> void seek_to_end_of_container(Container& x, size_t depth);
+	}
+
 	template <class Document> std::enable_if_t<tags::has_tag<std::decay_t<Document>, tags::document>::value, void> seek_to_end(Document&& d)
 	{
 		d.visit([&](auto&& x) {
 			if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::binary>) { stream::seek(x, std::numeric_limits<uint64_t>::max()); }
 			else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>) { stream::seek(x, std::numeric_limits<uint64_t>::max()); }
-			else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::array>)
-			{
-				while (auto d = x.read())
-					seek_to_end(*d);
-			}
-			else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::map>)
-			{
-				while (auto d = x.read_key())
-				{
-					seek_to_end(*d);
-					seek_to_end(x.read_value());
-				}
-			}
+			else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::array>) { details::seek_to_end_of_container(x, 0); }
+			else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::map>) { details::seek_to_end_of_container(x, 0); }
 		});
 	}
 	template <class type> std::enable_if_t<tags::has_tag<std::decay_t<type>, tags::undefined>::value, void> seek_to_end(type&&) {}
@@ -349,15 +513,72 @@ namespace goldfish
 	}
 	template <class type> std::enable_if_t<tags::has_tag<std::decay_t<type>, tags::array>::value, void> seek_to_end(type&& x)
 	{
-		while (auto d = x.read())
-			seek_to_end(*d);
+		details::seek_to_end_of_container(x, 0);
 	}
 	template <class type> std::enable_if_t<tags::has_tag<std::decay_t<type>, tags::map>::value, void> seek_to_end(type&& x)
 	{
-		while (auto d = x.read_key())
+		details::seek_to_end_of_container(x, 0);
+	}
+
+	namespace details
+	{
+		template <class Container> void seek_to_end_with_stack(Container& x, size_t depth)
 		{
-			seek_to_end(*d);
-			seek_to_end(x.read_value());
+			container_stack<open_container<element_t<Container>>> stack(depth);
+			bool value_next = false;
+			for (;;)
+			{
+				auto d = stack.empty() ? read_element(x, value_next) : stack.top().read_element();
+				if (!d)
+				{
+					if (stack.empty())
+						return;
+					stack.pop();
+					continue;
+				}
+				d->visit([&](auto&& y)
+				{
+					if constexpr (std::is_same_v<decltype(tags::get_tag(y)), tags::binary> || std::is_same_v<decltype(tags::get_tag(y)), tags::string>)
+						stream::seek(y, std::numeric_limits<uint64_t>::max());
+					else if constexpr (std::is_same_v<decltype(tags::get_tag(y)), tags::array> || std::is_same_v<decltype(tags::get_tag(y)), tags::map>)
+						stack.push(std::move(y));
+				});
+			}
+		}
+
+		// depth is the number of arrays and maps x is nested in
+		// The first levels are skipped recursively, the levels below are kept in a stack (see container_stack.h)
+		template <class Container> void seek_to_end_of_container(Container& x, size_t depth)
+		{
+			if constexpr (uniform_container<Container> && self_similar_document<element_t<Container>>)
+			{
+				if (depth >= recursive_nesting_depth)
+					return seek_to_end_with_stack(x, depth);
+			}
+
+			auto skip = [&](auto&& d)
+			{
+				d.visit([&](auto&& y)
+				{
+					if constexpr (std::is_same_v<decltype(tags::get_tag(y)), tags::binary> || std::is_same_v<decltype(tags::get_tag(y)), tags::string>)
+						stream::seek(y, std::numeric_limits<uint64_t>::max());
+					else if constexpr (std::is_same_v<decltype(tags::get_tag(y)), tags::array> || std::is_same_v<decltype(tags::get_tag(y)), tags::map>)
+						seek_to_end_of_container(y, depth + 1);
+				});
+			};
+			if constexpr (std::is_same_v<typename Container::tag, tags::array>)
+			{
+				while (auto d = x.read())
+					skip(*d);
+			}
+			else
+			{
+				while (auto d = x.read_key())
+				{
+					skip(*d);
+					skip(x.read_value());
+				}
+			}
 		}
 	}
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "container_stack.h"
+#include "encoded_key.h"
 #include "stream.h"
 #include "tags.h"
 #include <type_traits>
@@ -7,6 +9,9 @@
 
 namespace goldfish { namespace sax
 {
+	// Numbers are written as doubles, uint64_t or int64_t: elements of numeric arrays are converted to one of those types
+	template <class T> using widened_number_t = std::conditional_t<std::is_floating_point_v<T>, double, std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>;
+
 	template <class inner> class document_writer;
 	template <class inner> document_writer<std::decay_t<inner>> make_writer(inner&& writer);
 
@@ -29,6 +34,11 @@ namespace goldfish { namespace sax
 
 		auto append() { return make_writer(m_writer.append()); }
 		auto flush() { return m_writer.flush(); }
+
+		// Speculative output (see stream::write_mark): elements written after mark() are removed by rollback(mark)
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark()) { return m_writer.mark(); }
+		template <class Mark> void rollback(const Mark& m) { m_writer.rollback(m); }
+		template <class Mark> void commit(const Mark& m) { m_writer.commit(m); }
 	private:
 		inner m_writer;
 	};
@@ -91,13 +101,30 @@ namespace goldfish { namespace sax
 			write_value(std::forward<U>(value));
 		}
 
-		template <class U> void write(const uint64_t key, U&& value)
+		// Integer keys are widened to 64 bits (keeping their sign), other keys are written as they are
+		template <class T, class U> void write(T&& key, U&& value)
+		{
+			using key_type = std::decay_t<T>;
+			if constexpr (std::is_integral_v<key_type> && std::is_signed_v<key_type>)
+				write_key(static_cast<int64_t>(key));
+			else if constexpr (std::is_integral_v<key_type>)
+				write_key(static_cast<uint64_t>(key));
+			else
+				write_key(std::forward<T>(key));
+			write_value(std::forward<U>(value));
+		}
+		template <size_t N, class U> void write(const encoded_key<N>& key, U&& value)
 		{
 			write_key(key);
 			write_value(std::forward<U>(value));
 		}
 
 		auto flush() { return m_writer.flush(); }
+
+		// Speculative output (see stream::write_mark): key value pairs written after mark() are removed by rollback(mark)
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark()) { return m_writer.mark(); }
+		template <class Mark> void rollback(const Mark& m) { m_writer.rollback(m); }
+		template <class Mark> void commit(const Mark& m) { m_writer.commit(m); }
 	private:
 		inner m_writer;
 	};
@@ -148,6 +175,14 @@ namespace goldfish { namespace sax
 			stream.write_buffer({ reinterpret_cast<const byte*>(text.data()), text.size() });
 			return stream.flush();
 		}
+		template <size_t N> auto write(const encoded_key<N>& text) { return m_writer.write(text); }
+
+		// Write an array of numbers in one call, which lets the writer format all the elements in a tight loop
+		template <class T, size_t Extent> auto write_array(std::span<T, Extent> x)
+		{
+			static_assert(std::is_arithmetic_v<T> && !std::is_same_v<std::remove_const_t<T>, bool>, "write_array expects an array of numbers");
+			return m_writer.write_array(std::span<const std::remove_const_t<T>>(x));
+		}
 
 		auto start_array(uint64_t size) { return make_array_writer(m_writer.start_array(size)); }
 		auto start_array() { return make_array_writer(m_writer.start_array()); }
@@ -161,6 +196,19 @@ namespace goldfish { namespace sax
 		}
 
 		template <class T> auto write(T&& document, std::enable_if_t<std::is_same<typename std::decay_t<T>::tag, tags::document>::value>* = nullptr)
+		{
+			return write_document(document, 0);
+		}
+
+		template <class T> decltype(serialize_to_goldfish(std::declval<document_writer<inner>&>(), std::declval<T&&>())) write(T&& t)
+		{
+			return serialize_to_goldfish(*this, std::forward<T>(t));
+		}
+	private:
+		template <class> friend class document_writer;
+
+		// depth is the number of arrays and maps the document is nested in
+		template <class Document> auto write_document(Document&& document, size_t depth)
 		{
 			return document.visit([&](auto&& x) {
 				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::binary>) { return write(x); }
@@ -170,17 +218,12 @@ namespace goldfish { namespace sax
 				}
 				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::array>) {
 					auto array_writer = start_array();
-					while (auto element = x.read())
-						array_writer.write(*element);
+					copy_elements(x, array_writer, depth);
 					return array_writer.flush();
 				}
 				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::map>) {
 					auto map_writer = start_map();
-					while (auto key = x.read_key())
-					{
-						map_writer.write_key(*key);
-						map_writer.write_value(x.read_value());
-					}
+					copy_elements(x, map_writer, depth);
 					return map_writer.flush();
 				}
 				else {
@@ -189,11 +232,88 @@ namespace goldfish { namespace sax
 			});
 		}
 
-		template <class T> decltype(serialize_to_goldfish(std::declval<document_writer<inner>&>(), std::declval<T&&>())) write(T&& t)
+		// Copies the elements of an array or map document to the writer of that array or map
+		// The first levels are copied recursively, the levels below are kept in a stack with their writers (see container_stack.h)
+		template <class Container, class ContainerWriter> static void copy_elements(Container& x, ContainerWriter& writer, size_t depth)
 		{
-			return serialize_to_goldfish(*this, std::forward<T>(t));
+			using element = goldfish::details::element_t<Container>;
+			using element_writer = decltype(goldfish::details::append_element(writer));
+			if constexpr (goldfish::details::uniform_container<Container> && goldfish::details::self_similar_document<element> && goldfish::details::self_similar_writer<element_writer>)
+			{
+				if (depth >= goldfish::details::recursive_nesting_depth)
+					return copy_elements_with_stack(x, writer, depth);
+			}
+
+			if constexpr (std::is_same_v<typename Container::tag, tags::array>)
+			{
+				while (auto element = x.read())
+					writer.append().write_document(*element, depth + 1);
+			}
+			else
+			{
+				while (auto key = x.read_key())
+				{
+					writer.append_key().write_document(*key, depth + 1);
+					writer.append_value().write_document(x.read_value(), depth + 1);
+				}
+			}
 		}
-	private:
+		template <class Container, class ContainerWriter> static void copy_elements_with_stack(Container& x, ContainerWriter& writer, size_t depth)
+		{
+			using element = goldfish::details::element_t<Container>;
+			using element_writer = decltype(goldfish::details::append_element(writer));
+			goldfish::details::container_stack<goldfish::details::copied_container<element, element_writer>> stack(depth);
+			auto write_element = [&](auto&& w, element& d)
+			{
+				if constexpr (std::is_same_v<std::decay_t<decltype(w)>, element_writer>)
+				{
+					if (d.template is_exactly<tags::array>())
+					{
+						stack.push(d.as_array(), w.start_array());
+						return;
+					}
+					if (d.template is_exactly<tags::map>())
+					{
+						stack.push(d.as_map(), w.start_map());
+						return;
+					}
+				}
+				// Leaves, and keys that have their own writer type
+				w.write_document(d, depth + stack.size() + 1);
+			};
+			auto append_and_write = [&](auto& container_writer, bool is_key, element& d)
+			{
+				if constexpr (requires { container_writer.append_key(); })
+				{
+					if (is_key)
+						return write_element(container_writer.append_key(), d);
+				}
+				write_element(goldfish::details::append_element(container_writer), d);
+			};
+
+			bool value_next = false;
+			for (;;)
+			{
+				auto d = stack.empty() ? goldfish::details::read_element(x, value_next) : stack.top().reader.read_element();
+				if (!d)
+				{
+					if (stack.empty())
+						return;
+					std::visit([](auto& w) { w.flush(); }, stack.top().writer);
+					stack.pop();
+				}
+				else if (stack.empty())
+				{
+					append_and_write(writer, value_next, *d);
+				}
+				else
+				{
+					auto& top = stack.top();
+					std::visit([&](auto& w) { append_and_write(w, top.reader.read_key_last(), *d); }, top.writer);
+				}
+			}
+		}
+
 		template <class Stream, class CreateWriterWithSize, class CreateWriterWithoutSize>
 		auto copy(Stream& s, CreateWriterWithSize&& create_writer_with_size, CreateWriterWithoutSize&& create_writer_without_size)
 		{
@@ -0,0 +1,298 @@
+#pragma once
+
+#include "sax_reader.h"
+#include "sax_writer.h"
+#include <algorithm>
+#include <array>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Reading and writing of the standard containers
+// On the write side, writer.write(x) accepts std::vector, std::array, std::map, std::unordered_map, std::optional,
+// std::variant, std::pair and std::tuple of supported types. Arrays and maps are written with the size of the container
+// (which gives definite length CBOR), and arrays of numbers go through write_array
+// On the read side, goldfish::deserialize<T>(document) creates a T out of a document, for the same containers, booleans,
+// numbers and std::string. Containers are reserved when the document announces its length (definite length CBOR), and
+// vectors of numbers go through read_all_into
+// std::vector<byte> and std::array<byte, N> are binary data, not arrays of numbers
+// std::optional is null (or undefined) when empty, std::variant is written as its current alternative and read as the
+// first alternative that can hold the type of the document, std::pair and std::tuple are arrays with one element per member
+// Other types can be read by adding an overload of deserialize_from_goldfish(Document&&, deserialize_tag<T>), and written
+// with an overload of serialize_to_goldfish
+namespace goldfish
+{
+	// Thrown when reading a std::array, std::pair or std::tuple out of an array with a different number of elements
+	struct array_size_mismatch : exception { array_size_mismatch() : exception("Unexpected number of elements in array") {} };
+
+	// Tag used to pick the deserialize_from_goldfish overload that creates a T
+	template <class T> struct deserialize_tag {};
+
+	// Reads a T out of a document
+	template <class T, class Document> T deserialize(Document&& d)
+	{
+		return deserialize_from_goldfish(std::forward<Document>(d), deserialize_tag<T>{});
+	}
+
+	namespace details
+	{
+		template <class T> constexpr bool is_number = std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+
+		// Container lengths announced by the document are only trusted up to what could reasonably be in the stream, to avoid
+		// huge allocations on corrupted data
+		template <class Container, class Reader> void reserve_remaining_length(Container& c, const Reader& reader)
+		{
+			if (auto length = reader.remaining_length())
+				c.reserve(c.size() + static_cast<size_t>(std::min<uint64_t>(*length, typical_buffer_length)));
+		}
+
+		template <class T> struct is_std_array : std::false_type {};
+		template <class T, size_t N> struct is_std_array<std::array<T, N>> : std::true_type {};
+		template <class T> struct is_tuple_like : std::false_type {};
+		template <class... T> struct is_tuple_like<std::tuple<T...>> : std::true_type {};
+		template <class T, class U> struct is_tuple_like<std::pair<T, U>> : std::true_type {};
+		template <class T> struct is_std_map : std::false_type {};
+		template <class K, class V, class C, class A> struct is_std_map<std::map<K, V, C, A>> : std::true_type {};
+		template <class K, class V, class H, class E, class A> struct is_std_map<std::unordered_map<K, V, H, E, A>> : std::true_type {};
+		template <class T> struct is_std_optional : std::false_type {};
+		template <class T> struct is_std_optional<std::optional<T>> : std::true_type {};
+
+		// Whether a document could be read as a T without a conversion (used to pick the alternative of a std::variant)
+		template <class T, class Document> bool holds_alternative(Document& d)
+		{
+			if constexpr (std::is_same_v<T, bool>)
+				return d.template is_exactly<tags::boolean>();
+			else if constexpr (std::is_floating_point_v<T>)
+				return d.template is_exactly<tags::floating_point>() || d.template is_exactly<tags::unsigned_int>() || d.template is_exactly<tags::signed_int>();
+			else if constexpr (is_number<T>)
+				return d.template is_exactly<tags::unsigned_int>() || d.template is_exactly<tags::signed_int>();
+			else if constexpr (std::is_same_v<T, std::string>)
+				return d.template is_exactly<tags::string>();
+			else if constexpr (std::is_same_v<T, std::vector<byte>>)
+				return d.template is_exactly<tags::binary>();
+			else if constexpr (std::is_same_v<T, std::monostate>)
+				return d.is_undefined_or_null();
+			else if constexpr (is_std_optional<T>::value)
+				return d.is_undefined_or_null() || holds_alternative<typename T::value_type>(d);
+			else if constexpr (is_std_array<T>::value || is_tuple_like<T>::value)
+				return d.template is_exactly<tags::array>();
+			else if constexpr (is_std_map<T>::value)
+				return d.template is_exactly<tags::map>();
+			else if constexpr (requires { typename T::value_type; typename T::allocator_type; })
+				return d.template is_exactly<tags::array>();
+			else
+				return true;
+		}
+	}
+
+	template <class Document> bool deserialize_from_goldfish(Document&& d, deserialize_tag<bool>) { return d.as_bool(); }
+	template <class Document, class T> requires details::is_number<T> T deserialize_from_goldfish(Document&& d, deserialize_tag<T>)
+	{
+		return details::as_number<T>(std::forward<Document>(d));
+	}
+	template <class Document> std::string deserialize_from_goldfish(Document&& d, deserialize_tag<std::string>) { return stream::read_all_as_string(d.as_string()); }
+	template <class Document> std::vector<byte> deserialize_from_goldfish(Document&& d, deserialize_tag<std::vector<byte>>) { return stream::read_all(d.as_binary()); }
+	template <class Document> std::monostate deserialize_from_goldfish(Document&& d, deserialize_tag<std::monostate>)
+	{
+		if (!d.is_undefined_or_null())
+			throw std::bad_variant_access{};
+		return{};
+	}
+
+	template <class Document, class T> std::optional<T> deserialize_from_goldfish(Document&& d, deserialize_tag<std::optional<T>>)
+	{
+		if (d.is_undefined_or_null())
+			return std::nullopt;
+		return deserialize<T>(std::forward<Document>(d));
+	}
+
+	template <class Document, class T, class A> std::vector<T, A> deserialize_from_goldfish(Document&& d, deserialize_tag<std::vector<T, A>>)
+	{
+		std::vector<T, A> result;
+		auto array = d.as_array();
+		if constexpr (details::is_number<T> && std::is_same_v<A, std::allocator<T>>)
+		{
+			array.read_all_into(result);
+		}
+		else
+		{
+			details::reserve_remaining_length(result, array);
+			while (auto element = array.read())
+				result.push_back(deserialize<T>(std::move(*element)));
+		}
+		return result;
+	}
+
+	template <class Document, class T, size_t N> std::array<T, N> deserialize_from_goldfish(Document&& d, deserialize_tag<std::array<T, N>>)
+	{
+		std::array<T, N> result;
+		if constexpr (std::is_same_v<T, byte>)
+		{
+			auto binary = d.as_binary();
+			if (stream::read_full_buffer(binary, result) != N || stream::seek(binary, 1) != 0)
+				throw array_size_mismatch{};
+		}
+		else
+		{
+			auto array = d.as_array();
+			if constexpr (details::is_number<T>)
+			{
+				if (array.read_into(std::span<T>(result)) != N)
+					throw array_size_mismatch{};
+			}
+			else
+			{
+				for (auto& x : result)
+				{
+					auto element = array.read();
+					if (!element)
+						throw array_size_mismatch{};
+					x = deserialize<T>(std::move(*element));
+				}
+			}
+			if (array.read())
+				throw array_size_mismatch{};
+		}
+		return result;
+	}
+
+	namespace details
+	{
+		template <class Tuple, class Array, size_t... I> Tuple read_tuple(Array& array, std::index_sequence<I...>)
+		{
+			auto read_element = [&](auto tag) -> typename decltype(tag)::type
+			{
+				auto element = array.read();
+				if (!element)
+					throw array_size_mismatch{};
+				return deserialize<typename decltype(tag)::type>(std::move(*element));
+			};
+			// Braced initialization guarantees that the elements are read in order
+			Tuple result{ read_element(std::type_identity<std::tuple_element_t<I, Tuple>>{})... };
+			if (array.read())
+				throw array_size_mismatch{};
+			return result;
+		}
+
+		template <class Variant, class Document, size_t I = 0> Variant read_variant(Document&& d)
+		{
+			if constexpr (I == std::variant_size_v<Variant>)
+			{
+				throw std::bad_variant_access{};
+			}
+			else
+			{
+				using alternative = std::variant_alternative_t<I, Variant>;
+				if (holds_alternative<alternative>(d))
+					return Variant{ std::in_place_index<I>, deserialize<alternative>(std::forward<Document>(d)) };
+				return read_variant<Variant, Document, I + 1>(std::forward<Document>(d));
+			}
+		}
+
+		template <class Map, class Document> Map read_map(Document&& d)
+		{
+			Map result;
+			auto map = d.as_map();
+			if constexpr (requires { result.reserve(size_t{}); })
+				reserve_remaining_length(result, map);
+			while (auto key = map.read_key())
+			{
+				auto k = deserialize<typename Map::key_type>(std::move(*key));
+				result.insert_or_assign(std::move(k), deserialize<typename Map::mapped_type>(map.read_value()));
+			}
+			return result;
+		}
+	}
+	template <class Document, class... T> std::tuple<T...> deserialize_from_goldfish(Document&& d, deserialize_tag<std::tuple<T...>>)
+	{
+		auto array = d.as_array();
+		return details::read_tuple<std::tuple<T...>>(array, std::index_sequence_for<T...>{});
+	}
+	template <class Document, class T, class U> std::pair<T, U> deserialize_from_goldfish(Document&& d, deserialize_tag<std::pair<T, U>>)
+	{
+		auto array = d.as_array();
+		return details::read_tuple<std::pair<T, U>>(array, std::index_sequence<0, 1>{});
+	}
+	template <class Document, class... T> std::variant<T...> deserialize_from_goldfish(Document&& d, deserialize_tag<std::variant<T...>>)
+	{
+		return details::read_variant<std::variant<T...>>(std::forward<Document>(d));
+	}
+	template <class Document, class K, class V, class C, class A> std::map<K, V, C, A> deserialize_from_goldfish(Document&& d, deserialize_tag<std::map<K, V, C, A>>)
+	{
+		return details::read_map<std::map<K, V, C, A>>(std::forward<Document>(d));
+	}
+	template <class Document, class K, class V, class H, class E, class A> std::unordered_map<K, V, H, E, A> deserialize_from_goldfish(Document&& d, deserialize_tag<std::unordered_map<K, V, H, E, A>>)
+	{
+		return details::read_map<std::unordered_map<K, V, H, E, A>>(std::forward<Document>(d));
+	}
+
+	namespace details
+	{
+		template <class Writer, class Range> auto write_range(Writer& writer, const Range& range)
+		{
+			using element = std::decay_t<decltype(*std::begin(range))>;
+			if constexpr (std::is_same_v<element, byte>)
+			{
+				return writer.write(std::span<const byte>(std::data(range), std::size(range)));
+			}
+			else if constexpr (is_number<element>)
+			{
+				return writer.write_array(std::span<const element>(std::data(range), std::size(range)));
+			}
+			else
+			{
+				auto array = writer.start_array(std::size(range));
+				for (auto&& x : range)
+					array.write(static_cast<const element&>(x));
+				return array.flush();
+			}
+		}
+		template <class Writer, class Map> auto write_map(Writer& writer, const Map& map)
+		{
+			auto map_writer = writer.start_map(map.size());
+			for (auto&& [key, value] : map)
+				map_writer.write(key, value);
+			return map_writer.flush();
+		}
+	}
+
+	namespace sax
+	{
+		// Found by argument dependent lookup on the writer from document_writer::write
+		template <class Writer, class T, class A> auto serialize_to_goldfish(Writer& writer, const std::vector<T, A>& x) { return goldfish::details::write_range(writer, x); }
+		template <class Writer, class T, size_t N> auto serialize_to_goldfish(Writer& writer, const std::array<T, N>& x) { return goldfish::details::write_range(writer, x); }
+		template <class Writer, class K, class V, class C, class A> auto serialize_to_goldfish(Writer& writer, const std::map<K, V, C, A>& x) { return goldfish::details::write_map(writer, x); }
+		template <class Writer, class K, class V, class H, class E, class A> auto serialize_to_goldfish(Writer& writer, const std::unordered_map<K, V, H, E, A>& x) { return goldfish::details::write_map(writer, x); }
+		template <class Writer, class T> auto serialize_to_goldfish(Writer& writer, const std::optional<T>& x)
+		{
+			if (!x)
+				return writer.write(nullptr);
+			return writer.write(*x);
+		}
+		template <class Writer> auto serialize_to_goldfish(Writer& writer, std::monostate) { return writer.write(nullptr); }
+		template <class Writer, class... T> auto serialize_to_goldfish(Writer& writer, const std::variant<T...>& x)
+		{
+			using result = decltype(writer.write(std::get<0>(x)));
+			return std::visit([&](auto& alternative) -> result { return writer.write(alternative); }, x);
+		}
+		template <class Writer, class... T> auto serialize_to_goldfish(Writer& writer, const std::tuple<T...>& x)
+		{
+			auto array = writer.start_array(sizeof...(T));
+			std::apply([&](auto&... elements) { (array.write(elements), ...); }, x);
+			return array.flush();
+		}
+		template <class Writer, class T, class U> auto serialize_to_goldfish(Writer& writer, const std::pair<T, U>& x)
+		{
+			auto array = writer.start_array(2);
+			array.write(x.first);
+			array.write(x.second);
+			return array.flush();
+		}
+	}
+}
@@ -34,6 +34,10 @@ namespace goldfish { namespace stream
 	template <class T, class elem> static std::false_type test_has_read(...) { return{}; }
 	template <class T, class elem> struct has_read : decltype(test_has_read<T, elem>(nullptr)) {};
 
+	template <class T, class elem> static std::true_type test_has_peek(decltype(std::declval<T>(). template peek<elem>())*) { return{}; }
+	template <class T, class elem> static std::false_type test_has_peek(...) { return{}; }
+	template <class T, class elem> struct has_peek : decltype(test_has_peek<T, elem>(nullptr)) {};
+
 	template <class Stream> enable_if_reader_t<Stream, size_t> read_full_buffer(Stream&& s, std::span<byte> buffer)
 	{
 		std::ptrdiff_t cur = 0;
@@ -84,6 +88,63 @@ namespace goldfish { namespace stream
 		s.write_buffer({ reinterpret_cast<const byte*>(&t), sizeof(t) });
 	}
 
+	// Writer streams can optionally give direct access to their output buffer:
+	//  - reserve(cb) returns a pointer to at least cb writable bytes, or nullptr if the stream can't provide that many contiguous bytes
+	//  - commit(cb) appends the first cb bytes of the reserved space to the stream (cb is at most the size passed to reserve)
+	template <class T> static std::true_type test_has_reserve(decltype(std::declval<T>().reserve(size_t{}))*) { return{}; }
+	template <class T> static std::false_type test_has_reserve(...) { return{}; }
+	template <class T> struct has_reserve : decltype(test_has_reserve<T>(nullptr)) {};
+
+	// Call fill with a buffer of cb bytes, and write the bytes it produced (fill returns how many) to the stream
+	// The buffer is the output buffer of the stream when the stream supports reserve/commit, a buffer on the stack otherwise
+	template <size_t cb, class stream, class Fill> void write_direct(stream& s, Fill&& fill)
+	{
+		byte local_buffer[cb];
+		if constexpr (has_reserve<stream>::value)
+		{
+			// fill is only called at one place, to keep the code small enough to be inlined
+			auto reserved = s.reserve(cb);
+			auto cb_written = static_cast<size_t>(fill(reserved ? reserved : local_buffer));
+			if (reserved)
+				s.commit(cb_written);
+			else
+				s.write_buffer({ local_buffer, cb_written });
+		}
+		else
+		{
+			s.write_buffer({ local_buffer, static_cast<size_t>(fill(local_buffer)) });
+		}
+	}
+
+	// Writer streams that keep their output in memory can also roll back what was written, to drop speculative output:
+	//  - mark() returns the current position in the output
+	//  - rollback(mark) removes everything written after the mark
+	//  - commit(mark) keeps what was written after the mark (it's free, and the mark can't be rolled back anymore)
+	struct write_mark { uint64_t position; };
+	template <class T> static std::true_type test_has_mark(decltype(std::declval<T>().mark())*) { return{}; }
+	template <class T> static std::false_type test_has_mark(...) { return{}; }
+	template <class T> struct has_mark : decltype(test_has_mark<T>(nullptr)) {};
+
+	// Reader streams that read from memory can save their position and come back to it, to read the same data twice:
+	//  - bookmark() returns the current position in the input
+	//  - rewind(bookmark) moves the stream back (or forward) to that position
+	// Bookmarks are only meaningful for the stream that created them, and stay valid when that stream is moved
+	struct read_bookmark { uint64_t remaining_length; };
+	template <class T> static std::true_type test_has_bookmark(decltype(std::declval<T>().bookmark())*) { return{}; }
+	template <class T> static std::false_type test_has_bookmark(...) { return{}; }
+	template <class T> struct has_bookmark : decltype(test_has_bookmark<T>(nullptr)) {};
+
+	// Writer streams that batch their output (see buffered_writer) can be told where records (such as the lines of a JSON Lines stream) end,
+	// which lets them send complete records to the inner stream without waiting for their buffer to be full
+	template <class T> static std::true_type test_has_end_of_record(decltype(std::declval<T>().end_of_record())*) { return{}; }
+	template <class T> static std::false_type test_has_end_of_record(...) { return{}; }
+	template <class T> struct has_end_of_record : decltype(test_has_end_of_record<T>(nullptr)) {};
+	template <class stream> void end_of_record(stream& s)
+	{
+		if constexpr (has_end_of_record<stream>::value)
+			s.end_of_record();
+	}
+
 	template <class inner> class ref_reader;
 	template <class inner> class ref_writer;
 	template <class T> struct is_ref : std::false_type {};
@@ -101,7 +162,10 @@ namespace goldfish { namespace stream
 		size_t read_partial_buffer(std::span<byte> data) { return m_stream.read_partial_buffer(data); }
 		template <class T> auto read() { return stream::read<T>(m_stream); }
 		uint64_t seek(uint64_t x) { return stream::seek(m_stream, x); }
-		template <class T> auto peek() { return m_stream.template peek<T>(); }
+		template <class T> auto peek() -> decltype(std::declval<inner&>().template peek<T>()) { return m_stream.template peek<T>(); }
+		template <class T = inner> auto string_references() -> decltype(std::declval<T&>().string_references()) { return m_stream.string_references(); }
+		template <class T = inner> auto bookmark() const -> decltype(std::declval<T&>().bookmark()) { return m_stream.bookmark(); }
+		template <class T = inner> auto rewind(read_bookmark b) -> decltype(std::declval<T&>().rewind(b)) { return m_stream.rewind(b); }
 	private:
 		inner& m_stream;
 	};
@@ -120,6 +184,14 @@ namespace goldfish { namespace stream
 		// Note that the ref_writer doesn't flush
 		// The actual owner of the stream should be the one flushing
 		void flush() { }
+		template <class T = inner> auto reserve(size_t cb) -> decltype(std::declval<T&>().reserve(cb)) { return m_stream.reserve(cb); }
+		template <class T = inner> auto commit(size_t cb) -> decltype(std::declval<T&>().commit(cb)) { return m_stream.commit(cb); }
+		template <class T = inner> auto mark() -> decltype(std::declval<T&>().mark()) { return m_stream.mark(); }
+		template <class T = inner> auto rollback(write_mark m) -> decltype(std::declval<T&>().rollback(m)) { return m_stream.rollback(m); }
+		template <class T = inner> auto commit(write_mark m) -> decltype(std::declval<T&>().commit(m)) { return m_stream.commit(m); }
+		template <class T = inner> auto end_of_record() -> decltype(std::declval<T&>().end_of_record()) { return m_stream.end_of_record(); }
+		template <class T = inner> auto poll() -> decltype(std::declval<T&>().poll()) { return m_stream.poll(); }
+		template <class T = inner> auto string_references() -> decltype(std::declval<T&>().string_references()) { return m_stream.string_references(); }
 	private:
 		inner& m_stream;
 	};
@@ -169,6 +241,14 @@ namespace goldfish { namespace stream
 		{
 			return peek_helper<T>(std::integral_constant<size_t, alignof(T)>());
 		}
+
+		// The position is kept as the number of bytes left, which doesn't change when a vector_reader or string_reader is moved
+		read_bookmark bookmark() const { return{ m_data.size() }; }
+		void rewind(read_bookmark b)
+		{
+			auto end = m_data.data() + m_data.size();
+			m_data = { end - b.remaining_length, static_cast<size_t>(b.remaining_length) };
+		}
 	private:
 		template <class T> std::optional<T> peek_helper(std::integral_constant<size_t, 1>)
 		{
@@ -289,6 +369,17 @@ namespace goldfish { namespace stream
 			assert(!m_flushed);
 			m_data.push_back(reinterpret_cast<const byte&>(t));
 		}
+		write_mark mark() const
+		{
+			assert(!m_flushed);
+			return{ m_data.size() };
+		}
+		void rollback(write_mark m)
+		{
+			assert(!m_flushed && m.position <= m_data.size());
+			m_data.resize(static_cast<size_t>(m.position));
+		}
+		void commit(write_mark) {}
 		const auto& data() const
 		{
 			assert(!m_flushed);
@@ -322,6 +413,17 @@ namespace goldfish { namespace stream
 			assert(!m_flushed);
 			m_data.push_back(reinterpret_cast<const char&>(t));
 		}
+		write_mark mark() const
+		{
+			assert(!m_flushed);
+			return{ m_data.size() };
+		}
+		void rollback(write_mark m)
+		{
+			assert(!m_flushed && m.position <= m_data.size());
+			m_data.resize(static_cast<size_t>(m.position));
+		}
+		void commit(write_mark) {}
 		auto flush()
 		{
 			assert(!m_flushed);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "encoded_key.h"
+#include "key_matcher.h"
+#include "std_containers.h"
+#include <array>
+#include <tuple>
+#include <utility>
+
+// Declarative mapping between C++ structs and JSON or CBOR maps
+// A struct is mapped by a goldfish_fields function, found by argument dependent lookup, that lists the key of each field and
+// the corresponding data member:
+//   struct point { int x; int y; std::string label; };
+//   constexpr auto goldfish_fields(const point*)
+//   {
+//       return goldfish::fields(goldfish::field("x", &point::x), goldfish::field("y", &point::y), goldfish::field("label", &point::label));
+//   }
+// A mapped struct is read with goldfish::deserialize<point>(document) and written with writer.write(p)
+// When reading, keys are dispatched to the fields with a perfect hash built at compile time: unknown keys are skipped, and
+// fields that are not in the map keep their default value. When writing, the keys are encoded at compile time
+// Fields can be of any type supported by deserialize and the writers (see std_containers.h), including other mapped structs
+namespace goldfish
+{
+	template <class Class, class Member> struct field_mapping
+	{
+		std::string_view key;
+		Member Class::* member;
+	};
+	template <class Class, class Member> constexpr field_mapping<Class, Member> field(std::string_view key, Member Class::* member) { return{ key, member }; }
+	template <class... Fields> constexpr std::tuple<Fields...> fields(Fields... f) { return{ f... }; }
+
+	template <class T> concept has_struct_mapping = requires { goldfish_fields(static_cast<const T*>(nullptr)); };
+
+	namespace details
+	{
+		template <class T> struct struct_mapping
+		{
+			static constexpr auto fields = goldfish_fields(static_cast<const T*>(nullptr));
+			static constexpr size_t size = std::tuple_size_v<decltype(fields)>;
+			static constexpr perfect_hash_key_matcher<size> matcher = std::apply([](auto... f) { return perfect_hash_key_matcher<size>(std::array<std::string_view, size>{ f.key... }); }, fields);
+
+			static constexpr size_t max_key_length = std::apply([](auto... f) { return std::max({ size_t{ 0 }, f.key.size()... }); }, fields);
+			static constexpr auto keys = std::apply([](auto... f) { return std::array<encoded_key<max_key_length>, size>{ encoded_key<max_key_length>(f.key)... }; }, fields);
+		};
+	}
+
+	namespace details
+	{
+		template <size_t I, class T, class Map> void read_field(T& result, Map& map)
+		{
+			auto member = std::get<I>(struct_mapping<T>::fields).member;
+			result.*member = deserialize<std::decay_t<decltype(result.*member)>>(map.read_value());
+		}
+		template <class T, class Map, size_t... I> bool read_field(T& result, size_t index, Map& map, std::index_sequence<I...>)
+		{
+			return ((index == I && (read_field<I>(result, map), true)) || ...);
+		}
+	}
+	template <class Document, has_struct_mapping T> T deserialize_from_goldfish(Document&& d, deserialize_tag<T>)
+	{
+		using mapping = details::struct_mapping<T>;
+		T result{};
+		auto map = d.as_map();
+		while (auto index = map.read_key_match(mapping::matcher))
+		{
+			if (!details::read_field(result, *index, map, std::make_index_sequence<mapping::size>{}))
+				seek_to_end(map.read_value());
+		}
+		return result;
+	}
+
+	namespace sax
+	{
+		// Found by argument dependent lookup on the writer from document_writer::write
+		template <class Writer, has_struct_mapping T> auto serialize_to_goldfish(Writer& writer, const T& t)
+		{
+			using mapping = goldfish::details::struct_mapping<T>;
+			auto map = writer.start_map(mapping::size);
+			[&]<size_t... I>(std::index_sequence<I...>)
+			{
+				(map.write(mapping::keys[I], t.*(std::get<I>(mapping::fields).member)), ...);
+			}(std::make_index_sequence<mapping::size>{});
+			return map.flush();
+		}
+	}
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "common.h"
+
+namespace goldfish
+{
+	namespace details
+	{
+		template <class U, class... T> struct index_of;
+		template <class U, class... T> struct index_of<U, U, T...> : std::integral_constant<uint8_t, 0> {};
+		template <class U, class Head, class... T> struct index_of<U, Head, T...> : std::integral_constant<uint8_t, 1 + index_of<U, T...>::value> {};
+
+		template <class T> constexpr bool is_trivial_alternative = std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>;
+
+		// Returns an lvalue if Self is an lvalue reference to the tagged_union, an rvalue otherwise
+		template <class Self, class U> decltype(auto) forward_alternative(U& u)
+		{
+			if constexpr (std::is_lvalue_reference_v<Self>)
+				return (u);
+			else
+				return std::move(u);
+		}
+	}
+
+	// Union of the types T with a one byte tag, used by the document readers instead of std::variant
+	// visit dispatches with a switch, which compiles to a jump table or a few comparisons and lets the compiler inline the
+	// small cases, where std::visit goes through a table of function pointers
+	// Trivial alternatives (numbers, booleans, null...) are moved with a memcpy of the storage and are not destroyed
+	// Like std::variant, get throws std::bad_variant_access if the tagged union holds another type
+	template <class... T> class tagged_union
+	{
+		static_assert(sizeof...(T) > 0 && sizeof...(T) <= 12, "tagged_union supports 1 to 12 alternatives");
+		template <size_t I> using alternative = std::tuple_element_t<I, std::tuple<T...>>;
+		template <class Self, class F> using visit_result_t = std::invoke_result_t<F, decltype(details::forward_alternative<Self>(std::declval<std::conditional_t<std::is_const_v<std::remove_reference_t<Self>>, const alternative<0>&, alternative<0>&>>()))>;
+
+	public:
+		template <class U> static constexpr uint8_t index_of = details::index_of<std::decay_t<U>, T...>::value;
+
+		template <class U, class = std::enable_if_t<!std::is_same_v<std::decay_t<U>, tagged_union>>> tagged_union(U&& u)
+			: m_index(index_of<U>)
+		{
+			new (m_storage) std::decay_t<U>(std::forward<U>(u));
+		}
+
+		// The special members are trivial when they are trivial for all the alternatives (a document on a trivial stream is trivially movable)
+		tagged_union(tagged_union&&) requires (std::is_trivially_move_constructible_v<T> && ...) = default;
+		tagged_union(tagged_union&& rhs)
+			: m_index(rhs.m_index)
+		{
+			construct_from(std::move(rhs));
+		}
+		tagged_union(const tagged_union&) requires (std::is_trivially_copy_constructible_v<T> && ...) = default;
+		tagged_union(const tagged_union& rhs) requires ((std::is_copy_constructible_v<T> && ...) && !(std::is_trivially_copy_constructible_v<T> && ...))
+			: m_index(rhs.m_index)
+		{
+			construct_from(rhs);
+		}
+		tagged_union& operator = (tagged_union&&) requires ((std::is_trivially_move_constructible_v<T> && std::is_trivially_destructible_v<T>) && ...) = default;
+		tagged_union& operator = (tagged_union&& rhs)
+		{
+			if (this != &rhs)
+			{
+				destroy();
+				m_index = rhs.m_index;
+				construct_from(std::move(rhs));
+			}
+			return *this;
+		}
+		tagged_union& operator = (const tagged_union&) requires ((std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>) && ...) = default;
+		tagged_union& operator = (const tagged_union& rhs) requires ((std::is_copy_constructible_v<T> && ...) && !((std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>) && ...))
+		{
+			if (this != &rhs)
+			{
+				destroy();
+				m_index = rhs.m_index;
+				construct_from(rhs);
+			}
+			return *this;
+		}
+		~tagged_union() requires (std::is_trivially_destructible_v<T> && ...) = default;
+		~tagged_union() { destroy(); }
+
+		uint8_t index() const { return m_index; }
+		template <class U> bool holds() const { return m_index == index_of<U>; }
+
+		template <class U> U& get() &
+		{
+			if (!holds<U>())
+				throw std::bad_variant_access{};
+			return get_unchecked<index_of<U>>();
+		}
+		template <class U> const U& get() const&
+		{
+			if (!holds<U>())
+				throw std::bad_variant_access{};
+			return get_unchecked<index_of<U>>();
+		}
+		template <class U> U&& get() &&
+		{
+			if (!holds<U>())
+				throw std::bad_variant_access{};
+			return std::move(get_unchecked<index_of<U>>());
+		}
+		template <class U> U* get_if() { return holds<U>() ? &get_unchecked<index_of<U>>() : nullptr; }
+		template <class U> const U* get_if() const { return holds<U>() ? &get_unchecked<index_of<U>>() : nullptr; }
+
+		// Like std::visit, the result type is the one of f called with the first alternative
+		template <class F> auto visit(F&& f) & -> visit_result_t<tagged_union&, F> { return visit_impl(*this, std::forward<F>(f)); }
+		template <class F> auto visit(F&& f) const& -> visit_result_t<const tagged_union&, F> { return visit_impl(*this, std::forward<F>(f)); }
+		template <class F> auto visit(F&& f) && -> visit_result_t<tagged_union, F> { return visit_impl(std::move(*this), std::forward<F>(f)); }
+
+	private:
+		template <size_t I> alternative<I>& get_unchecked() { return *std::launder(reinterpret_cast<alternative<I>*>(m_storage)); }
+		template <size_t I> const alternative<I>& get_unchecked() const { return *std::launder(reinterpret_cast<const alternative<I>*>(m_storage)); }
+
+		// Cases 0 to 10 are written explicitly (and skipped when there are fewer alternatives), the last alternative is the default case
+		template <class Self, class F> static visit_result_t<Self, F> visit_impl(Self&& self, F&& f)
+		{
+			constexpr size_t last = sizeof...(T) - 1;
+			#define GOLDFISH_TAGGED_UNION_CASE(i) \
+				case i: \
+					if constexpr (i < last) \
+						return f(details::forward_alternative<Self>(self.template get_unchecked<i>())); \
+					[[fallthrough]];
+			switch (self.m_index)
+			{
+				GOLDFISH_TAGGED_UNION_CASE(0)
+				GOLDFISH_TAGGED_UNION_CASE(1)
+				GOLDFISH_TAGGED_UNION_CASE(2)
+				GOLDFISH_TAGGED_UNION_CASE(3)
+				GOLDFISH_TAGGED_UNION_CASE(4)
+				GOLDFISH_TAGGED_UNION_CASE(5)
+				GOLDFISH_TAGGED_UNION_CASE(6)
+				GOLDFISH_TAGGED_UNION_CASE(7)
+				GOLDFISH_TAGGED_UNION_CASE(8)
+				GOLDFISH_TAGGED_UNION_CASE(9)
+				GOLDFISH_TAGGED_UNION_CASE(10)
+			default:
+				return f(details::forward_alternative<Self>(self.template get_unchecked<last>()));
+			}
+			#undef GOLDFISH_TAGGED_UNION_CASE
+		}
+
+		template <class Rhs> void construct_from(Rhs&& rhs)
+		{
+			if (is_trivial(m_index))
+			{
+				std::memcpy(m_storage, rhs.m_storage, sizeof(m_storage));
+				return;
+			}
+			visit_impl(std::forward<Rhs>(rhs), [&](auto&& x) { new (m_storage) std::decay_t<decltype(x)>(std::forward<decltype(x)>(x)); });
+		}
+		void destroy()
+		{
+			if (is_trivial(m_index))
+				return;
+			visit([](auto& x) { using U = std::decay_t<decltype(x)>; x.~U(); });
+		}
+		static bool is_trivial(uint8_t index)
+		{
+			constexpr uint16_t trivial_alternatives = [] {
+				uint16_t result = 0;
+				uint16_t bit = 1;
+				((result |= details::is_trivial_alternative<T> ? bit : 0, bit <<= 1), ...);
+				return result;
+			}();
+			return (trivial_alternatives >> index) & 1;
+		}
+
+		alignas(T...) byte m_storage[std::max({ sizeof(T)... })];
+		uint8_t m_index;
+	};
+}
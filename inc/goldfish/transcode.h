@@ -0,0 +1,546 @@
+#pragma once
+
+#include "buffered_stream.h"
+#include "cbor_reader.h"
+#include "cbor_writer.h"
+#include "counting_writer.h"
+#include "json_reader.h"
+#include "json_writer.h"
+#include "stream.h"
+#include "tags.h"
+#include <optional>
+#include <vector>
+
+namespace goldfish
+{
+	namespace json
+	{
+		namespace details
+		{
+			inline std::optional<uint32_t> parse_hex4(std::span<const byte> json, size_t i)
+			{
+				if (json.size() - i < 4)
+					return std::nullopt;
+
+				uint32_t value = 0;
+				for (auto c : json.subspan(i, 4))
+				{
+					if ('0' <= c && c <= '9') value = (value << 4) | (c - '0');
+					else if ('a' <= c && c <= 'f') value = (value << 4) | (c - 'a' + 10);
+					else if ('A' <= c && c <= 'F') value = (value << 4) | (c - 'A' + 10);
+					else return std::nullopt;
+				}
+				return value;
+			}
+
+			// Returns the length of the string starting at json[i] (the opening quote) once unescaped and converted to UTF8
+			// On return, i is the index of the closing quote
+			inline uint64_t scan_string_length(std::span<const byte> json, size_t& i)
+			{
+				uint64_t length = 0;
+				++i;
+				while (i < json.size() && json[i] != '"')
+				{
+					if (json[i] != '\\')
+					{
+						++length;
+						++i;
+					}
+					else if (i + 1 < json.size() && json[i + 1] == 'u')
+					{
+						auto codepoint = parse_hex4(json, i + 2);
+						i += 6;
+						if (!codepoint)
+							continue; // the JSON reader will report the error
+
+						if (0xD800 <= *codepoint && *codepoint <= 0xDBFF && i + 1 < json.size() && json[i] == '\\' && json[i + 1] == 'u')
+						{
+							auto low_surrogate = parse_hex4(json, i + 2);
+							if (low_surrogate && 0xDC00 <= *low_surrogate && *low_surrogate <= 0xDFFF)
+							{
+								length += 4;
+								i += 6;
+								continue;
+							}
+						}
+						length += *codepoint < 0x80 ? 1 : *codepoint < 0x800 ? 2 : 3;
+					}
+					else
+					{
+						++length;
+						i += 2;
+					}
+				}
+				return length;
+			}
+		}
+
+		// Scans an in memory JSON document and returns the number of elements of each array and map and the
+		// length of each string (in bytes, once unescaped), in the order they appear in the document
+		// The document is not validated: the sizes of an ill formatted document are meaningless, but the scan doesn't fail
+		inline std::vector<uint64_t> scan_sizes(std::span<const byte> json)
+		{
+			std::vector<uint64_t> sizes;
+			std::vector<size_t> open_containers; // indices in sizes of the arrays and maps not closed yet
+			bool container_empty = false; // true right after [ or {
+
+			for (size_t i = 0; i < json.size(); ++i)
+			{
+				auto c = json[i];
+				switch (c)
+				{
+				case ' ': case '\t': case '\r': case '\n':
+					continue;
+
+				case ']': case '}':
+					if (!open_containers.empty())
+						open_containers.pop_back();
+					container_empty = false;
+					continue;
+				}
+
+				if (container_empty)
+				{
+					sizes[open_containers.back()] = 1;
+					container_empty = false;
+				}
+
+				switch (c)
+				{
+				case '[': case '{':
+					open_containers.push_back(sizes.size());
+					sizes.push_back(0);
+					container_empty = true;
+					break;
+
+				case ',':
+					if (!open_containers.empty())
+						++sizes[open_containers.back()];
+					break;
+
+				case '"':
+					sizes.push_back(details::scan_string_length(json, i));
+					break;
+				}
+			}
+			return sizes;
+		}
+	}
+
+	namespace details
+	{
+		template <class Document, class Writer> auto write_with_sizes(Document&& d, Writer&& writer, std::span<const uint64_t>& sizes)
+		{
+			return d.visit([&](auto&& x) {
+				if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::string>)
+				{
+					auto output = writer.start_string(next_size(sizes));
+					stream::copy(x, output);
+					return output.flush();
+				}
+				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::array>)
+				{
+					auto array = writer.start_array(next_size(sizes));
+					while (auto element = x.read())
+						write_with_sizes(*element, array.append(), sizes);
+					return array.flush();
+				}
+				else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::map>)
+				{
+					auto map = writer.start_map(next_size(sizes));
+					while (auto key = x.read_key())
+					{
+						write_with_sizes(*key, map.append_key(), sizes);
+						write_with_sizes(x.read_value(), map.append_value(), sizes);
+					}
+					return map.flush();
+				}
+				else
+				{
+					return writer.write(x);
+				}
+			});
+		}
+	}
+
+	// Converts an in memory JSON document to CBOR using only definite length arrays, maps and strings
+	// The JSON document is scanned once to compute the sizes, then converted in a single pass over the output
+	template <class Stream, class error_handler> auto json_to_definite_cbor(std::span<const byte> json, Stream&& output, error_handler e)
+	{
+		auto sizes = json::scan_sizes(json);
+		std::span<const uint64_t> remaining_sizes = sizes;
+
+		stream::const_buffer_ref_reader input(json);
+		auto result = details::write_with_sizes(json::read(stream::ref(input), e), cbor::create_writer(std::forward<Stream>(output), e), remaining_sizes);
+		if (!remaining_sizes.empty())
+			throw size_table_mismatch{};
+		return result;
+	}
+	template <class Stream> auto json_to_definite_cbor(std::span<const byte> json, Stream&& output)
+	{
+		return json_to_definite_cbor(json, std::forward<Stream>(output), debug_checks::default_error_handler{});
+	}
+
+	namespace details
+	{
+		// The transcoders read and write through buffers of this size
+		template <class Reader> using transcoder_input = stream::buffered_reader<typical_buffer_length, stream::reader_ref_type_t<std::decay_t<Reader>>>;
+		template <class Writer> using transcoder_output = stream::buffered_writer<typical_buffer_length, stream::writer_ref_type_t<std::decay_t<Writer>>>;
+
+		// Transcode a JSON string to a CBOR text string, the opening quote has already been read
+		// Like the document writer, strings shorter than the buffer are written with a definite length, longer strings are written in chunks
+		template <class Input, class Output> void transcode_json_string(Input& input, Output& output)
+		{
+			byte buffer[typical_buffer_length];
+			size_t cb = 0;
+			bool chunked = false;
+			auto append = [&](const byte* data, size_t size)
+			{
+				while (size != 0)
+				{
+					auto to_copy = std::min(size, sizeof(buffer) - cb);
+					std::memcpy(buffer + cb, data, to_copy);
+					cb += to_copy;
+					data += to_copy;
+					size -= to_copy;
+					if (cb == sizeof(buffer))
+					{
+						if (!chunked)
+						{
+							stream::write(output, static_cast<byte>((3 << 5) | 31));
+							chunked = true;
+						}
+						cbor::details::write_integer<3>(output, cb);
+						output.write_buffer({ buffer, cb });
+						cb = 0;
+					}
+				}
+			};
+
+			for (;;)
+			{
+				// Copy up to the closing quote or the next escape sequence
+				auto data = input.peek_buffer();
+				if (data.empty())
+					throw stream::unexpected_end_of_stream{};
+				auto special = json::details::find_escape<true>(data.data(), data.data() + data.size());
+				append(data.data(), special - data.data());
+				stream::seek(input, special - data.data());
+				if (special == data.data() + data.size())
+					continue;
+
+				auto c = stream::read<byte>(input);
+				if (c == '"')
+					break;
+				if (c != '\\')
+					throw json::ill_formatted_json_data{ "Invalid character in JSON string" };
+
+				byte converted[4];
+				append(converted, json::details::read_escape_sequence(input, converted));
+			}
+
+			if (chunked)
+			{
+				if (cb != 0)
+				{
+					cbor::details::write_integer<3>(output, cb);
+					output.write_buffer({ buffer, cb });
+				}
+				stream::write(output, static_cast<byte>(0xFF));
+			}
+			else
+			{
+				cbor::details::write_integer<3>(output, cb);
+				output.write_buffer({ buffer, cb });
+			}
+		}
+
+		template <class Options, class Input, class Output> void transcode_json_to_cbor(Input& input, Output& output)
+		{
+			std::vector<char> closing_characters; // ']' or '}' for each array or map not closed yet
+			auto read_key = [&]
+			{
+				if (json::details::read_non_space(input) != '"')
+					throw json::ill_formatted_json_data{ "Only strings are supported for JSON keys" };
+				transcode_json_string(input, output);
+				if (json::details::read_non_space(input) != ':')
+					throw json::ill_formatted_json_data{ "':' expected between JSON key and value" };
+			};
+
+			for (;;)
+			{
+				auto c = json::details::read_non_space(input);
+				switch (c)
+				{
+				case '[':
+				case '{':
+					stream::write(output, static_cast<byte>(c == '[' ? (4 << 5) | 31 : (5 << 5) | 31));
+					closing_characters.push_back(c == '[' ? ']' : '}');
+					if (json::details::peek_non_space(input) != closing_characters.back())
+					{
+						if (c == '{')
+							read_key();
+						continue;
+					}
+					stream::read<char>(input);
+					stream::write(output, static_cast<byte>(0xFF));
+					closing_characters.pop_back();
+					break;
+				case '"':
+					transcode_json_string(input, output);
+					break;
+				case 't': json::details::throw_if_stream_isnt(input, { 'r', 'u', 'e' }); stream::write(output, static_cast<byte>((7 << 5) | 21)); break;
+				case 'f': json::details::throw_if_stream_isnt(input, { 'a', 'l', 's', 'e' }); stream::write(output, static_cast<byte>((7 << 5) | 20)); break;
+				case 'n': json::details::throw_if_stream_isnt(input, { 'u', 'l', 'l' }); stream::write(output, static_cast<byte>((7 << 5) | 22)); break;
+				case '-':
+				case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+					std::visit([&](auto x)
+					{
+						stream::write_direct<9>(output, [&](byte* buffer) { return cbor::details::encode_number<Options>(buffer, x); });
+					}, json::read_number(input, c));
+					break;
+				default:
+					throw json::ill_formatted_json_data{ "Invalid first character for JSON document" };
+				}
+
+				// The value is complete: close the arrays and maps that end after it, up to the next element
+				for (;;)
+				{
+					if (closing_characters.empty())
+						return;
+
+					auto delimiter = json::details::read_non_space(input);
+					if (delimiter == ',')
+					{
+						if (closing_characters.back() == '}')
+							read_key();
+						break;
+					}
+					if (delimiter != closing_characters.back())
+						throw json::ill_formatted_json_data{ "Invalid delimiter in JSON array or map" };
+					stream::write(output, static_cast<byte>(0xFF));
+					closing_characters.pop_back();
+				}
+			}
+		}
+
+		// Call f with the parts of a CBOR string (definite or indefinite length) whose first byte has already been read
+		// The parts are spans of the input buffer, they are consumed once f returns
+		template <byte major, class Input, class F> void for_each_cbor_string_part(Input& input, byte first_byte, F&& f)
+		{
+			auto read_definite = [&](uint64_t cb)
+			{
+				while (cb != 0)
+				{
+					auto data = input.peek_buffer();
+					if (data.empty())
+						throw stream::unexpected_end_of_stream{};
+					auto part = data.first(static_cast<size_t>(std::min<uint64_t>(cb, data.size())));
+					f(part);
+					stream::seek(input, part.size());
+					cb -= part.size();
+				}
+			};
+
+			if ((first_byte & 31) != 31)
+			{
+				read_definite(cbor::read_integer(static_cast<byte>(first_byte & 31), input));
+				return;
+			}
+			for (;;)
+			{
+				auto b = stream::read<byte>(input);
+				if (b == 0xFF)
+					return;
+				if ((b >> 5) != major)
+					throw cbor::ill_formatted_cbor_data{ "Unexpected type in CBOR string block" };
+				read_definite(cbor::read_integer(static_cast<byte>(b & 31), input));
+			}
+		}
+
+		// Keys of JSON maps are strings: like the JSON key writer, numbers and literals used as keys are written in quotes
+		template <class Format, class Output, class T> void write_json_number(Output& output, T x, bool quoted)
+		{
+			constexpr size_t max_length = largest<"-9223372036854775808"sv.size(), Format::max_length>::value + 2 /*quotes*/;
+			stream::write_direct<max_length>(output, [&](byte* buffer)
+			{
+				auto it = reinterpret_cast<char*>(buffer);
+				if (quoted)
+					*it++ = '"';
+				it = json::details::format_number<Format>(it, x);
+				if (quoted)
+					*it++ = '"';
+				return it - reinterpret_cast<char*>(buffer);
+			});
+		}
+		template <class Output> void write_json_literal(Output& output, std::string_view literal, bool quoted)
+		{
+			if (quoted)
+				stream::write(output, '"');
+			output.write_buffer({ reinterpret_cast<const byte*>(literal.data()), literal.size() });
+			if (quoted)
+				stream::write(output, '"');
+		}
+
+		template <class Options, class Input, class Output> void transcode_cbor_to_json(Input& input, Output& output)
+		{
+			using double_format = typename Options::double_format;
+			static constexpr uint64_t indefinite = std::numeric_limits<uint64_t>::max();
+			struct container
+			{
+				uint64_t remaining_items; // for maps, keys and values are counted separately
+				uint64_t items_read;
+				bool map;
+			};
+			std::vector<container> containers;
+
+			// Close the definite length arrays and maps that are complete, and return true once the document is complete
+			auto close_complete_containers = [&]
+			{
+				while (!containers.empty() && containers.back().remaining_items == 0)
+				{
+					stream::write(output, containers.back().map ? '}' : ']');
+					containers.pop_back();
+				}
+				return containers.empty();
+			};
+
+			for (;;)
+			{
+				bool key = false;
+				auto b = stream::read<byte>(input);
+				if (!containers.empty())
+				{
+					auto& top = containers.back();
+					if (b == 0xFF)
+					{
+						if (top.remaining_items != indefinite)
+							throw cbor::ill_formatted_cbor_data{ top.map ? "Unexpected break code found in finite length map" : "Unexpected break code found in finite length array" };
+						if (top.map && top.items_read % 2 == 1)
+							throw cbor::ill_formatted_cbor_data{ "Unexpected break code found as a map value" };
+						stream::write(output, top.map ? '}' : ']');
+						containers.pop_back();
+						if (close_complete_containers())
+							return;
+						continue;
+					}
+
+					if (top.items_read != 0)
+						stream::write(output, top.map && top.items_read % 2 == 1 ? ':' : ',');
+					key = top.map && top.items_read % 2 == 0;
+					++top.items_read;
+					if (top.remaining_items != indefinite)
+						--top.remaining_items;
+				}
+
+				// Tags are skipped
+				while ((b >> 5) == 6)
+				{
+					cbor::read_integer(static_cast<byte>(b & 31), input);
+					b = stream::read<byte>(input);
+				}
+
+				switch (b >> 5)
+				{
+				case 0:
+					write_json_number<double_format>(output, cbor::read_integer(static_cast<byte>(b & 31), input), key);
+					break;
+				case 1:
+				{
+					auto x = cbor::read_integer(static_cast<byte>(b & 31), input);
+					if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+						throw cbor::ill_formatted_cbor_data{ "CBOR signed integer too large" };
+					write_json_number<double_format>(output, -1 - static_cast<int64_t>(x), key);
+					break;
+				}
+				case 2:
+				{
+					stream::write(output, '"');
+					stream::base64_writer<stream::writer_ref_type_t<Output>> encoder{ stream::ref(output) };
+					for_each_cbor_string_part<2>(input, b, [&](std::span<const byte> part) { encoder.write_buffer(part); });
+					encoder.flush_no_inner_stream_flush();
+					stream::write(output, '"');
+					break;
+				}
+				case 3:
+					stream::write(output, '"');
+					for_each_cbor_string_part<3>(input, b, [&](std::span<const byte> part)
+					{
+						auto it = part.data();
+						auto end = it + part.size();
+						for (;;)
+						{
+							auto next = json::details::find_escape(it, end);
+							output.write_buffer({ it, next });
+							if (next == end)
+								break;
+							output.write_buffer(json::details::escape_sequence(*next));
+							it = next + 1;
+						}
+					});
+					stream::write(output, '"');
+					break;
+				case 4:
+				case 5:
+				{
+					if (key)
+						throw json::invalid_key_type{ (b >> 5) == 4 ? "An array cannot be a JSON key" : "A map cannot be a JSON key" };
+					bool map = (b >> 5) == 5;
+					uint64_t size = (b & 31) == 31 ? indefinite : cbor::read_integer(static_cast<byte>(b & 31), input);
+					if (size != indefinite && (size == indefinite - 1 || (map && size > indefinite / 2)))
+						throw cbor::ill_formatted_cbor_data{ map ? "CBOR map too large" : "CBOR array too large" };
+					stream::write(output, map ? '{' : '[');
+					containers.push_back({ map && size != indefinite ? size * 2 : size, 0, map });
+					break;
+				}
+				default:
+					switch (b)
+					{
+					case (7 << 5) | 20: write_json_literal(output, "false", key); break;
+					case (7 << 5) | 21: write_json_literal(output, "true", key); break;
+					case (7 << 5) | 22:
+					case (7 << 5) | 23: write_json_literal(output, "null", key); break;
+					case (7 << 5) | 25: write_json_number<double_format>(output, cbor::read_half_point_float(input), key); break;
+					case (7 << 5) | 26: write_json_number<double_format>(output, double{ cbor::to_float(from_big_endian(stream::read<uint32_t>(input))) }, key); break;
+					case (7 << 5) | 27: write_json_number<double_format>(output, cbor::to_double(from_big_endian(stream::read<uint64_t>(input))), key); break;
+					case 0xFF: throw cbor::ill_formatted_cbor_data{ "Unexpected break code in CBOR stream" };
+					default: throw cbor::ill_formatted_cbor_data{ "Unexpected CBOR opcode" };
+					}
+					break;
+				}
+
+				if (close_complete_containers())
+					return;
+			}
+		}
+	}
+
+	// Converts the JSON document read from input to CBOR and returns output.flush()
+	// The tokens are converted from one format to the other in a single loop, without the document layer:
+	// strings without escape sequences are copied with memcpy, and arrays and maps are nested without recursion
+	// The output is the same as cbor::create_writer<Options>(output).write(json::read(input)) (arrays, maps and long strings have
+	// an indefinite length), and ill formatted documents throw the same exceptions
+	// The input is read by blocks: bytes after the end of the document may be consumed
+	template <class Options = cbor::write_options, class Reader, class Writer> auto json_to_cbor(Reader&& input, Writer&& output)
+	{
+		details::transcoder_input<Reader> buffered_input(stream::ref(input));
+		details::transcoder_output<Writer> buffered_output(stream::ref(output));
+		details::transcode_json_to_cbor<Options>(buffered_input, buffered_output);
+		buffered_output.flush();
+		return output.flush();
+	}
+
+	// Converts the CBOR document read from input to JSON and returns output.flush()
+	// Like json_to_cbor, the conversion is done in a single loop, and text strings are copied as they are up to the characters that need escaping
+	// The output is the same as json::create_writer<Options>(output).write(cbor::read(input)): binary strings are written in base64,
+	// tags are skipped, undefined is written as null, and keys that are not strings are written in quotes
+	// The input is read by blocks: bytes after the end of the document may be consumed
+	template <class Options = json::write_options, class Reader, class Writer> auto cbor_to_json(Reader&& input, Writer&& output)
+	{
+		details::transcoder_input<Reader> buffered_input(stream::ref(input));
+		details::transcoder_output<Writer> buffered_output(stream::ref(output));
+		details::transcode_cbor_to_json<Options>(buffered_input, buffered_output);
+		buffered_output.flush();
+		return output.flush();
+	}
+}
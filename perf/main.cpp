@@ -3,12 +3,18 @@
 #include <chrono>
 #include <algorithm>
 
+#include <goldfish/buffered_stream.h>
 #include <goldfish/stream.h>
 #include <goldfish/file_stream.h>
 #include <goldfish/json_reader.h>
+#include <goldfish/json_reformat.h>
 #include <goldfish/json_writer.h>
 #include <goldfish/cbor_reader.h>
 #include <goldfish/cbor_writer.h>
+#include <goldfish/cursor.h>
+#include <goldfish/std_containers.h>
+#include <goldfish/struct_mapping.h>
+#include <goldfish/transcode.h>
 
 using namespace std;
 using namespace goldfish;
@@ -39,7 +45,7 @@ void measure(Lambda&& l, size_t document_size)
 
 template <class Document> int64_t sum_ints(Document&& t)
 {
-	return t.visit([&](auto&& x) {
+	return t.visit([&](auto&& x) -> int64_t {
 		if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::unsigned_int>) { return x; }
 		else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::signed_int>) { return x; }
 		else if constexpr (std::is_same_v<decltype(tags::get_tag(x)), tags::array>) {
@@ -63,6 +69,129 @@ template <class Document> int64_t sum_ints(Document&& t)
 	});
 }
 
+template <class Cursor> int64_t sum_ints_with_cursor(Cursor&& c)
+{
+	int64_t sum = 0;
+	for (;;)
+	{
+		auto t = c.next_token();
+		switch (t.type)
+		{
+		case token_type::unsigned_int: sum += t.unsigned_int; break;
+		case token_type::signed_int: sum += t.signed_int; break;
+		case token_type::end_of_document: return sum;
+		default: break;
+		}
+	}
+}
+
+// Object heavy serialization: many small objects using the same keys
+struct record
+{
+	uint64_t id;
+	std::string name;
+	int64_t balance;
+	bool active;
+	double score;
+};
+
+constexpr auto goldfish_fields(const record*)
+{
+	return fields(
+		field("id", &record::id),
+		field("name", &record::name),
+		field("balance", &record::balance),
+		field("active", &record::active),
+		field("score", &record::score));
+}
+
+static constexpr encoded_key id_key("id");
+static constexpr encoded_key name_key("name");
+static constexpr encoded_key balance_key("balance");
+static constexpr encoded_key active_key("active");
+static constexpr encoded_key score_key("score");
+
+template <class Writer> auto write_records(Writer&& writer, const vector<record>& records, bool use_encoded_keys)
+{
+	auto array = writer.start_array(records.size());
+	for (auto&& r : records)
+	{
+		auto map = array.start_map(5);
+		if (use_encoded_keys)
+		{
+			map.write(id_key, r.id);
+			map.write(name_key, r.name);
+			map.write(balance_key, r.balance);
+			map.write(active_key, r.active);
+			map.write(score_key, r.score);
+		}
+		else
+		{
+			map.write("id", r.id);
+			map.write("name", r.name);
+			map.write("balance", r.balance);
+			map.write("active", r.active);
+			map.write("score", r.score);
+		}
+		map.flush();
+	}
+	return array.flush();
+}
+
+static constexpr key_matcher record_keys{ "id", "name", "balance", "active", "score" };
+
+// Reads back the records written by write_records, matching the keys either by reading them in a string or with a key_matcher
+template <class Document> uint64_t read_records(Document&& d, bool use_key_matcher)
+{
+	uint64_t checksum = 0;
+	auto array = d.as_array();
+	while (auto element = array.read())
+	{
+		auto map = element->as_map();
+		for (;;)
+		{
+			size_t index;
+			if (use_key_matcher)
+			{
+				auto k = map.read_key_match(record_keys);
+				if (!k)
+					break;
+				index = *k;
+			}
+			else
+			{
+				auto key = map.read_key();
+				if (!key)
+					break;
+				index = record_keys.match(stream::read_all_as_string(key->as_string()));
+			}
+
+			auto value = map.read_value();
+			switch (index)
+			{
+			case 0: checksum += value.as_uint64(); break;
+			case 1: checksum += stream::read_all_as_string(value.as_string()).size(); break;
+			case 2: checksum += value.as_int64(); break;
+			case 3: checksum += value.as_bool(); break;
+			case 4: checksum += static_cast<uint64_t>(value.as_double()); break;
+			default: seek_to_end(value); break;
+			}
+		}
+	}
+	return checksum;
+}
+
+struct six_digits_write_options { using double_format = json::fixed_precision_doubles<6>; };
+struct float_write_options { using double_format = json::shortest_float_doubles; };
+
+template <class Writer> auto write_doubles(Writer&& writer, const vector<double>& doubles)
+{
+	auto array = writer.start_array(doubles.size());
+	for (auto&& d : doubles)
+		array.write(d);
+	return array.flush();
+}
+
 int main(int argc, char* argv[])
 {
 	if (argc != 2)
@@ -80,6 +209,12 @@ int main(int argc, char* argv[])
 		cbor::create_writer(stream::ref(output_stream)).write(document);
 		return output_stream.flush();
 	}();
+	auto definite_cbor_data = json_to_definite_cbor(json_data, stream::vector_writer{});
+
+	cout << "\nDOCUMENT SIZES\n";
+	cout << "JSON: " << json_data.size() << " bytes\n";
+	cout << "CBOR: " << cbor_data.size() << " bytes\n";
+	cout << "CBOR (definite lengths): " << definite_cbor_data.size() << " bytes\n";
 
 	cout << "\nSTREAMING MODE\n";
 
@@ -89,10 +224,353 @@ int main(int argc, char* argv[])
 		return sum_ints(cbor::read(stream::read_buffer_ref(cbor_data)));
 	}, cbor_data.size());
 
+	cout << "\nDeserialize CBOR with definite lengths in streaming mode\n";
+	measure([&]
+	{
+		return sum_ints(cbor::read(stream::read_buffer_ref(definite_cbor_data)));
+	}, definite_cbor_data.size());
+
 	cout << "\nDeserialize JSON in streaming mode\n";
 	measure([&]
 	{
 		return sum_ints(json::read(stream::read_buffer_ref(json_data)));
 	}, json_data.size());
-}
 
+	// Release builds use debug_checks::no_check, which doesn't wrap the readers at all: this measures what the checks cost
+	cout << "\nDeserialize CBOR in streaming mode with debug checks\n";
+	measure([&]
+	{
+		return sum_ints(cbor::read(stream::read_buffer_ref(cbor_data), debug_checks::terminate_on_error{}));
+	}, cbor_data.size());
+
+	cout << "\nDeserialize JSON in streaming mode with debug checks\n";
+	measure([&]
+	{
+		return sum_ints(json::read(stream::read_buffer_ref(json_data), debug_checks::terminate_on_error{}));
+	}, json_data.size());
+
+	cout << "\nDeserialize CBOR with a token cursor\n";
+	measure([&]
+	{
+		return sum_ints_with_cursor(cbor::create_cursor(stream::read_buffer_ref(cbor_data)));
+	}, cbor_data.size());
+
+	cout << "\nDeserialize JSON with a token cursor\n";
+	measure([&]
+	{
+		return sum_ints_with_cursor(json::create_cursor(stream::read_buffer_ref(json_data)));
+	}, json_data.size());
+
+	cout << "\nSkip JSON with seek_to_end\n";
+	measure([&]
+	{
+		seek_to_end(json::read(stream::read_buffer_ref(json_data)));
+	}, json_data.size());
+
+	cout << "\nSkip CBOR with seek_to_end\n";
+	measure([&]
+	{
+		seek_to_end(cbor::read(stream::read_buffer_ref(cbor_data)));
+	}, cbor_data.size());
+
+	cout << "\nCONVERSION\n";
+
+	cout << "\nConvert JSON to CBOR\n";
+	measure([&]
+	{
+		return cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_buffer_ref(json_data)));
+	}, json_data.size());
+
+	cout << "\nConvert JSON to CBOR (transcoder)\n";
+	measure([&]
+	{
+		return json_to_cbor(stream::read_buffer_ref(json_data), stream::vector_writer{});
+	}, json_data.size());
+
+	cout << "\nConvert CBOR to JSON\n";
+	measure([&]
+	{
+		return json::create_writer(stream::vector_writer{}).write(cbor::read(stream::read_buffer_ref(cbor_data)));
+	}, cbor_data.size());
+
+	cout << "\nConvert CBOR to JSON (transcoder)\n";
+	measure([&]
+	{
+		return cbor_to_json(stream::read_buffer_ref(cbor_data), stream::vector_writer{});
+	}, cbor_data.size());
+
+	cout << "\nConvert JSON to CBOR with definite lengths\n";
+	measure([&]
+	{
+		return json_to_definite_cbor(json_data, stream::vector_writer{});
+	}, json_data.size());
+
+	auto indented_json_data = json::indent(stream::read_buffer_ref(json_data), stream::vector_writer{});
+
+	cout << "\nConvert JSON to JSON (parse and write)\n";
+	measure([&]
+	{
+		return json::create_writer(stream::vector_writer{}).write(json::read(stream::read_buffer_ref(indented_json_data)));
+	}, indented_json_data.size());
+
+	cout << "\nMinify JSON\n";
+	measure([&]
+	{
+		return json::minify(stream::read_buffer_ref(indented_json_data), stream::vector_writer{});
+	}, indented_json_data.size());
+
+	cout << "\nIndent JSON\n";
+	measure([&]
+	{
+		return json::indent(stream::read_buffer_ref(json_data), stream::vector_writer{});
+	}, json_data.size());
+
+	cout << "\nSERIALIZATION\n";
+
+	vector<record> records;
+	for (uint64_t i = 0; i < 200000; ++i)
+		records.push_back({ i, "name " + to_string(i % 1000), static_cast<int64_t>(i * 7919 % 100000) - 50000, i % 3 == 0, i / 8.0 });
+
+	auto json_records = write_records(json::create_writer(stream::vector_writer{}), records, false);
+	auto cbor_records = write_records(cbor::create_writer(stream::vector_writer{}), records, false);
+
+	// A map of names to tuples with a vector of numbers, an optional and a vector of strings
+	map<string, tuple<vector<int64_t>, optional<double>, vector<string>>> containers;
+	for (uint64_t i = 0; i < 10000; ++i)
+		containers["key " + to_string(i)] = { vector<int64_t>(20, static_cast<int64_t>(i)), i % 2 ? optional<double>(i / 8.0) : nullopt, { "a", to_string(i) } };
+
+	cout << "\nSerialize objects to JSON\n";
+	measure([&]
+	{
+		return write_records(json::create_writer(stream::buffer<8192>(stream::vector_writer{})), records, false);
+	}, json_records.size());
+
+	cout << "\nSerialize objects to JSON with encoded keys\n";
+	measure([&]
+	{
+		return write_records(json::create_writer(stream::buffer<8192>(stream::vector_writer{})), records, true);
+	}, json_records.size());
+
+	cout << "\nSerialize objects to CBOR\n";
+	measure([&]
+	{
+		return write_records(cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})), records, false);
+	}, cbor_records.size());
+
+	cout << "\nSerialize objects to CBOR with debug checks\n";
+	measure([&]
+	{
+		return write_records(cbor::create_writer(stream::buffer<8192>(stream::vector_writer{}), debug_checks::terminate_on_error{}), records, false);
+	}, cbor_records.size());
+
+	cout << "\nSerialize objects to CBOR with encoded keys\n";
+	measure([&]
+	{
+		return write_records(cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})), records, true);
+	}, cbor_records.size());
+
+	cout << "\nDeserialize objects from JSON (keys read as strings)\n";
+	measure([&]
+	{
+		return read_records(json::read(stream::read_buffer_ref(json_records)), false);
+	}, json_records.size());
+
+	cout << "\nDeserialize objects from JSON with a key matcher\n";
+	measure([&]
+	{
+		return read_records(json::read(stream::read_buffer_ref(json_records)), true);
+	}, json_records.size());
+
+	cout << "\nDeserialize objects from JSON with a key matcher (strict policy)\n";
+	measure([&]
+	{
+		return read_records(json::read<json::strict>(stream::read_buffer_ref(json_records)), true);
+	}, json_records.size());
+
+	cout << "\nDeserialize objects from JSON with a struct mapping\n";
+	measure([&]
+	{
+		return deserialize<vector<record>>(json::read(stream::read_buffer_ref(json_records)));
+	}, json_records.size());
+
+	cout << "\nDeserialize objects from CBOR (keys read as strings)\n";
+	measure([&]
+	{
+		return read_records(cbor::read(stream::read_buffer_ref(cbor_records)), false);
+	}, cbor_records.size());
+
+	cout << "\nDeserialize objects from CBOR with a key matcher\n";
+	measure([&]
+	{
+		return read_records(cbor::read(stream::read_buffer_ref(cbor_records)), true);
+	}, cbor_records.size());
+
+	cout << "\nDeserialize objects from CBOR with a struct mapping\n";
+	measure([&]
+	{
+		return deserialize<vector<record>>(cbor::read(stream::read_buffer_ref(cbor_records)));
+	}, cbor_records.size());
+
+	cout << "\nSerialize objects to CBOR with a struct mapping\n";
+	measure([&]
+	{
+		return cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})).write(records);
+	}, cbor_records.size());
+
+	cout << "\nDeserialize std containers from CBOR\n";
+	auto cbor_containers = cbor::create_writer(stream::vector_writer{}).write(containers);
+	measure([&]
+	{
+		return deserialize<decltype(containers)>(cbor::read(stream::read_buffer_ref(cbor_containers)));
+	}, cbor_containers.size());
+
+	cout << "\nSerialize std containers to CBOR\n";
+	measure([&]
+	{
+		return cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})).write(containers);
+	}, cbor_containers.size());
+
+	// Numbers in strings, as found in some third party feeds, where 1 in 20 is malformed
+	auto dirty_numbers = [&]
+	{
+		auto writer = json::create_writer(stream::vector_writer{}).start_array();
+		for (uint64_t i = 0; i < 200000; ++i)
+			writer.write(to_string(i * 7919 % 100000) + (i % 20 == 0 ? "x" : ""));
+		return writer.flush();
+	}();
+
+	cout << "\nConvert numbers in strings with 5% malformed (as_int64 and exceptions)\n";
+	measure([&]
+	{
+		int64_t sum = 0;
+		auto array = json::read(stream::read_buffer_ref(dirty_numbers)).as_array();
+		while (auto x = array.read())
+		{
+			try
+			{
+				sum += x->as_int64();
+			}
+			catch (const bad_variant_access&)
+			{
+			}
+		}
+		return sum;
+	}, dirty_numbers.size());
+
+	cout << "\nConvert numbers in strings with 5% malformed (try_as_int64)\n";
+	measure([&]
+	{
+		int64_t sum = 0;
+		auto array = json::read(stream::read_buffer_ref(dirty_numbers)).as_array();
+		while (auto x = array.read())
+			sum += x->try_as_int64().value_or(0);
+		return sum;
+	}, dirty_numbers.size());
+
+	// Positive integers are decoded as uint64_t, so as_int64 and as_double always go through a conversion
+	auto json_integers = write_doubles(json::create_writer(stream::vector_writer{}), [&]
+	{
+		vector<double> result;
+		for (uint64_t i = 0; i < 1000000; ++i)
+			result.push_back(static_cast<double>(i * 2654435761u % 1000003));
+		return result;
+	}());
+	auto sum_with_accessors = [](auto&& document)
+	{
+		double sum = 0;
+		auto array = document.as_array();
+		while (auto x = array.read())
+			sum += x->as_double();
+		return sum;
+	};
+
+	cout << "\nRead integers one at a time with as_double\n";
+	measure([&]
+	{
+		return sum_with_accessors(json::read(stream::read_buffer_ref(json_integers)));
+	}, json_integers.size());
+
+	cout << "\nRead integers one at a time with as_double (strict policy)\n";
+	measure([&]
+	{
+		return sum_with_accessors(json::read<json::strict>(stream::read_buffer_ref(json_integers)));
+	}, json_integers.size());
+
+	vector<double> doubles;
+	for (uint64_t i = 0; i < 1000000; ++i)
+		doubles.push_back(static_cast<float>((i * 2654435761u % 1000003) / 7.0));
+
+	cout << "\nSerialize doubles to JSON (shortest)\n";
+	measure([&]
+	{
+		return write_doubles(json::create_writer(stream::buffer<8192>(stream::vector_writer{})), doubles);
+	}, write_doubles(json::create_writer(stream::vector_writer{}), doubles).size());
+
+	cout << "\nSerialize doubles to JSON (6 significant digits)\n";
+	measure([&]
+	{
+		return write_doubles(json::create_writer<six_digits_write_options>(stream::buffer<8192>(stream::vector_writer{})), doubles);
+	}, write_doubles(json::create_writer<six_digits_write_options>(stream::vector_writer{}), doubles).size());
+
+	cout << "\nSerialize doubles to JSON (shortest float)\n";
+	measure([&]
+	{
+		return write_doubles(json::create_writer<float_write_options>(stream::buffer<8192>(stream::vector_writer{})), doubles);
+	}, write_doubles(json::create_writer<float_write_options>(stream::vector_writer{}), doubles).size());
+
+	cout << "\nSerialize doubles to JSON with write_array\n";
+	measure([&]
+	{
+		return json::create_writer(stream::buffer<8192>(stream::vector_writer{})).write_array(std::span(doubles));
+	}, write_doubles(json::create_writer(stream::vector_writer{}), doubles).size());
+
+	cout << "\nSerialize doubles to CBOR\n";
+	measure([&]
+	{
+		return write_doubles(cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})), doubles);
+	}, write_doubles(cbor::create_writer(stream::vector_writer{}), doubles).size());
+
+	cout << "\nSerialize doubles to CBOR with write_array\n";
+	measure([&]
+	{
+		return cbor::create_writer(stream::buffer<8192>(stream::vector_writer{})).write_array(std::span(doubles));
+	}, write_doubles(cbor::create_writer(stream::vector_writer{}), doubles).size());
+
+	// Documents nested 50000 levels deep: arrays and maps are kept in an explicit stack, so these don't overflow the stack
+	cout << "\nDEEP DOCUMENTS\n";
+	auto deep_json = [&]
+	{
+		string result;
+		for (int i = 0; i < 50000; ++i)
+			result += "{\"a\":[1,";
+		result += "null";
+		for (int i = 0; i < 50000; ++i)
+			result += "]}";
+		return vector<goldfish::byte>(result.begin(), result.end());
+	}();
+	auto deep_cbor = json_to_cbor(stream::read_buffer_ref(deep_json), stream::vector_writer{});
+
+	cout << "\nSkip deep JSON with seek_to_end\n";
+	measure([&]
+	{
+		seek_to_end(json::read(stream::read_buffer_ref(deep_json)));
+	}, deep_json.size());
+
+	cout << "\nSkip deep CBOR with seek_to_end\n";
+	measure([&]
+	{
+		seek_to_end(cbor::read(stream::read_buffer_ref(deep_cbor)));
+	}, deep_cbor.size());
+
+	cout << "\nConvert deep JSON to CBOR\n";
+	measure([&]
+	{
+		return cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_buffer_ref(deep_json)));
+	}, deep_json.size());
+
+	cout << "\nConvert deep CBOR to JSON\n";
+	measure([&]
+	{
+		return json::create_writer(stream::vector_writer{}).write(cbor::read(stream::read_buffer_ref(deep_cbor)));
+	}, deep_cbor.size());
+}
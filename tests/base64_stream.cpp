@@ -38,6 +38,38 @@ namespace goldfish { namespace stream
 	TEST_CASE(base64_decode_wrong_padding_size_3) { expect_exception<ill_formatted_base64_data>([] { my_base64_decode("===="); }); }
 	TEST_CASE(base64_padding_in_middle) { expect_exception<ill_formatted_base64_data>([] { my_base64_decode("cw==cw=="); }); }
 
+	TEST_CASE(base64_large_round_trip)
+	{
+		// Sizes around the block sizes of the SIMD and scalar code paths, and larger than the internal buffers
+		for (size_t size : { 11, 12, 13, 23, 24, 25, 29, 30, 31, 47, 48, 49, 1000, 6143, 6144, 6145, 100000 })
+		{
+			std::string data;
+			for (size_t i = 0; i < size; ++i)
+				data.push_back(static_cast<char>(i * 7919 % 251));
+
+			auto encoded = my_base64_encode(data);
+			test(encoded.size() == (size + 2) / 3 * 4);
+			test(encoded.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=") == std::string::npos);
+			test(encoded.substr(0, 20) == my_base64_encode(data.substr(0, 15)));
+			test(my_base64_decode(encoded) == data);
+
+			auto unpadded = encoded.substr(0, encoded.find('='));
+			test(my_base64_decode(unpadded) == data);
+
+			// An invalid character or padding anywhere but at the end is detected, whatever the block it's in
+			for (auto position : { size_t(0), unpadded.size() / 2, unpadded.size() - 5 })
+			{
+				for (auto c : { '*', '=', '\x80' })
+				{
+					auto invalid = encoded;
+					invalid[position] = c;
+					expect_exception<ill_formatted_base64_data>([&] { my_base64_decode(invalid); });
+				}
+			}
+			expect_exception<ill_formatted_base64_data>([&] { my_base64_decode(encoded + "===="); });
+		}
+	}
+
 	TEST_CASE(decode_partial_buffer)
 	{
 		auto s = decode_base64(read_string("YW55IGNhcm5hbCBwbGVhc3VyZS4"));
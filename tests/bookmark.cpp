@@ -0,0 +1,181 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/json_reader.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	namespace
+	{
+		struct bookmark_misused {};
+		struct throw_on_bookmark_misuse
+		{
+			static void on_error() { throw bookmark_misused{}; }
+		};
+	}
+
+	// Reads the "type" field of the map first, then rewinds and describes all the other fields
+	template <class Map> std::string describe_by_type(Map&& map)
+	{
+		auto start = map.bookmark();
+		std::string type;
+		while (auto key = map.read_key())
+		{
+			if (stream::read_all_as_string(key->as_string()) == "type")
+				type = stream::read_all_as_string(map.read_value().as_string());
+			else
+				seek_to_end(map.read_value());
+		}
+
+		map.rewind(start);
+		std::string result = type + ":";
+		while (auto key = map.read_key())
+		{
+			auto name = stream::read_all_as_string(key->as_string());
+			auto value = map.read_value();
+			if (name == "type")
+				seek_to_end(value);
+			else
+				result += name + "=" + std::to_string(value.as_int64()) + " ";
+		}
+		return result;
+	}
+
+	TEST_CASE(stream_bookmark)
+	{
+		std::string data = "abcdef";
+		stream::const_buffer_ref_reader s({ reinterpret_cast<const byte*>(data.data()), data.size() });
+		test(stream::read<char>(s) == 'a');
+		auto b = s.bookmark();
+		test(stream::read<char>(s) == 'b');
+		test(stream::seek(s, 3) == 3);
+		s.rewind(b);
+		test(stream::read<char>(s) == 'b');
+
+		// Bookmarks stay valid when the stream is moved
+		auto owned = stream::read_string(std::string("abcdef"));
+		stream::read<char>(owned);
+		auto owned_bookmark = owned.bookmark();
+		stream::read<char>(owned);
+		auto moved = std::move(owned);
+		moved.rewind(owned_bookmark);
+		test(stream::read_all_as_string(moved) == "bcdef");
+
+		static_assert(stream::has_bookmark<stream::ref_reader<stream::const_buffer_ref_reader>>::value);
+		static_assert(!stream::has_bookmark<stream::buffered_reader<4, stream::const_buffer_ref_reader>>::value);
+	}
+
+	TEST_CASE(json_bookmark)
+	{
+		auto array = json::read(stream::read_string_ref("[1, 2, [3], 4]")).as_array();
+		auto start = array.bookmark();
+		test(array.read()->as_uint64() == 1);
+		auto second = array.bookmark();
+		uint64_t sum = 0;
+		while (auto x = array.read())
+		{
+			if (x->is_exactly<tags::array>())
+				seek_to_end(*x);
+			else
+				sum += x->as_uint64();
+		}
+		test(sum == 6);
+
+		// Rewind after the end of the array, and in the middle of it
+		array.rewind(second);
+		test(array.read()->as_uint64() == 2);
+		array.rewind(start);
+		test(array.read()->as_uint64() == 1);
+		test(array.read()->as_uint64() == 2);
+		test(array.read()->as_array().read()->as_uint64() == 3);
+
+		test(describe_by_type(json::read(stream::read_string_ref(R"({"x":1,"y":-2,"type":"point"})")).as_map()) == "point:x=1 y=-2 ");
+		test(describe_by_type(json::read(stream::read_string_ref("{}")).as_map()) == ":");
+
+		// The empty state is restored too
+		auto empty = json::read(stream::read_string_ref("[]")).as_array();
+		auto empty_start = empty.bookmark();
+		test(empty.read() == std::nullopt);
+		empty.rewind(empty_start);
+		test(empty.read() == std::nullopt);
+	}
+
+	TEST_CASE(cbor_bookmark)
+	{
+		for (auto data : {
+			std::vector<byte>{ 0xa3, 0x61, 'x', 0x01, 0x61, 'y', 0x21, 0x64, 't', 'y', 'p', 'e', 0x65, 'p', 'o', 'i', 'n', 't' },
+			std::vector<byte>{ 0xbf, 0x61, 'x', 0x01, 0x61, 'y', 0x21, 0x64, 't', 'y', 'p', 'e', 0x65, 'p', 'o', 'i', 'n', 't', 0xff },
+		})
+		{
+			test(describe_by_type(cbor::read(stream::read_buffer_ref(data)).as_map()) == "point:x=1 y=-2 ");
+		}
+
+		// Definite length arrays get their remaining length back, indefinite ones stay indefinite
+		std::vector<byte> definite{ 0x83, 1, 2, 3 };
+		auto array = cbor::read(stream::read_buffer_ref(definite)).as_array();
+		array.read();
+		auto b = array.bookmark();
+		test(array.read()->as_uint64() == 2);
+		test(array.read()->as_uint64() == 3);
+		test(array.read() == std::nullopt);
+		array.rewind(b);
+		test(array.remaining_length() == 2u);
+		std::vector<uint32_t> rest;
+		array.read_all_into(rest);
+		test(rest == std::vector<uint32_t>{ 2, 3 });
+
+		std::vector<byte> indefinite{ 0x9f, 1, 2, 0xff };
+		auto indefinite_array = cbor::read(stream::read_buffer_ref(indefinite)).as_array();
+		auto start = indefinite_array.bookmark();
+		while (indefinite_array.read()) {}
+		indefinite_array.rewind(start);
+		test(indefinite_array.remaining_length() == std::nullopt);
+		test(indefinite_array.read()->as_uint64() == 1);
+	}
+
+	TEST_CASE(bookmark_debug_checks)
+	{
+		// A child must be finished before its parent is rewound
+		expect_exception<bookmark_misused>([]
+		{
+			auto array = json::read(stream::read_string_ref("[[1, 2]]"), throw_on_bookmark_misuse{}).as_array();
+			auto b = array.bookmark();
+			auto inner = array.read()->as_array();
+			inner.read();
+			array.rewind(b);
+		});
+
+		// Arrays and maps can't be bookmarked while one of their elements is being read
+		expect_exception<bookmark_misused>([]
+		{
+			auto array = json::read(stream::read_string_ref("[[1, 2], 3]"), throw_on_bookmark_misuse{}).as_array();
+			auto inner = array.read()->as_array();
+			inner.read();
+			array.bookmark();
+		});
+		expect_exception<bookmark_misused>([]
+		{
+			auto map = json::read(stream::read_string_ref(R"({"a":[1, 2]})"), throw_on_bookmark_misuse{}).as_map();
+			map.read_key();
+			auto value = map.read_value().as_array();
+			value.read();
+			map.bookmark();
+		});
+
+		// Maps can't be bookmarked between a key and its value
+		expect_exception<bookmark_misused>([]
+		{
+			auto map = json::read(stream::read_string_ref(R"({"a":1})"), throw_on_bookmark_misuse{}).as_map();
+			map.read_key();
+			map.bookmark();
+		});
+
+		// Rewinding a map between a key and its value is fine, and the map is read again from the bookmark
+		auto map = json::read(stream::read_string_ref(R"({"a":1})"), throw_on_bookmark_misuse{}).as_map();
+		auto b = map.bookmark();
+		test(stream::read_all_as_string(map.read_key()->as_string()) == "a");
+		map.rewind(b);
+		test(stream::read_all_as_string(map.read_key()->as_string()) == "a");
+		test(map.read_value().as_uint64() == 1);
+		test(map.read_key() == std::nullopt);
+	}
+}
@@ -80,6 +80,21 @@ namespace goldfish { namespace stream
 		test(stream::seek(s, 5) == 4);
 		test(stream::seek(s, 1) == 0);
 	}
+	TEST_CASE(test_buffered_reader_peek_buffer)
+	{
+		auto as_string = [](std::span<const byte> x) { return std::string(reinterpret_cast<const char*>(x.data()), x.size()); };
+		auto s = buffer<3>(read_string("abcdefg"));
+		test(as_string(s.peek_buffer()) == "abc");
+		test(as_string(s.peek_buffer()) == "abc");
+		test(stream::seek(s, 2) == 2);
+		test(as_string(s.peek_buffer()) == "c");
+		test(stream::read<char>(s) == 'c');
+		test(as_string(s.peek_buffer()) == "def");
+		test(stream::seek(s, 3) == 3);
+		test(as_string(s.peek_buffer()) == "g");
+		test(stream::seek(s, 1) == 1);
+		test(s.peek_buffer().empty());
+	}
 	TEST_CASE(test_move_buffered_reader)
 	{
 		auto s = buffer<3>(read_string("abcdef"));
@@ -101,4 +116,120 @@ namespace goldfish { namespace stream
 
 		test(x.data() == std::vector<byte>{1, 2});
 	}
+	static_assert(has_reserve<buffered_writer<4, vector_writer>>::value, "buffered_writer supports reserve");
+	static_assert(has_reserve<ref_writer<buffered_writer<4, vector_writer>>>::value, "ref_writer forwards reserve");
+	TEST_CASE(test_buffered_writer_reserve)
+	{
+		vector_writer x;
+		auto stream = buffer<4>(ref(x));
+		stream.write<byte>(1);
+		auto buffer = stream.reserve(2);
+		buffer[0] = 2;
+		buffer[1] = 3;
+		stream.commit(2);
+		test(x.data().empty());
+
+		// Not enough space left: the buffer is sent to the inner stream first
+		buffer = stream.reserve(3);
+		test(x.data() == std::vector<byte>{1, 2, 3});
+		buffer[0] = 4;
+		stream.commit(1);
+
+		// Can't reserve more than the size of the buffer
+		test(stream.reserve(5) == nullptr);
+		write_direct<5>(stream, [&](byte* buffer)
+		{
+			std::fill(buffer, buffer + 5, byte(5));
+			return 5;
+		});
+		stream.flush();
+
+		test(x.data() == std::vector<byte>{1, 2, 3, 4, 5, 5, 5, 5, 5});
+	}
+	static_assert(has_mark<buffered_writer<4, vector_writer>>::value, "buffered_writer supports marks when the inner stream does");
+	TEST_CASE(test_buffered_writer_rollback)
+	{
+		vector_writer x;
+		auto stream = buffer<2>(ref(x));
+		stream.write<byte>(1);
+
+		// The mark is still in the buffer
+		auto m = stream.mark();
+		stream.write<byte>(2);
+		stream.rollback(m);
+		test(x.data().empty());
+
+		// The data written after the mark has been sent to the inner stream
+		stream.write<byte>(3);
+		stream.write<byte>(4);
+		stream.write<byte>(5);
+		test(x.data() == std::vector<byte>{1, 3});
+		stream.rollback(m);
+		test(x.data() == std::vector<byte>{1});
+
+		stream.write<byte>(6);
+		m = stream.mark();
+		stream.write<byte>(7);
+		stream.commit(m);
+		stream.flush();
+		test(x.data() == std::vector<byte>{1, 6, 7});
+	}
+	TEST_CASE(test_buffered_writer_flush_at_end_of_record)
+	{
+		vector_writer x;
+		auto stream = buffer<4>(ref(x), flush_at_end_of_record{});
+		stream.write<byte>(1);
+		stream.write<byte>(2);
+		test(x.data().empty());
+		stream.end_of_record();
+		test(x.data() == std::vector<byte>{1, 2});
+
+		// Nothing is sent when the buffer is empty
+		stream.end_of_record();
+		test(x.data() == std::vector<byte>{1, 2});
+
+		// The default policy only sends full buffers
+		vector_writer y;
+		auto batched = buffer<4>(ref(y));
+		batched.write<byte>(1);
+		end_of_record(batched);
+		test(y.data().empty());
+	}
+	struct test_clock
+	{
+		using duration = std::chrono::milliseconds;
+		using rep = duration::rep;
+		using period = duration::period;
+		using time_point = std::chrono::time_point<test_clock>;
+		static constexpr bool is_steady = true;
+		static time_point now() { return current_time; }
+		static inline time_point current_time;
+	};
+	TEST_CASE(test_buffered_writer_latency_bounded)
+	{
+		using namespace std::chrono_literals;
+		vector_writer x;
+		auto stream = buffer<16>(ref(x), latency_bounded<test_clock>(10ms));
+
+		// The age of the data is counted from the first record boundary
+		stream.write<byte>(1);
+		stream.end_of_record();
+		test_clock::current_time += 5ms;
+		stream.write<byte>(2);
+		stream.end_of_record();
+		test(x.data().empty());
+
+		test_clock::current_time += 5ms;
+		stream.write<byte>(3);
+		stream.end_of_record();
+		test(x.data() == std::vector<byte>{1, 2, 3});
+
+		// poll sends old data even if no record ends
+		stream.write<byte>(4);
+		stream.poll();
+		test_clock::current_time += 10ms;
+		test(x.data() == std::vector<byte>{1, 2, 3});
+		stream.poll();
+		test(x.data() == std::vector<byte>{1, 2, 3, 4});
+	}
 }}
\ No newline at end of file
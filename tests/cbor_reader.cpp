@@ -195,4 +195,43 @@ namespace goldfish { namespace dom
 		stream::const_buffer_ref_reader s(binary);
 		test(stream::seek(cbor::read(stream::ref(s)).as_string(), 10) == 9);
 	}
+
+	TEST_CASE(read_array_into)
+	{
+		auto read_all = [](std::string input, auto& result)
+		{
+			auto binary = to_vector(input);
+			stream::const_buffer_ref_reader s(binary);
+			cbor::read(stream::ref(s)).as_array().read_all_into(result);
+			test(stream::seek(s, 1) == 0);
+		};
+
+		std::vector<int64_t> ints;
+		read_all("8501381818641a000f42403b7fffffffffffffff", ints); // [1, -25, 100, 1000000, -9223372036854775808]
+		test(ints == std::vector<int64_t>{ 1, -25, 100, 1000000, std::numeric_limits<int64_t>::min() });
+
+		ints.clear();
+		read_all("9f0102c1186420ff", ints); // [_ 1, 2, 1(100), -1]
+		test(ints == std::vector<int64_t>{ 1, 2, 100, -1 });
+
+		std::vector<double> doubles;
+		read_all("84f93e00fa47c35000fb3ff199999999999a01", doubles); // [1.5, 100000.0, 1.1, 1]
+		test(doubles == std::vector<double>{ 1.5, 100000.0, 1.1, 1 });
+
+		{
+			auto binary = to_vector("83010203");
+			stream::const_buffer_ref_reader s(binary);
+			auto array = cbor::read(stream::ref(s)).as_array();
+			uint16_t buffer[2];
+			test(array.read_into(std::span<uint16_t>(buffer)) == 2);
+			test(buffer[0] == 1 && buffer[1] == 2);
+			test(array.read_into(std::span<uint16_t>(buffer)) == 1);
+			test(buffer[0] == 3);
+		}
+
+		std::vector<uint64_t> unsigned_ints;
+		expect_exception<integer_overflow_while_casting>([&] { read_all("8120", unsigned_ints); });
+		expect_exception<std::bad_variant_access>([&] { read_all("8201f5", unsigned_ints); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { read_all("8201ff", unsigned_ints); });
+	}
 }}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/cbor_string_references.h>
+#include <goldfish/cbor_writer.h>
+#include "dom.h"
+#include "unit_test.h"
+
+namespace goldfish { namespace dom
+{
+	static uint8_t to_hex(char c)
+	{
+		if ('0' <= c && c <= '9') return c - '0';
+		else if ('a' <= c && c <= 'f') return c - 'a' + 10;
+		else if ('A' <= c && c <= 'F') return c - 'A' + 10;
+		else std::terminate();
+	};
+	static auto to_vector(const std::string& input)
+	{
+		std::vector<byte> data;
+		for (auto it = input.begin(); it != input.end(); it += 2)
+		{
+			uint8_t high = to_hex(*it);
+			uint8_t low = to_hex(*next(it));
+			data.push_back((high << 4) | low);
+		}
+		return data;
+	}
+	static std::string to_hex_string(const std::vector<byte>& data)
+	{
+		std::string result;
+		for (auto&& x : data)
+		{
+			result += "0123456789abcdef"[x >> 4];
+			result += "0123456789abcdef"[x & 0b1111];
+		}
+		return result;
+	}
+	static auto w() { return cbor::create_writer(cbor::with_string_references(stream::vector_writer{})); }
+	static document r(const std::vector<byte>& binary)
+	{
+		stream::const_buffer_ref_reader s(binary);
+		auto result = load_in_memory(cbor::read(cbor::with_string_references(stream::ref(s))));
+		test(seek(s, 1) == 0);
+		return result;
+	}
+
+	TEST_CASE(write_string_references)
+	{
+		auto records = w().start_array(2);
+		for (uint64_t i = 1; i <= 2; ++i)
+		{
+			auto record = records.start_map(2);
+			record.write("name", i == 1 ? "a" : "b");
+			record.write("value", i);
+			record.flush();
+		}
+		test(to_hex_string(records.flush()) ==
+			"d90100" "82"
+			"a2" "646e616d65" "6161" "6576616c7565" "01"
+			"a2" "d81900" "6162" "d81901" "02");
+
+		// Strings that are too long to be deduplicated still take an index
+		std::string long_string(100, 'x');
+		std::string long_string_hex;
+		for (int i = 0; i < 100; ++i)
+			long_string_hex += "78";
+		auto strings = w().start_array(4);
+		strings.write(long_string);
+		strings.write(long_string);
+		strings.write("abc");
+		strings.write("abc");
+		test(to_hex_string(strings.flush()) == "d90100" "84" "7864" + long_string_hex + "7864" + long_string_hex + "63616263" "d81902");
+
+		// Text and binary strings with the same content are different strings
+		std::vector<byte> binary{ 'a', 'b', 'c' };
+		auto mixed = w().start_array(3);
+		mixed.write("abc");
+		mixed.write(std::span<const byte>(binary));
+		mixed.write(std::span<const byte>(binary));
+		test(to_hex_string(mixed.flush()) == "d90100" "83" "63616263" "43616263" "d81901");
+	}
+
+	TEST_CASE(read_string_references)
+	{
+		test(r(to_vector("d90100" "83" "63616263" "43616263" "d81901")) == array{ "abc", std::vector<byte>{ 'a', 'b', 'c' }, std::vector<byte>{ 'a', 'b', 'c' } });
+
+		// Short strings are not in the table, so the indices skip them
+		test(r(to_vector("d90100" "84" "6161" "63616263" "d81900" "d81900")) == array{ "a", "abc", "abc", "abc" });
+
+		// References outside of a namespace, or to strings not in the table, are invalid
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r(to_vector("82" "63616263" "d81900")); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r(to_vector("d90100" "82" "63616263" "d81901")); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r(to_vector("d90100" "82" "63616263" "d8196161")); });
+
+		// Nested namespaces would need the enclosing table to be restored at the end of the tagged document, they are rejected
+		// (the reference after the nested namespace refers to "abc" in the enclosing one)
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r(to_vector("d90100" "83" "63616263" "d90100" "81" "63787978" "d81900")); });
+
+		// A namespace can be started in a document that is not in a namespace
+		test(r(to_vector("82" "6161" "d90100" "82" "63616263" "d81900")) == array{ "a", array{ "abc", "abc" } });
+
+		// Each top level document can start its own namespace
+		auto sequence = to_vector("d90100" "82" "63616263" "d81900" "d90100" "82" "63787978" "d81900");
+		stream::const_buffer_ref_reader sequence_stream(sequence);
+		auto references = cbor::with_string_references(stream::ref(sequence_stream));
+		test(load_in_memory(cbor::read(stream::ref(references))) == array{ "abc", "abc" });
+		test(load_in_memory(cbor::read(stream::ref(references))) == array{ "xyx", "xyx" });
+		test(seek(sequence_stream, 1) == 0);
+
+		// Without with_string_references, the tags are ignored
+		auto binary = to_vector("d90100" "82" "63616263" "d81900");
+		stream::const_buffer_ref_reader s(binary);
+		test(load_in_memory(cbor::read(stream::ref(s))) == array{ "abc", 0ull });
+	}
+
+	TEST_CASE(string_references_round_trip)
+	{
+		// More than 24 strings of 3 characters: only the first 24 can be referenced
+		std::vector<std::string> strings;
+		for (int i = 0; i < 30; ++i)
+			strings.push_back(std::string{ 'k', static_cast<char>('0' + i / 10), static_cast<char>('0' + i % 10) });
+		for (int i = 0; i < 30; ++i)
+			strings.push_back(strings[i]);
+		strings.push_back(std::string(1000, 'x'));
+		strings.push_back(std::string(1000, 'x'));
+
+		auto write_records = [&](auto writer)
+		{
+			auto records = writer.start_array(100);
+			for (uint64_t i = 0; i < 100; ++i)
+			{
+				auto record = records.start_map(3);
+				record.write("identifier", i);
+				record.write("description", "some text");
+				auto list = record.start_array("list", strings.size());
+				for (auto&& x : strings)
+					list.write(x);
+				list.flush();
+				record.flush();
+			}
+			return records.flush();
+		};
+		auto data = write_records(w());
+
+		array expected_strings(strings.begin(), strings.end());
+		array expected;
+		for (uint64_t i = 0; i < 100; ++i)
+			expected.push_back(map{ { "identifier", i }, { "description", "some text" }, { "list", expected_strings } });
+		test(r(data) == expected);
+		test(data.size() < write_records(cbor::create_writer(stream::vector_writer{})).size());
+	}
+}}
@@ -1,6 +1,8 @@
 #include "dom.h"
+#include <goldfish/cbor_reader.h>
 #include <goldfish/cbor_writer.h>
 #include <goldfish/stream.h>
+#include <bit>
 #include "unit_test.h"
 
 namespace goldfish { namespace dom
@@ -108,6 +110,99 @@ namespace goldfish { namespace dom
 		}) == "a56161614161626142616361436164614461656145");
 	}
 
+	struct half_precision_floats_only
+	{
+		static constexpr bool half_precision_floats = true;
+		static constexpr bool integral_doubles_as_integers = false;
+	};
+	TEST_CASE(write_compact_floats)
+	{
+		auto w_half = [&](double d) { return to_hex_string(cbor::create_writer<half_precision_floats_only>(stream::vector_writer{}).write(d)); };
+		test(w_half(0.0) == "f90000");
+		test(w_half(-0.0) == "f98000");
+		test(w_half(1.0) == "f93c00");
+		test(w_half(1.5) == "f93e00");
+		test(w_half(-4.0) == "f9c400");
+		test(w_half(65504.0) == "f97bff");
+		test(w_half(65536.0) == "fa47800000");
+		test(w_half(5.960464477539063e-8) == "f90001");
+		test(w_half(0.00006103515625) == "f90400");
+		test(w_half(2.98023223876953125e-8) == "fa33000000");
+		test(w_half(100000.0) == "fa47c35000");
+		test(w_half(1.1) == "fb3ff199999999999a");
+		test(w_half(std::numeric_limits<double>::infinity()) == "f97c00");
+		test(w_half(-std::numeric_limits<double>::infinity()) == "f9fc00");
+		test(w_half(std::numeric_limits<double>::quiet_NaN()) == "f97e00");
+		test(w_half(-std::numeric_limits<double>::quiet_NaN()) == "f97e00");
+		test(w_half(std::bit_cast<double>(0x7ff8000000000001ull)) == "f97e00");
+		test(w_half(std::bit_cast<double>(0x7ff0000000000001ull)) == "f97e00");
+		test(to_hex_string(cbor::create_writer<half_precision_floats_only>(stream::vector_writer{}).write(std::bit_cast<float>(0x7fc00001u))) == "f97e00");
+
+		auto w = [&](double d) { return to_hex_string(cbor::create_writer<cbor::compact_write_options>(stream::vector_writer{}).write(d)); };
+		test(w(0.0) == "00");
+		test(w(-0.0) == "f98000");
+		test(w(1.0) == "01");
+		test(w(-4.0) == "23");
+		test(w(1.5) == "f93e00");
+		test(w(-9223372036854775808.0) == "3b7fffffffffffffff");
+		test(w(18446744073709549568.0) == "1bfffffffffffff800");
+		test(w(18446744073709551616.0) == "fa5f800000");
+		test(w(1.0e+300) == "fb7e37e43c8800759c");
+
+		// Every half precision value read back from the stream should be written back as the same half precision value
+		for (uint32_t i = 0; i < 0x10000; ++i)
+		{
+			if ((i & 0x7C00) == 0x7C00 && (i & 0x3FF) != 0)
+				continue; // NaNs are normalized
+
+			auto binary = to_vector("f9" + to_hex_string({ static_cast<byte>(i >> 8), static_cast<byte>(i & 0xFF) }));
+			stream::const_buffer_ref_reader s(binary);
+			test(w_half(cbor::read(stream::ref(s)).as_double()) == to_hex_string(binary));
+		}
+	}
+
+	TEST_CASE(write_numeric_array)
+	{
+		auto element_by_element = [&](auto writer, const auto& data)
+		{
+			auto array = writer.start_array(data.size());
+			for (auto&& x : data)
+				array.write(x);
+			return to_hex_string(array.flush());
+		};
+		auto w = [&](const auto& data)
+		{
+			auto expected = element_by_element(cbor::create_writer(stream::vector_writer{}), data);
+			test(to_hex_string(cbor::create_writer(stream::vector_writer{}).write_array(std::span(data))) == expected);
+			test(element_by_element(cbor::create_writer<cbor::compact_write_options>(stream::vector_writer{}), data) ==
+				to_hex_string(cbor::create_writer<cbor::compact_write_options>(stream::vector_writer{}).write_array(std::span(data))));
+			return expected;
+		};
+		test(w(std::vector<uint64_t>{}) == "80");
+		test(w(std::vector<int64_t>{ 1, -1, 24, -1000, std::numeric_limits<int64_t>::min() }) == "85012018183903e73b7fffffffffffffff");
+		test(w(std::vector<double>{ 1.0, 1.1 }) == "82fa3f800000fb3ff199999999999a");
+		test(w(std::vector<float>{ 1.5f }) == "81fa3fc00000");
+		test(w(std::vector<uint8_t>{ 0, 255 }) == "820018ff");
+
+		// Arrays larger than the buffer used by write_array
+		std::vector<double> doubles;
+		std::vector<int32_t> integers;
+		for (int i = 0; i < 10000; ++i)
+		{
+			doubles.push_back(i % 3 == 0 ? i : i / 7.0);
+			integers.push_back(i * (i % 2 == 0 ? 7919 : -7919));
+		}
+		w(doubles);
+		w(integers);
+
+		// write_array can be used for elements of arrays and values of maps
+		std::vector<uint64_t> small = { 1, 2 };
+		auto map = cbor::create_writer(stream::vector_writer{}).start_map(1);
+		map.write_key("a");
+		map.append_value().write_array(std::span(small));
+		test(to_hex_string(map.flush()) == "a16161820102");
+	}
+
 	TEST_CASE(write_infinite_array)
 	{
 		auto w = [&](const std::vector<document>& data)
@@ -147,6 +242,22 @@ namespace goldfish { namespace dom
 		}) == "bf6346756ef563416d7421ff");
 	}
 
+	TEST_CASE(write_speculative_output)
+	{
+		// Only indefinite length arrays and maps support marks
+		stream::vector_writer s;
+		auto map = cbor::create_writer(stream::ref(s)).start_map();
+		map.write("Fun", true);
+		auto m = map.mark();
+		map.write("Amt", -2ll);
+		map.rollback(m);
+		m = map.mark();
+		map.write("Amt", -2ll);
+		map.commit(m);
+		map.flush();
+		test(to_hex_string(s.flush()) == "bf6346756ef563416d7421ff");
+	}
+
 	TEST_CASE(write_infinite_string)
 	{
 		auto w = [&](const std::vector<std::string>& data)
@@ -0,0 +1,107 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/cbor_writer.h>
+#include <goldfish/json_reader.h>
+#include <goldfish/json_writer.h>
+#include <goldfish/transcode.h>
+#include "dom.h"
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static std::string nested_json_arrays(size_t depth)
+	{
+		return std::string(depth, '[') + std::string(depth, ']');
+	}
+	static std::string nested_json_maps(size_t depth)
+	{
+		std::string result;
+		for (size_t i = 0; i < depth; ++i)
+			result += "{\"a\":[1,\"x\",";
+		result += "null";
+		for (size_t i = 0; i < depth; ++i)
+			result += "]}";
+		return result;
+	}
+
+	TEST_CASE(container_stack_push_pop)
+	{
+		details::container_stack<std::string, 2> stack;
+		std::vector<std::string*> addresses;
+		for (int i = 0; i < 200; ++i)
+			addresses.push_back(&stack.push(std::to_string(i)));
+
+		// Elements don't move when the stack grows
+		for (int i = 0; i < 200; ++i)
+			test(*addresses[i] == std::to_string(i));
+		test(stack.size() == 200);
+		for (int i = 199; i >= 0; --i)
+		{
+			test(stack.top() == std::to_string(i));
+			stack.pop();
+		}
+		test(stack.empty());
+	}
+
+	TEST_CASE(seek_to_end_deep_documents)
+	{
+		static_assert(details::self_similar_document<details::element_t<decltype(json::read(stream::read_string_ref("")).as_array())>>);
+		static_assert(details::self_similar_document<details::element_t<decltype(cbor::read(stream::read_string_ref("")).as_array())>>);
+
+		for (auto&& text : { nested_json_arrays(50000), nested_json_maps(20000) })
+		{
+			auto s = stream::read_string_ref(text.c_str());
+			seek_to_end(json::read(stream::ref(s)));
+			test(stream::seek(s, 1) == 0);
+		}
+
+		// Skipping a map in the middle of a document
+		auto maps = "[" + nested_json_maps(20000) + ",true]";
+		auto array = json::read(stream::read_string_ref(maps.c_str())).as_array();
+		seek_to_end(array.read()->as_map());
+		test(array.read()->as_bool());
+		test(array.read() == std::nullopt);
+
+		auto cbor = json_to_cbor(stream::read_string_ref(nested_json_maps(20000).c_str()), stream::vector_writer{});
+		stream::const_buffer_ref_reader s(cbor);
+		seek_to_end(cbor::read(stream::ref(s)));
+		test(stream::seek(s, 1) == 0);
+	}
+
+	TEST_CASE(write_deep_documents)
+	{
+		auto json = nested_json_maps(20000);
+		auto cbor = cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_string_ref(json.c_str())));
+		test(cbor == json_to_cbor(stream::read_string_ref(json.c_str()), stream::vector_writer{}));
+
+		auto round_trip = json::create_writer(stream::vector_writer{}).write(cbor::read(stream::read_buffer_ref(cbor)));
+		test(std::string(round_trip.begin(), round_trip.end()) == json);
+
+		auto arrays = nested_json_arrays(50000);
+		auto copy = json::create_writer(stream::vector_writer{}).write(json::read(stream::read_string_ref(arrays.c_str())));
+		test(std::string(copy.begin(), copy.end()) == arrays);
+	}
+
+	TEST_CASE(load_deep_documents)
+	{
+		auto document = dom::load_in_memory(json::read(stream::read_string_ref(nested_json_maps(3).c_str())));
+		test(document == dom::map{ { "a", dom::array{ 1ull, "x", dom::map{ { "a", dom::array{ 1ull, "x", dom::map{ { "a", dom::array{ 1ull, "x", nullptr } } } } } } } } });
+
+		// The dom is destroyed recursively, so the document is only moderately deep
+		auto deep = dom::load_in_memory(json::read(stream::read_string_ref(nested_json_arrays(2000).c_str())));
+		size_t depth = 0;
+		for (auto* x = &deep; !x->as<dom::array>().empty(); x = &x->as<dom::array>()[0])
+			++depth;
+		test(depth == 1999);
+	}
+
+	TEST_CASE(nesting_depth_limit)
+	{
+		test(max_nesting_depth == 100000);
+		seek_to_end(json::read(stream::read_string_ref(nested_json_arrays(max_nesting_depth).c_str())));
+		expect_exception<document_too_deep>([] { seek_to_end(json::read(stream::read_string_ref(nested_json_arrays(max_nesting_depth + 1).c_str()))); });
+		expect_exception<document_too_deep>([]
+		{
+			cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_string_ref(nested_json_arrays(max_nesting_depth + 1).c_str())));
+		});
+	}
+}
@@ -0,0 +1,86 @@
+#include <goldfish/counting_writer.h>
+#include <goldfish/cbor_writer.h>
+#include <goldfish/json_writer.h>
+#include <list>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	namespace
+	{
+		// Types whose serialization doesn't know the sizes upfront
+		struct point { int x; int y; };
+		struct shape { std::string name; std::list<point> points; };
+
+		template <class Writer> auto serialize_to_goldfish(Writer& writer, const point& p)
+		{
+			auto map = writer.start_map();
+			map.write("x", p.x);
+			map.write("y", p.y);
+			return map.flush();
+		}
+		template <class Writer> auto serialize_to_goldfish(Writer& writer, const shape& s)
+		{
+			auto map = writer.start_map();
+			{
+				map.write("name", s.name);
+				auto points = map.start_array("points");
+				for (auto&& p : s.points)
+					points.write(p);
+				points.flush();
+			}
+			{
+				auto comment = map.append_key();
+				comment.write("comment");
+				auto stream = map.append_value().start_string();
+				stream.write_buffer(as_bytes(std::string_view("hello ")));
+				stream.write_buffer(as_bytes(std::string_view("world")));
+				stream.flush();
+			}
+			return map.flush();
+		}
+	}
+
+	static std::string to_hex_string(const std::vector<byte>& data)
+	{
+		std::string result;
+		for (auto&& x : data)
+		{
+			result += "0123456789abcdef"[x >> 4];
+			result += "0123456789abcdef"[x & 0b1111];
+		}
+		return result;
+	}
+
+	TEST_CASE(counting_writer_compute_sizes)
+	{
+		shape s{ "sq", { { 1, 2 }, { 3, 4 } } };
+		test(counting::compute_sizes(s) == std::vector<uint64_t>{ 3, 2, 2, 2, 11 });
+		test(counting::compute_sizes(shape{ "empty", {} }) == std::vector<uint64_t>{ 3, 0, 11 });
+		test(counting::compute_sizes(point{ 1, 2 }) == std::vector<uint64_t>{ 2 });
+		test(counting::compute_sizes(std::string("abc")) == std::vector<uint64_t>{});
+	}
+
+	TEST_CASE(counting_writer_definite_cbor)
+	{
+		shape s{ "sq", { { 1, 2 }, { 3, 4 } } };
+
+		// Without the size table, the arrays, maps and strings have indefinite lengths
+		test(to_hex_string(cbor::create_writer(stream::vector_writer{}).write(point{ 1, 2 })) == "bf617801617902ff");
+
+		test(to_hex_string(counting::write_with_definite_sizes(cbor::create_writer(stream::vector_writer{}), point{ 1, 2 })) == "a2617801617902");
+		test(to_hex_string(counting::write_with_definite_sizes(cbor::create_writer(stream::vector_writer{}), s)) ==
+			"a3"
+			"646e616d65" "627371"
+			"66706f696e7473" "82" "a2617801617902" "a2617803617904"
+			"67636f6d6d656e74" "6b68656c6c6f20776f726c64");
+	}
+
+	TEST_CASE(counting_writer_json)
+	{
+		// Sizes are not needed for JSON, but the output is unchanged
+		shape s{ "sq", { { 1, 2 } } };
+		test(counting::write_with_definite_sizes(json::create_writer(stream::string_writer{}), s) ==
+			R"({"name":"sq","points":[{"x":1,"y":2}],"comment":"hello world"})");
+	}
+}
@@ -0,0 +1,143 @@
+#include <goldfish/cursor.h>
+
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static std::vector<byte> from_hex_string(std::string_view hex)
+	{
+		auto to_hex = [](char c) -> byte { return static_cast<byte>(c <= '9' ? c - '0' : c - 'a' + 10); };
+		std::vector<byte> result;
+		for (size_t i = 0; i + 1 < hex.size(); i += 2)
+			result.push_back(static_cast<byte>((to_hex(hex[i]) << 4) | to_hex(hex[i + 1])));
+		return result;
+	}
+
+	// Describe the tokens of a document in a compact form, for instance [ k:"a" 1 ] for [{"a":1}]
+	template <class Cursor> std::string describe(Cursor&& c)
+	{
+		std::string result;
+		for (;;)
+		{
+			auto t = c.next_token();
+			if (!result.empty())
+				result += ' ';
+			if (t.key)
+				result += "k:";
+			switch (t.type)
+			{
+			case token_type::null: result += "null"; break;
+			case token_type::undefined: result += "undefined"; break;
+			case token_type::boolean: result += t.as_bool() ? "true" : "false"; break;
+			case token_type::unsigned_int: result += std::to_string(t.as_uint64()); break;
+			case token_type::signed_int: result += std::to_string(t.as_int64()); break;
+			case token_type::floating_point: result += std::to_string(t.as_double()); break;
+			case token_type::string: result += '"' + std::string(t.as_string()) + '"'; break;
+			case token_type::binary: result += "b" + std::to_string(t.as_binary().size()); break;
+			case token_type::start_array: result += '['; break;
+			case token_type::end_array: result += ']'; break;
+			case token_type::start_map: result += '{'; break;
+			case token_type::end_map: result += '}'; break;
+			case token_type::end_of_document: return result + "$";
+			}
+		}
+	}
+
+	TEST_CASE(json_cursor_tokens)
+	{
+		auto r = [](const char* text) { return describe(json::create_cursor(stream::read_string_ref(text))); };
+		test(r("1") == "1 $");
+		test(r(" -1 ") == "-1 $");
+		test(r("0.5") == "0.500000 $");
+		test(r("true") == "true $");
+		test(r("null") == "null $");
+		test(r("\"a\\nb\"") == "\"a\nb\" $");
+		test(r("[]") == "[ ] $");
+		test(r("{}") == "{ } $");
+		test(r("[1,[2,{}],3]") == "[ 1 [ 2 { } ] 3 ] $");
+		test(r(R"({ "a" : 1, "b\u00e9" : [true, false], "c": {"d": null}})") == "{ k:\"a\" 1 k:\"b\xc3\xa9\" [ true false ] k:\"c\" { k:\"d\" null } } $");
+
+		// Strings longer than the buffer are copied
+		std::string long_string(typical_buffer_length * 2, 'x');
+		test(r(("[\"" + long_string + "\",\"" + long_string + "\"]").c_str()) == "[ \"" + long_string + "\" \"" + long_string + "\" ] $");
+
+		expect_exception<json::ill_formatted_json_data>([&] { r("[1 2]"); });
+		expect_exception<json::ill_formatted_json_data>([&] { r("{1:2}"); });
+		expect_exception<json::ill_formatted_json_data>([&] { r("{\"a\" 2}"); });
+		expect_exception<json::ill_formatted_json_data>([&] { r("[1}"); });
+
+		// Bytes that never appear in UTF-8 are rejected like json::read does, whether the string is returned in place or copied
+		expect_exception<json::ill_formatted_json_data>([&] { r("\"a\xF8" "b\""); });
+		expect_exception<json::ill_formatted_json_data>([&] { r("[\"\\n\xFF\"]"); });
+		expect_exception<json::ill_formatted_json_data>([&] { r(("\"" + long_string + "\xFC\"").c_str()); });
+		test(r("\"\xC3\xBC\xF4\x8F\xBF\xBF\"") == "\"\xC3\xBC\xF4\x8F\xBF\xBF\" $");
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("[1"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("\"abc"); });
+	}
+
+	TEST_CASE(json_cursor_depth_and_skip_value)
+	{
+		auto c = json::create_cursor(stream::read_string_ref(R"({"skip":[1,{"a":[2]}],"keep":3})"));
+		test(c.depth() == 0);
+		test(c.next_token().type == token_type::start_map);
+		test(c.depth() == 1);
+		test(c.next_token().as_string() == "skip");
+		c.skip_value();
+		test(c.depth() == 1);
+		test(c.next_token().as_string() == "keep");
+		auto value = c.next_token();
+		test(value.as_uint64() == 3);
+		test(value.as_int64() == 3);
+		test(value.as_double() == 3);
+		expect_exception<std::bad_variant_access>([&] { value.as_string(); });
+		test(c.next_token().type == token_type::end_map);
+		test(c.depth() == 0);
+		test(c.next_token().type == token_type::end_of_document);
+		test(c.next_token().type == token_type::end_of_document);
+	}
+
+	TEST_CASE(cbor_cursor_tokens)
+	{
+		auto r = [](std::string_view hex)
+		{
+			auto data = from_hex_string(hex);
+			return describe(cbor::create_cursor(stream::read_buffer_ref(data)));
+		};
+		test(r("01") == "1 $");
+		test(r("20") == "-1 $");
+		test(r("f93800") == "0.500000 $");
+		test(r("f5") == "true $");
+		test(r("f7") == "undefined $");
+		test(r("c11a514b67b0") == "1363896240 $"); // tags are skipped
+		test(r("6161") == "\"a\" $");
+		test(r("7f61616162ff") == "\"ab\" $");
+		test(r("43010203") == "b3 $");
+		test(r("80") == "[ ] $");
+		test(r("a0") == "{ } $");
+		test(r("83018202a003") == "[ 1 [ 2 { } ] 3 ] $");
+		test(r("9f018202a0ff") == "[ 1 [ 2 { } ] ] $");
+		test(r("bf616101018102ff") == "{ k:\"a\" 1 k:1 [ 2 ] } $");
+		test(r("a2616101018102") == "{ k:\"a\" 1 k:1 [ 2 ] } $");
+
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r("82ff"); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r("bf6161ff"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("8201"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("6461"); });
+	}
+
+	TEST_CASE(cbor_cursor_depth_and_skip_value)
+	{
+		auto data = from_hex_string("a264736b69708301a16161810203646b65657004");
+		auto c = cbor::create_cursor(stream::read_buffer_ref(data));
+		test(c.next_token().type == token_type::start_map);
+		test(c.next_token().as_string() == "skip");
+		c.skip_value();
+		test(c.depth() == 1);
+		auto key = c.next_token();
+		test(key.key);
+		test(key.as_string() == "keep");
+		test(c.next_token().as_int64() == 4);
+		test(c.next_token().type == token_type::end_map);
+		test(c.next_token().type == token_type::end_of_document);
+	}
+}
@@ -1,3 +1,4 @@
+#include <goldfish/cbor_reader.h>
 #include <goldfish/debug_checks_reader.h>
 #include <goldfish/json_reader.h>
 #include "unit_test.h"
@@ -10,6 +11,13 @@ namespace goldfish
 		static void on_error() { throw library_misused{}; }
 	};
 
+	TEST_CASE(no_check_doesnt_wrap_readers)
+	{
+		static_assert(std::is_same_v<decltype(json::read(stream::read_string_ref(""), debug_checks::no_check{})), decltype(json::read_no_debug_check(stream::read_string_ref("")))>);
+		static_assert(std::is_same_v<decltype(cbor::read(stream::read_string_ref(""), debug_checks::no_check{})), cbor::document<stream::const_buffer_ref_reader>>);
+		static_assert(!std::is_same_v<decltype(json::read(stream::read_string_ref(""), throw_on_error{})), decltype(json::read_no_debug_check(stream::read_string_ref("")))>);
+	}
+
 	TEST_CASE(reading_parent_before_stream_end)
 	{
 		auto document = json::read(stream::read_string("[\"hello\"]"), throw_on_error{}).as_array();
@@ -10,6 +10,12 @@ namespace goldfish
 		static void on_error() { throw library_misused{}; }
 	};
 
+	TEST_CASE(no_check_doesnt_wrap_writers)
+	{
+		static_assert(std::is_same_v<decltype(json::create_writer(stream::vector_writer{}, debug_checks::no_check{})), decltype(sax::make_writer(json::create_writer_no_debug_check(stream::vector_writer{})))>);
+		static_assert(!std::is_same_v<decltype(json::create_writer(stream::vector_writer{}, throw_on_error{})), decltype(sax::make_writer(json::create_writer_no_debug_check(stream::vector_writer{})))>);
+	}
+
 	TEST_CASE(write_multiple_documents_on_same_writer)
 	{
 		stream::vector_writer output;
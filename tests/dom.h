@@ -1,7 +1,9 @@
 #pragma once
 
+#include <optional>
 #include <vector>
 #include <string>
+#include <goldfish/container_stack.h>
 #include <goldfish/match.h>
 #include <goldfish/tags.h>
 #include <goldfish/stream.h>
@@ -76,29 +78,95 @@ namespace goldfish { namespace dom
 			}));
 	}
 
+	namespace details
+	{
+		template <class Container> document load_container(Container& x);
+	}
+
 	template <class D> std::enable_if_t<tags::has_tag<std::decay_t<D>, tags::document>::value, document> load_in_memory(D&& reader)
 	{
 		return std::forward<D>(reader).visit(first_match(
 			[](auto&& d, tags::binary) -> document { return stream::read_all(d); },
 			[](auto&& d, tags::string) -> document { return stream::read_all_as_string(d); },
-			[](auto&& d, tags::array) -> document
+			[](auto&& d, tags::array) -> document { return details::load_container(d); },
+			[](auto&& d, tags::map) -> document { return details::load_container(d); },
+			[](auto&& x, auto) -> document { return std::forward<decltype(x)>(x); }
+		));
+	}
+
+	namespace details
+	{
+		// Adds an element to the array or map being loaded, keys are kept aside until their value is loaded
+		inline void add_element(document& container, std::optional<document>& key, document&& element, bool is_key)
+		{
+			if (container.is<array>())
+				container.as<array>().emplace_back(std::move(element));
+			else if (is_key)
+				key = std::move(element);
+			else
+				container.as<map>().emplace_back(std::move(*key), std::move(element));
+		}
+
+		// Same as seek_to_end, the nested arrays and maps are kept in a stack instead of being loaded recursively
+		template <class Container> document load_container(Container& x)
+		{
+			using goldfish::details::element_t;
+			document result = std::is_same_v<typename Container::tag, tags::array> ? document(array{}) : document(map{});
+			std::optional<document> key;
+			if constexpr (goldfish::details::uniform_container<Container> && goldfish::details::self_similar_document<element_t<Container>>)
+			{
+				using element = element_t<Container>;
+				struct loaded_container
+				{
+					goldfish::details::open_container<element> reader;
+					document value;
+					std::optional<document> key;
+					bool is_key;
+				};
+				goldfish::details::container_stack<loaded_container> stack;
+				bool value_next = false;
+				for (;;)
+				{
+					auto d = stack.empty() ? goldfish::details::read_element(x, value_next) : stack.top().reader.read_element();
+					bool is_key = stack.empty() ? value_next : stack.top().reader.read_key_last();
+					if (!d)
+					{
+						if (stack.empty())
+							return result;
+						auto value = std::move(stack.top().value);
+						is_key = stack.top().is_key;
+						stack.pop();
+						add_element(stack.empty() ? result : stack.top().value, stack.empty() ? key : stack.top().key, std::move(value), is_key);
+					}
+					else if (d->template is_exactly<tags::array>())
+					{
+						stack.push(loaded_container{ d->as_array(), array{}, std::nullopt, is_key });
+					}
+					else if (d->template is_exactly<tags::map>())
+					{
+						stack.push(loaded_container{ d->as_map(), map{}, std::nullopt, is_key });
+					}
+					else
+					{
+						add_element(stack.empty() ? result : stack.top().value, stack.empty() ? key : stack.top().key, load_in_memory(std::move(*d)), is_key);
+					}
+				}
+			}
+			else if constexpr (std::is_same_v<typename Container::tag, tags::array>)
 			{
-				array result;
-				while (auto x = d.read())
-					result.emplace_back(load_in_memory(*x));
+				while (auto d = x.read())
+					result.as<array>().emplace_back(load_in_memory(*d));
 				return result;
-			},
-			[](auto&& d, tags::map) -> document
+			}
+			else
 			{
-				map result;
-				while (auto x = d.read_key())
+				while (auto d = x.read_key())
 				{
-					auto key = load_in_memory(*x);
-					result.emplace_back(key, load_in_memory(d.read_value()));
+					auto loaded_key = load_in_memory(*d);
+					result.as<map>().emplace_back(loaded_key, load_in_memory(x.read_value()));
 				}
 				return result;
-			},
-			[](auto&& x, auto) -> document { return std::forward<decltype(x)>(x); }
-		));
+			}
+		}
 	}
 }}
\ No newline at end of file
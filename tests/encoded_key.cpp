@@ -0,0 +1,70 @@
+#include <goldfish/encoded_key.h>
+#include <goldfish/cbor_string_references.h>
+#include <goldfish/cbor_writer.h>
+#include <goldfish/json_writer.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static std::string to_hex_string(const std::vector<byte>& data)
+	{
+		std::string result;
+		for (auto&& x : data)
+		{
+			result += "0123456789abcdef"[x >> 4];
+			result += "0123456789abcdef"[x & 0b1111];
+		}
+		return result;
+	}
+	static std::string to_string(std::span<const byte> data)
+	{
+		return{ reinterpret_cast<const char*>(data.data()), data.size() };
+	}
+
+	static constexpr encoded_key name_key("name");
+	static_assert(name_key.text() == "name", "Literals are encoded at compile time");
+	static_assert(name_key.json().size() == 6 && name_key.cbor().size() == 5, "Literals are encoded at compile time");
+
+	TEST_CASE(encoded_key_encodings)
+	{
+		test(to_string(name_key.json()) == "\"name\"");
+		test(to_hex_string({ name_key.cbor().begin(), name_key.cbor().end() }) == "646e616d65");
+
+		// Same escaping as the JSON writer
+		encoded_key escaped("a\"b\\c\n\x01\x7f");
+		test(to_string(escaped.json()) == "\"a\\\"b\\\\c\\n\\u0001\x7f\"");
+		test(escaped.cbor().size() == 9);
+
+		// Header sizes depend on the length of the text
+		encoded_key<300> long_key{ std::string_view(std::string(300, 'x')) };
+		test(to_hex_string({ long_key.cbor().begin(), long_key.cbor().begin() + 3 }) == "79012c");
+		test(long_key.cbor().size() == 303);
+		test(encoded_key<0>{ std::string_view{} }.json().size() == 2);
+
+		expect_exception<encoded_key_too_long>([] { encoded_key<2>{ std::string_view("abc") }; });
+	}
+
+	TEST_CASE(encoded_key_write)
+	{
+		static constexpr encoded_key type_key("type");
+		auto write_records = [&](auto writer)
+		{
+			auto map = writer.start_map(3);
+			map.write(name_key, "John");
+			map.write(type_key, encoded_key("person"));
+			map.write("id", 1);
+			return map.flush();
+		};
+
+		// The output is the same as with plain strings
+		test(write_records(json::create_writer(stream::string_writer{})) == R"({"name":"John","type":"person","id":1})");
+		test(to_hex_string(write_records(cbor::create_writer(stream::vector_writer{}))) ==
+			"a3" "646e616d65" "644a6f686e" "6474797065" "66706572736f6e" "626964" "01");
+
+		// With string references, the encoded keys still get their entry in the table
+		auto array = cbor::create_writer(cbor::with_string_references(stream::vector_writer{})).start_array(2);
+		array.write(name_key);
+		array.write("name");
+		test(to_hex_string(array.flush()) == "d90100" "82" "646e616d65" "d81900");
+	}
+}
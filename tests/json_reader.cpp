@@ -120,6 +120,41 @@ namespace goldfish { namespace dom
 		test(r("\"\\uD801\\uDC37\"") == u8"\U00010437");
 	}
 
+	TEST_CASE(json_read_array_into)
+	{
+		{
+			std::vector<int64_t> result;
+			json::read(stream::read_string("[1, -2 ,3,12345678,123456789012,-9223372036854775808]")).as_array().read_all_into(result);
+			test(result == std::vector<int64_t>{ 1, -2, 3, 12345678, 123456789012, std::numeric_limits<int64_t>::min() });
+		}
+		{
+			std::vector<double> result;
+			json::read(stream::read_string("[1.5,-2,3e2,\"4\"]")).as_array().read_all_into(result);
+			test(result == std::vector<double>{ 1.5, -2, 300, 4 });
+		}
+		{
+			std::vector<uint64_t> result;
+			json::read(stream::read_string("[]")).as_array().read_all_into(result);
+			test(result.empty());
+			json::read(stream::read_string("[18446744073709551615]")).as_array().read_all_into(result);
+			test(result == std::vector<uint64_t>{ 18446744073709551615ull });
+		}
+		{
+			auto array = json::read(stream::read_string("[1,2,3,4,5]")).as_array();
+			int32_t buffer[3];
+			test(array.read_into(std::span<int32_t>(buffer)) == 3);
+			test(buffer[0] == 1 && buffer[1] == 2 && buffer[2] == 3);
+			test(array.read_into(std::span<int32_t>(buffer)) == 2);
+			test(buffer[0] == 4 && buffer[1] == 5);
+			test(array.read() == std::nullopt);
+		}
+
+		std::vector<uint8_t> bytes;
+		expect_exception<integer_overflow_while_casting>([&] { json::read(stream::read_string("[256]")).as_array().read_all_into(bytes); });
+		expect_exception<json::integer_overflow_in_json>([&] { json::read(stream::read_string("[18446744073709551616]")).as_array().read_all_into(bytes); });
+		expect_exception<std::bad_variant_access>([&] { json::read(stream::read_string("[1,true]")).as_array().read_all_into(bytes); });
+	}
+
 	struct data_partially_parsed {};
 
 	template <class Exception>
@@ -0,0 +1,75 @@
+#include <goldfish/json_reformat.h>
+#include "unit_test.h"
+
+namespace goldfish { namespace json
+{
+	static std::string minify(const std::string& text) { return json::minify(stream::read_string_ref(text.c_str()), stream::string_writer{}); }
+	static std::string indent(const std::string& text) { return json::indent(stream::read_string_ref(text.c_str()), stream::string_writer{}); }
+
+	TEST_CASE(test_minify)
+	{
+		test(minify("") == "");
+		test(minify(" 1 ") == "1");
+		test(minify(" [ 1 , true , null ] ") == "[1,true,null]");
+		test(minify("{ \"a\" : [ ] ,\r\n\t\"b\" : { } }") == R"({"a":[],"b":{}})");
+
+		// Numbers and strings are copied as they are
+		test(minify("[ 1.50E+3 , -0.0 , 123456789012345678901234567890 ]") == "[1.50E+3,-0.0,123456789012345678901234567890]");
+		test(minify(R"([ " a \" b \\ " , "é\/" ])") == R"([" a \" b \\ ","é\/"])");
+	}
+
+	TEST_CASE(test_indent)
+	{
+		test(indent("1") == "1");
+		test(indent("[]") == "[]");
+		test(indent("[ { } ]") == "[\n  {}\n]");
+		test(indent(R"({"a":[1,2],"b":{"c":"d"}})") ==
+			"{\n"
+			"  \"a\": [\n"
+			"    1,\n"
+			"    2\n"
+			"  ],\n"
+			"  \"b\": {\n"
+			"    \"c\": \"d\"\n"
+			"  }\n"
+			"}");
+		test(json::indent(stream::read_string_ref("[1,[2]]"), stream::string_writer{}, "\t") == "[\n\t1,\n\t[\n\t\t2\n\t]\n]");
+
+		// Indenting and minifying a document gives back the minified document
+		auto text = R"({ "key with \" and \\ and [ and {" : [ 1, 2.5e-3, "x", [ [ ] ], { "y" : null } ], "z" : false })";
+		test(minify(indent(text)) == minify(text));
+	}
+
+	TEST_CASE(test_reformat_large_document)
+	{
+		// Strings and whitespace longer than the internal buffers, and tokens split between reads
+		std::string long_string(20000, 'x');
+		long_string[10000] = '\\';
+		long_string[10001] = '"';
+		std::string text = "[\"" + long_string + "\"" + std::string(10000, ' ');
+		for (int i = 0; i < 5000; ++i)
+			text += ", " + std::to_string(i * 7919.5);
+		text += "]";
+
+		std::string expected = "[\"" + long_string + "\"";
+		for (int i = 0; i < 5000; ++i)
+			expected += "," + std::to_string(i * 7919.5);
+		expected += "]";
+
+		test(minify(text) == expected);
+		test(minify(indent(text)) == expected);
+
+		auto buffered_input = stream::buffer<5>(stream::read_string_ref(text.c_str()));
+		test(json::minify(buffered_input, stream::string_writer{}) == expected);
+	}
+
+	TEST_CASE(test_reformat_invalid_structure)
+	{
+		expect_exception<ill_formatted_json_data>([] { minify("["); });
+		expect_exception<ill_formatted_json_data>([] { minify("[}"); });
+		expect_exception<ill_formatted_json_data>([] { minify("{]"); });
+		expect_exception<ill_formatted_json_data>([] { minify("[]]"); });
+		expect_exception<ill_formatted_json_data>([] { minify("\"abc"); });
+		expect_exception<ill_formatted_json_data>([] { indent("[\"abc\\\"]"); });
+	}
+}}
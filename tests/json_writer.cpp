@@ -40,6 +40,32 @@ namespace goldfish { namespace dom
 		test(w(map{ { 1ull, 1ull } }) == "{\"1\":1}");
 	}
 
+	TEST_CASE(test_escape_in_long_string)
+	{
+		// Put the character at every position of a string that spans several blocks of the vectorized scan
+		auto run = [](char c, const std::string& escaped)
+		{
+			for (size_t position = 0; position < 70; ++position)
+			{
+				std::string text(70, 'a');
+				text[position] = c;
+				auto expected = "\"" + text.substr(0, position) + escaped + text.substr(position + 1) + "\"";
+				test(json::create_writer(stream::string_writer{}).write(std::string_view(text)) == expected);
+
+				auto map = json::create_writer(stream::string_writer{}).start_map();
+				map.write(std::string_view(text), 1);
+				test(map.flush() == "{" + expected + ":1}");
+			}
+		};
+		run('"', "\\\"");
+		run('\\', "\\\\");
+		run('\n', "\\n");
+		run('\x00', "\\u0000");
+		run('\x1f', "\\u001F");
+		run('\x7f', "\x7f");
+		run('\xff', "\xff");
+	}
+
 	TEST_CASE(test_roundtrip)
 	{
 		auto run = [](const char* data)
@@ -77,7 +103,7 @@ namespace goldfish { namespace dom
 		map.write(stream::read_string("Key"), 4);
 		map.write("Key", 5);
 
-		test(map.flush() == R"({"1":1,"-1":2,"0.500000":3,"S2V5":4,"Key":5})");
+		test(map.flush() == R"({"1":1,"-1":2,"0.5":3,"S2V5":4,"Key":5})");
 	}
 
 	TEST_CASE(test_lossless_floating_point)
@@ -98,4 +124,104 @@ namespace goldfish { namespace dom
 		//run("2.2250738585072014e-308");
 		//run("1.7976931348623157e308");
 	}
+
+	struct six_digits_write_options { using double_format = json::fixed_precision_doubles<6>; };
+	struct float_write_options { using double_format = json::shortest_float_doubles; };
+
+	TEST_CASE(test_numeric_array)
+	{
+		auto element_by_element = [&](auto writer, const auto& data)
+		{
+			auto array = writer.start_array(data.size());
+			for (auto&& x : data)
+				array.write(x);
+			return array.flush();
+		};
+		auto w = [&](const auto& data)
+		{
+			auto result = json::create_writer(stream::string_writer{}).write_array(std::span(data));
+			test(result == element_by_element(json::create_writer(stream::string_writer{}), data));
+			return result;
+		};
+		test(w(std::vector<uint64_t>{}) == "[]");
+		test(w(std::vector<int64_t>{ 1, -1, std::numeric_limits<int64_t>::min() }) == "[1,-1,-9223372036854775808]");
+		test(w(std::vector<uint64_t>{ std::numeric_limits<uint64_t>::max() }) == "[18446744073709551615]");
+		test(w(std::vector<double>{ 0.5, 1e300, -2.2250738585072014e-308 }) == "[0.5,1e+300,-2.2250738585072014e-308]");
+		test(w(std::vector<float>{ 0.5f }) == "[0.5]");
+		test(w(std::vector<int8_t>{ -128, 127 }) == "[-128,127]");
+
+		// Arrays larger than the buffer used by write_array
+		std::vector<double> doubles;
+		std::vector<int64_t> integers;
+		for (int i = 0; i < 10000; ++i)
+		{
+			doubles.push_back(-i / 7.0);
+			integers.push_back(std::numeric_limits<int64_t>::min() + i);
+		}
+		w(doubles);
+		w(integers);
+
+		// The double format of the options is used
+		test(json::create_writer<six_digits_write_options>(stream::string_writer{}).write_array(std::span(doubles).subspan(0, 3)) == "[0,-0.142857,-0.285714]");
+
+		// write_array can be used for elements of arrays and values of maps
+		auto map = json::create_writer(stream::string_writer{}).start_map();
+		map.write_key("a");
+		map.append_value().write_array(std::span(integers).subspan(0, 1));
+		test(map.flush() == R"({"a":[-9223372036854775808]})");
+	}
+
+	TEST_CASE(test_double_formats)
+	{
+		auto run = [](double x, const char* shortest, const char* six_digits, const char* as_float)
+		{
+			test(json::create_writer(stream::string_writer{}).write(x) == shortest);
+			test(json::create_writer<six_digits_write_options>(stream::string_writer{}).write(x) == six_digits);
+			test(json::create_writer<float_write_options>(stream::string_writer{}).write(x) == as_float);
+		};
+		run(0.5, "0.5", "0.5", "0.5");
+		run(100, "100", "100", "100");
+		run(0.1f, "0.10000000149011612", "0.1", "0.1");
+		run(1.0 / 3, "0.3333333333333333", "0.333333", "0.33333334");
+		run(-2.2250738585072014e-308, "-2.2250738585072014e-308", "-2.22507e-308", "-0");
+		run(1e300, "1e+300", "1e+300", "1e+300");
+
+		// The format applies to nested documents and keys
+		auto map = json::create_writer<six_digits_write_options>(stream::string_writer{}).start_map();
+		map.write(1.0 / 3, 2.0 / 3);
+		auto array = map.start_array("a");
+		array.write(1.0 / 7);
+		array.flush();
+		test(map.flush() == R"({"0.333333":0.666667,"a":[0.142857]})");
+	}
+
+	TEST_CASE(test_speculative_output)
+	{
+		// Rolling back removes the elements written after the mark, and the separator before them
+		auto map = json::create_writer(stream::string_writer{}).start_map();
+		auto m = map.mark();
+		map.write("errors", 1ull);
+		map.rollback(m);
+		map.write("a", 1ull);
+		m = map.mark();
+		auto errors = map.start_array("errors");
+		errors.write(2ull);
+		errors.flush();
+		map.rollback(m);
+		m = map.mark();
+		map.write("b", 2ull);
+		map.commit(m);
+		test(map.flush() == R"({"a":1,"b":2})");
+
+		auto array = json::create_writer(stream::string_writer{}).start_array();
+		array.write(1ull);
+		m = array.mark();
+		array.write(2ull);
+		auto element_mark = array.mark();
+		array.write(3ull);
+		array.rollback(element_mark);
+		array.write(4ull);
+		array.commit(m);
+		test(array.flush() == "[1,2,4]");
+	}
 }}
\ No newline at end of file
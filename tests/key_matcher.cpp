@@ -0,0 +1,144 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/json_reader.h>
+#include <goldfish/key_matcher.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static std::vector<byte> from_hex_string(std::string_view hex)
+	{
+		auto to_hex = [](char c) -> byte { return static_cast<byte>(c <= '9' ? c - '0' : c - 'a' + 10); };
+		std::vector<byte> result;
+		for (size_t i = 0; i + 1 < hex.size(); i += 2)
+			result.push_back(static_cast<byte>((to_hex(hex[i]) << 4) | to_hex(hex[i + 1])));
+		return result;
+	}
+
+	// Reads all the keys of the map, and describes each key with its index (or ? if it didn't match)
+	template <class Map, class Matcher> std::string describe_keys(Map&& map, const Matcher& matcher)
+	{
+		std::string result;
+		while (auto index = map.read_key_match(matcher))
+		{
+			result += *index == key_matcher_base::no_match ? "?" : std::to_string(*index);
+			seek_to_end(map.read_value());
+		}
+		return result;
+	}
+
+	TEST_CASE(key_matcher_match)
+	{
+		static constexpr key_matcher keys{ "id", "ts", "payload", "a_key_longer_than_8_bytes", "a_key_longer_than_8_bytez", "" };
+		static_assert(keys.match("id") == 0);
+		static_assert(keys.match("payload") == 2);
+		static_assert(keys.match("a_key_longer_than_8_bytez") == 4);
+		static_assert(keys.match("") == 5);
+		static_assert(keys.match("i") == key_matcher_base::no_match);
+		static_assert(keys.match("idx") == key_matcher_base::no_match);
+		static_assert(keys.match("a_key_longer_than_8_bytes_") == key_matcher_base::no_match);
+		static_assert(keys.has_length(7) && !keys.has_length(3));
+
+		expect_exception<key_matcher_key_too_long>([] { key_matcher{ std::string(key_matcher_base::max_key_length + 1, 'x').c_str() }; });
+		expect_exception<key_matcher_duplicate_key>([] { key_matcher{ "a", "b", "a" }; });
+		expect_exception<key_matcher_duplicate_key>([] { key_matcher<2>(std::array<std::string_view, 2>{ "payload", "payload" }); });
+	}
+
+	TEST_CASE(perfect_hash_key_matcher_match)
+	{
+		static constexpr perfect_hash_key_matcher keys{ "id", "ts", "payload", "a_key_longer_than_8_bytes", "a_key_longer_than_8_bytez", "" };
+		static_assert(keys.match("id") == 0);
+		static_assert(keys.match("payload") == 2);
+		static_assert(keys.match("a_key_longer_than_8_bytez") == 4);
+		static_assert(keys.match("") == 5);
+		static_assert(keys.match("i") == key_matcher_base::no_match);
+		static_assert(keys.match("idx") == key_matcher_base::no_match);
+		static_assert(keys.has_length(7) && !keys.has_length(3));
+
+		// Every key of a large set is found, and nothing else
+		std::array<std::string, 200> names;
+		std::array<std::string_view, 200> views;
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			names[i] = "field_" + std::to_string(i * 7919);
+			views[i] = names[i];
+		}
+		perfect_hash_key_matcher<200> many(views);
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			test(many.match(names[i]) == i);
+			test(many.match(names[i] + "_") == key_matcher_base::no_match);
+		}
+
+		expect_exception<key_matcher_duplicate_key>([] { perfect_hash_key_matcher{ "a", "b", "a" }; });
+	}
+
+	TEST_CASE(json_read_key_match)
+	{
+		static constexpr key_matcher keys{ "id", "ts", "payload" };
+		auto r = [](const char* text) { return describe_keys(json::read(stream::read_string_ref(text)).as_map(), keys); };
+		test(r("{}") == "");
+		test(r(R"({"id":1,"payload":[1,{"ts":2}],"ts":"x","other":null})") == "021?");
+		test(r(R"({"id":1,"ts\n":2})") == "0?");
+		test(r(("{\"" + std::string(200, 'x') + "\":1,\"ts\":2}").c_str()) == "?1");
+
+		auto map = json::read(stream::read_string_ref(R"({"b":1,"a":2})")).as_map();
+		test(map.read_key_match({ "a", "b" }) == 1);
+		test(map.read_value().as_uint64() == 1);
+		test(map.read_key_match({ "a", "b" }) == 0);
+		test(map.read_value().as_uint64() == 2);
+		test(map.read_key_match({ "a", "b" }) == std::nullopt);
+
+		static constexpr perfect_hash_key_matcher hashed_keys{ "id", "ts", "payload" };
+		test(describe_keys(json::read(stream::read_string_ref(R"({"id":1,"payload":[1,{"ts":2}],"ts":"x","other":null})")).as_map(), hashed_keys) == "021?");
+	}
+
+	TEST_CASE(cbor_read_key_match)
+	{
+		static constexpr key_matcher keys{ "id", "ts", "payload" };
+		auto r = [](std::string_view hex)
+		{
+			auto data = from_hex_string(hex);
+			stream::const_buffer_ref_reader s(data);
+			auto result = describe_keys(cbor::read(stream::ref(s)).as_map(), keys);
+			test(stream::seek(s, 1) == 0);
+			return result;
+		};
+		test(r("a0") == "");
+		test(r("a3" "626964" "01" "677061796c6f6164" "820102" "627473" "f6") == "021");
+		test(r("a3" "627878" "01" "63787878" "02" "01" "03") == "???"); // same length, other length, not a string
+		test(r("bf" "7f626964ff" "01" "627473" "02" "ff") == "01"); // indefinite length key
+		test(r("a1" "c1627473" "01") == "1"); // tagged key
+		test(r("a1" "78c8" + std::string(400, '7') + "01") == "?");
+
+		static constexpr perfect_hash_key_matcher hashed_keys{ "id", "ts", "payload" };
+		auto data = from_hex_string("a4" "626964" "01" "677061796c6f6164" "820102" "627473" "f6" "63747378" "00");
+		test(describe_keys(cbor::read(stream::read_buffer_ref(data)).as_map(), hashed_keys) == "021?");
+
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("a1" "6269"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { r("a1" "6378"); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { r("a1" "ff"); });
+	}
+
+	TEST_CASE(cbor_read_key_match_with_string_references)
+	{
+		// Two records with the keys "name" and "value", the second one refers to the keys of the first one
+		auto data = from_hex_string(
+			"d90100" "82"
+			"a2" "646e616d65" "6161" "6576616c7565" "01"
+			"a2" "d81900" "6162" "d81901" "02");
+		auto records = cbor::read(cbor::with_string_references(stream::read_buffer_ref(data))).as_array();
+		std::string result;
+		while (auto record = records.read())
+		{
+			auto map = record->as_map();
+			while (auto index = map.read_key_match({ "value", "name" }))
+			{
+				result += std::to_string(*index) + ":";
+				auto value = map.read_value();
+				result += *index == 0 ? std::to_string(value.as_uint64()) : stream::read_all_as_string(value.as_string());
+				result += " ";
+			}
+		}
+		test(result == "1:a 0:1 1:b 0:2 ");
+	}
+}
@@ -94,4 +94,85 @@ namespace goldfish
 		test(json::read(stream::read_string("\"8000\"")).as_int64() == 8000);
 		test(json::read(stream::read_string("\"8000\"")).as_uint64() == 8000);
 	}
+	TEST_CASE(test_strict_policy)
+	{
+		auto r = [](const char* input) { return json::read<json::strict>(stream::read_string_ref(input)); };
+		test(r("1").as_uint64() == 1);
+		test(r("1").as_int8() == 1);
+		test(r("-1").as_double() == -1);
+		test(r("1.0").as_uint16() == 1);
+		test(r("true").as_bool() == true);
+		test(stream::read_all_as_string(r("\"8000\"").as_string()) == "8000");
+
+		// Strings are not converted
+		test(r("\"8000\"").try_as_uint64().error() == conversion_error::type_mismatch);
+		test(r("\"8000\"").try_as_double().error() == conversion_error::type_mismatch);
+		test(r("\"true\"").try_as_bool().error() == conversion_error::type_mismatch);
+		expect_exception<bad_variant_access>([&] { r("\"8000\"").as_int64(); });
+		expect_exception<bad_variant_access>([&] { r("\"SGVsbG8=\"").as_binary(); });
+		expect_exception<integer_overflow_while_casting>([&] { r("-1").as_uint64(); });
+
+		// The policy applies to the whole document
+		auto map = r(R"({"a":["1",2]})").as_map();
+		test(stream::read_all_as_string(map.read_key()->as_string()) == "a");
+		auto array = map.read_value().as_array();
+		test(array.read()->try_as_int32().error() == conversion_error::type_mismatch);
+		test(array.read()->as_int32() == 2);
+		test(array.read() == std::nullopt);
+		test(map.read_key() == std::nullopt);
+	}
+	TEST_CASE(test_try_as)
+	{
+		test(*json::read(stream::read_string_ref("1")).try_as_uint64() == 1);
+		test(*json::read(stream::read_string_ref("\"-1.5e1\"")).try_as_double() == -15);
+		test(*json::read(stream::read_string_ref("\"18446744073709551615\"")).try_as_uint64() == 18446744073709551615ull);
+		test(*json::read(stream::read_string_ref("\"-9223372036854775808\"")).try_as_int64() == std::numeric_limits<int64_t>::min());
+		test(*json::read(stream::read_string_ref("\"false\"")).try_as_bool() == false);
+
+		auto error = [](const char* input) { return json::read(stream::read_string_ref(input)).try_as_int32(); };
+		test(error("[1]").error() == conversion_error::type_mismatch);
+		test(error("true").error() == conversion_error::type_mismatch);
+		test(error("2147483648").error() == conversion_error::integer_overflow);
+		test(error("1.5").error() == conversion_error::integer_overflow);
+		test(error("1e300").error() == conversion_error::integer_overflow);
+		test(error("\"-1.5\"").error() == conversion_error::integer_overflow);
+		test(error("\"18446744073709551616\"").error() == conversion_error::invalid_string);
+		test(error("\"12a\"").error() == conversion_error::invalid_string);
+		test(error("\"12a\"").error_offset() == 2);
+		test(error("\"01\"").error_offset() == 1);
+		test(error("\"1.\"").error_offset() == 2);
+		test(error("\"\"").error_offset() == 0);
+		test(error("\"12a\"").value_or(-1) == -1);
+		test(json::read(stream::read_string_ref("\"yes\"")).try_as_bool().error() == conversion_error::invalid_string);
+
+		expect_exception<bad_variant_access>([&] { error("\"12a\"").value(); });
+		expect_exception<integer_overflow_while_casting>([&] { error("1.5").value(); });
+
+		// as_* throws without reading documents of another type, which can still be read
+		auto document = json::read(stream::read_string_ref(R"([1,{"a":2}])"));
+		expect_exception<bad_variant_access>([&] { document.as_uint64(); });
+		expect_exception<bad_variant_access>([&] { document.as_bool(); });
+		auto elements = document.as_array();
+		test(elements.read()->as_uint64() == 1);
+		auto map = elements.read()->as_map();
+		test(stream::read_all_as_string(map.read_key()->as_string()) == "a");
+		test(map.read_value().as_uint64() == 2);
+		test(map.read_key() == std::nullopt);
+		test(elements.read() == std::nullopt);
+
+		// Values that can't be converted are skipped, and the rest of the document can still be read
+		auto array = json::read(stream::read_string_ref(R"([1,"x",[2,[3]],{"a":"b"},"1234567890123","4",true])")).as_array();
+		std::vector<conversion_error> errors;
+		int64_t sum = 0;
+		while (auto element = array.read())
+		{
+			auto x = element->try_as_int32();
+			if (x)
+				sum += *x;
+			else
+				errors.push_back(x.error());
+		}
+		test(sum == 5);
+		test(errors == std::vector<conversion_error>{ conversion_error::invalid_string, conversion_error::type_mismatch, conversion_error::type_mismatch, conversion_error::integer_overflow, conversion_error::type_mismatch });
+	}
 }	
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/cbor_writer.h>
+#include <goldfish/json_reader.h>
+#include <goldfish/json_writer.h>
+#include <goldfish/std_containers.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	template <class T> static std::string to_json(const T& x)
+	{
+		return stream::read_all_as_string(stream::read_buffer_ref(json::create_writer(stream::vector_writer{}).write(x)));
+	}
+	template <class T> static std::vector<byte> to_cbor(const T& x)
+	{
+		return cbor::create_writer(stream::vector_writer{}).write(x);
+	}
+	template <class T> static T from_json(const std::string& x)
+	{
+		return deserialize<T>(json::read(stream::read_string_ref(x.c_str())));
+	}
+	template <class T> static T from_cbor(const std::vector<byte>& x)
+	{
+		stream::const_buffer_ref_reader s(x);
+		auto result = deserialize<T>(cbor::read(stream::ref(s)));
+		test(stream::seek(s, 1) == 0);
+		return result;
+	}
+	template <class T> static void test_round_trip(const T& x, const char* json)
+	{
+		test(to_json(x) == json);
+		test(from_json<T>(json) == x);
+		test(from_cbor<T>(to_cbor(x)) == x);
+	}
+
+	TEST_CASE(std_containers_round_trip)
+	{
+		test_round_trip(std::vector<int>{ 1, -2, 3 }, "[1,-2,3]");
+		test_round_trip(std::vector<std::string>{ "a", "" }, R"(["a",""])");
+		test_round_trip(std::vector<std::vector<double>>{ { 0.5 }, {} }, "[[0.5],[]]");
+		test_round_trip(std::array<uint16_t, 3>{ 1, 2, 3 }, "[1,2,3]");
+		test_round_trip(std::array<std::string, 2>{ "a", "b" }, R"(["a","b"])");
+		test_round_trip(std::map<std::string, int>{ { "a", 1 }, { "b", 2 } }, R"({"a":1,"b":2})");
+		test_round_trip(std::unordered_map<std::string, std::vector<int>>{ { "a", { 1, 2 } } }, R"({"a":[1,2]})");
+		test_round_trip(std::optional<int>{}, "null");
+		test_round_trip(std::optional<int>{ 3 }, "3");
+		test_round_trip(std::vector<std::optional<bool>>{ true, std::nullopt }, "[true,null]");
+		test_round_trip(std::tuple<int, std::string, bool>{ 1, "a", false }, R"([1,"a",false])");
+		test_round_trip(std::pair<std::string, double>{ "pi", 3.5 }, R"(["pi",3.5])");
+
+		// Binary data is base64 encoded in JSON
+		test(to_json(std::vector<byte>{ 1, 2, 3 }) == R"("AQID")");
+		test(to_cbor(std::vector<byte>{ 1, 2, 3 }) == std::vector<byte>{ 0x43, 1, 2, 3 });
+		test(from_cbor<std::vector<byte>>({ 0x43, 1, 2, 3 }) == std::vector<byte>{ 1, 2, 3 });
+		test(from_cbor<std::array<byte, 3>>({ 0x43, 1, 2, 3 }) == std::array<byte, 3>{ 1, 2, 3 });
+	}
+
+	TEST_CASE(std_containers_variant)
+	{
+		using value = std::variant<std::monostate, bool, int64_t, double, std::string, std::vector<int>>;
+		test_round_trip(value{}, "null");
+		test_round_trip(value{ true }, "true");
+		test_round_trip(value{ int64_t{ -3 } }, "-3");
+		test_round_trip(value{ 0.5 }, "0.5");
+		test_round_trip(value{ std::string("a") }, R"("a")");
+		test_round_trip(value{ std::vector<int>{ 1 } }, "[1]");
+
+		// The first alternative that can hold the document is used
+		test(from_json<std::variant<double, int>>("1").index() == 0);
+		test(from_json<std::variant<std::string, int>>("1").index() == 1);
+		expect_exception<std::bad_variant_access>([] { from_json<std::variant<std::string, int>>("{}"); });
+	}
+
+	TEST_CASE(std_containers_definite_length)
+	{
+		// Containers know their size, so they are written with definite lengths
+		test(to_cbor(std::vector<std::string>{ "a", "b" }) == std::vector<byte>{ 0x82, 0x61, 'a', 0x61, 'b' });
+		test(to_cbor(std::vector<uint16_t>{ 1, 2 }) == std::vector<byte>{ 0x82, 1, 2 });
+		test(to_cbor(std::map<std::string, int>{ { "a", 1 } }) == std::vector<byte>{ 0xa1, 0x61, 'a', 1 });
+		test(to_cbor(std::pair<int, int>{ 1, 2 }) == std::vector<byte>{ 0x82, 1, 2 });
+
+		// Definite length arrays and maps announce their length, indefinite ones and JSON ones don't
+		std::vector<byte> definite{ 0x83, 1, 2, 3 };
+		test(cbor::read(stream::read_buffer_ref(definite)).as_array().remaining_length() == 3u);
+		std::vector<byte> indefinite{ 0x9f, 1, 2, 3, 0xff };
+		test(cbor::read(stream::read_buffer_ref(indefinite)).as_array().remaining_length() == std::nullopt);
+		test(json::read(stream::read_string_ref("[1,2,3]")).as_array().remaining_length() == std::nullopt);
+
+		auto array = cbor::read(stream::read_buffer_ref(definite)).as_array();
+		array.read();
+		test(array.remaining_length() == 2u);
+
+		std::vector<byte> map{ 0xa2, 0x61, 'a', 1, 0x61, 'b', 2 };
+		test(cbor::read(stream::read_buffer_ref(map)).as_map().remaining_length() == 2u);
+
+		// Containers are reserved from the announced length, and read the same either way
+		auto strings = from_cbor<std::vector<std::string>>({ 0x82, 0x61, 'a', 0x61, 'b' });
+		test(strings == std::vector<std::string>{ "a", "b" });
+		test(strings.capacity() == 2);
+		test(from_cbor<std::vector<std::string>>({ 0x9f, 0x61, 'a', 0x61, 'b', 0xff }) == strings);
+		test(from_cbor<std::unordered_map<std::string, int>>({ 0xbf, 0x61, 'a', 1, 0xff }) == std::unordered_map<std::string, int>{ { "a", 1 } });
+
+		// A corrupted length doesn't cause a huge allocation
+		expect_exception<stream::unexpected_end_of_stream>([] { from_cbor<std::vector<std::string>>({ 0x9b, 0x10, 0, 0, 0, 0, 0, 0, 0, 0x61, 'a' }); });
+	}
+
+	TEST_CASE(std_containers_size_mismatch)
+	{
+		expect_exception<array_size_mismatch>([] { from_json<std::array<int, 3>>("[1,2]"); });
+		expect_exception<array_size_mismatch>([] { from_json<std::array<int, 1>>("[1,2]"); });
+		expect_exception<array_size_mismatch>([] { from_json<std::array<std::string, 2>>(R"(["a"])"); });
+		expect_exception<array_size_mismatch>([] { from_json<std::tuple<int, int>>("[1,2,3]"); });
+		expect_exception<array_size_mismatch>([] { from_json<std::pair<int, int>>("[1]"); });
+		expect_exception<array_size_mismatch>([] { from_cbor<std::array<byte, 2>>({ 0x43, 1, 2, 3 }); });
+		expect_exception<array_size_mismatch>([] { from_cbor<std::array<byte, 4>>({ 0x43, 1, 2, 3 }); });
+
+		// Duplicate keys keep the last value
+		test(from_json<std::map<std::string, int>>(R"({"a":1,"a":2})") == std::map<std::string, int>{ { "a", 2 } });
+	}
+}
@@ -7,6 +7,7 @@ static_assert(is_reader<const_buffer_ref_reader>::value, "const_buffer_ref_reade
 static_assert(!is_reader<vector_writer>::value, "vector_writer is not a reader");
 static_assert(!is_writer<const_buffer_ref_reader>::value, "const_buffer_ref_reader is not a writer");
 static_assert(is_writer<vector_writer>::value, "vector_writer is a writer");
+static_assert(!has_reserve<vector_writer>::value, "vector_writer doesn't support reserve");
 
 TEST_CASE(test_skip)
 {
@@ -92,4 +93,42 @@ TEST_CASE(test_copy)
 	test_string_of_size(typical_buffer_length * 2 + 1);
 }
 
+TEST_CASE(test_write_direct_without_reserve)
+{
+	string_writer s;
+	for (int i = 0; i < 100; ++i)
+	{
+		write_direct<20>(s, [&](byte* buffer)
+		{
+			buffer[0] = 'a';
+			return 1;
+		});
+	}
+	test(s.flush() == std::string(100, 'a'));
+}
+
+TEST_CASE(test_write_mark)
+{
+	string_writer s;
+	write(s, 'a');
+	auto m = s.mark();
+	write(s, 'b');
+	s.rollback(m);
+	write(s, 'c');
+	m = s.mark();
+	write(s, 'd');
+	s.commit(m);
+	test(s.flush() == "acd");
+
+	vector_writer v;
+	auto r = ref(v);
+	static_assert(has_mark<decltype(r)>::value, "ref_writer forwards marks");
+	write(r, byte(1));
+	m = r.mark();
+	write(r, byte(2));
+	r.rollback(m);
+	test(v.flush() == std::vector<byte>{ 1 });
+}
+static_assert(!has_mark<const_buffer_ref_reader>::value, "Readers don't support marks");
+
 }}
\ No newline at end of file
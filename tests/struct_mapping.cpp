@@ -0,0 +1,64 @@
+#include <goldfish/cbor_reader.h>
+#include <goldfish/cbor_writer.h>
+#include <goldfish/counting_writer.h>
+#include <goldfish/json_reader.h>
+#include <goldfish/json_writer.h>
+#include <goldfish/struct_mapping.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	namespace
+	{
+		struct point
+		{
+			int32_t x = 0;
+			int32_t y = 0;
+			bool operator == (const point&) const = default;
+		};
+		constexpr auto goldfish_fields(const point*) { return fields(field("x", &point::x), field("y", &point::y)); }
+
+		struct shape
+		{
+			std::string name;
+			std::vector<point> points;
+			std::vector<double> weights;
+			std::optional<uint8_t> layer;
+			bool visible = false;
+			bool operator == (const shape&) const = default;
+		};
+		constexpr auto goldfish_fields(const shape*)
+		{
+			return fields(
+				field("name", &shape::name),
+				field("points", &shape::points),
+				field("weights", &shape::weights),
+				field("layer", &shape::layer),
+				field("visible", &shape::visible));
+		}
+	}
+
+	static const shape test_shape{ "triangle", { { 0, 0 }, { 1, -2 }, { 3, 4 } }, { 0.5, 2 }, 7, true };
+
+	TEST_CASE(struct_mapping_json)
+	{
+		auto json = stream::read_all_as_string(stream::read_buffer_ref(json::create_writer(stream::vector_writer{}).write(test_shape)));
+		test(json == R"({"name":"triangle","points":[{"x":0,"y":0},{"x":1,"y":-2},{"x":3,"y":4}],"weights":[0.5,2],"layer":7,"visible":true})");
+		test(deserialize<shape>(json::read(stream::read_string_ref(json.c_str()))) == test_shape);
+
+		// Unknown keys are skipped, missing keys keep their default values, keys can be in any order
+		auto s = deserialize<shape>(json::read(stream::read_string_ref(R"({"visible":true,"extra":{"a":[1,2]},"layer":null,"points":[{"y":1,"z":2}]})")));
+		test(s == shape{ "", { { 0, 1 } }, {}, std::nullopt, true });
+
+		expect_exception<integer_overflow_while_casting>([] { deserialize<shape>(json::read(stream::read_string_ref(R"({"layer":256})"))); });
+		expect_exception<std::bad_variant_access>([] { deserialize<shape>(json::read(stream::read_string_ref(R"({"points":{}})"))); });
+	}
+
+	TEST_CASE(struct_mapping_cbor)
+	{
+		auto cbor = cbor::create_writer(stream::vector_writer{}).write(test_shape);
+		test(cbor[0] == 0xa5); // map with 5 entries
+		test(deserialize<shape>(cbor::read(stream::read_buffer_ref(cbor))) == test_shape);
+		test(deserialize<point>(cbor::read(stream::read_buffer_ref(counting::write_with_definite_sizes(cbor::create_writer(stream::vector_writer{}), point{ 1, 2 })))) == point{ 1, 2 });
+	}
+}
@@ -0,0 +1,55 @@
+#include <goldfish/tagged_union.h>
+#include <memory>
+#include <string>
+
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static_assert(std::is_trivially_copy_constructible_v<tagged_union<bool, uint64_t, double>>, "Unions of scalars are trivially copyable");
+	static_assert(std::is_trivially_destructible_v<tagged_union<bool, uint64_t, double>>, "Unions of scalars are trivially destructible");
+	static_assert(!std::is_copy_constructible_v<tagged_union<bool, std::unique_ptr<int>>>, "Unions of move only types are move only");
+
+	TEST_CASE(tagged_union_get_and_visit)
+	{
+		using union_type = tagged_union<bool, uint64_t, double, std::string>;
+		auto name = [](const union_type& x)
+		{
+			return x.visit([](auto&& value) -> std::string
+			{
+				using T = std::decay_t<decltype(value)>;
+				if constexpr (std::is_same_v<T, bool>) return "bool";
+				else if constexpr (std::is_same_v<T, uint64_t>) return "uint64_t";
+				else if constexpr (std::is_same_v<T, double>) return "double";
+				else return "string " + value;
+			});
+		};
+
+		union_type x(uint64_t{ 1 });
+		test(x.index() == 1);
+		test(x.holds<uint64_t>());
+		test(x.get<uint64_t>() == 1);
+		test(*x.get_if<uint64_t>() == 1);
+		test(x.get_if<double>() == nullptr);
+		test(name(x) == "uint64_t");
+		expect_exception<std::bad_variant_access>([&] { x.get<std::string>(); });
+
+		x = union_type(std::string(100, 'a'));
+		test(name(x) == "string " + std::string(100, 'a'));
+		union_type y(x);
+		test(y.get<std::string>() == std::string(100, 'a'));
+		union_type z(std::move(x));
+		test(z.get<std::string>() == std::string(100, 'a'));
+		z = union_type(true);
+		test(name(z) == "bool");
+	}
+
+	TEST_CASE(tagged_union_move_only)
+	{
+		tagged_union<bool, std::unique_ptr<int>> x(std::make_unique<int>(3));
+		auto y = std::move(x);
+		auto p = std::move(y).get<std::unique_ptr<int>>();
+		test(*p == 3);
+		test(y.get<std::unique_ptr<int>>() == nullptr);
+	}
+}
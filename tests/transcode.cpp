@@ -0,0 +1,136 @@
+#include <goldfish/transcode.h>
+#include "unit_test.h"
+
+namespace goldfish
+{
+	static std::string to_hex_string(const std::vector<byte>& data)
+	{
+		std::string result;
+		for (auto&& x : data)
+		{
+			result += "0123456789abcdef"[x >> 4];
+			result += "0123456789abcdef"[x & 0b1111];
+		}
+		return result;
+	}
+	static std::vector<byte> from_hex_string(std::string_view hex)
+	{
+		std::vector<byte> result;
+		for (size_t i = 0; i + 1 < hex.size(); i += 2)
+			result.push_back(static_cast<byte>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+		return result;
+	}
+
+	TEST_CASE(json_scan_sizes)
+	{
+		auto scan = [](std::string_view json) { return json::scan_sizes(as_bytes(json)); };
+		test(scan("1") == std::vector<uint64_t>{});
+		test(scan("[]") == std::vector<uint64_t>{ 0 });
+		test(scan(" [ ] ") == std::vector<uint64_t>{ 0 });
+		test(scan("[1]") == std::vector<uint64_t>{ 1 });
+		test(scan("[1, [], [2, 3], {}]") == std::vector<uint64_t>{ 4, 0, 2, 0 });
+		test(scan("{\"a\":[1,2,3],\"bc\":{\"d\":\"\"}}") == std::vector<uint64_t>{ 2, 1, 3, 2, 1, 1, 0 });
+		test(scan("\"a,b]\"") == std::vector<uint64_t>{ 4 });
+		test(scan("\"\\\"\\\\\\n\"") == std::vector<uint64_t>{ 3 });
+		test(scan("\"\\u0041\\u00e9\\u6c34\\uD801\\uDC37\"") == std::vector<uint64_t>{ 1 + 2 + 3 + 4 });
+	}
+
+	TEST_CASE(json_to_definite_cbor_conversion)
+	{
+		auto w = [](std::string_view json) { return to_hex_string(json_to_definite_cbor(as_bytes(json), stream::vector_writer{})); };
+		test(w("1") == "01");
+		test(w("[]") == "80");
+		test(w("[1,[2,3],[4,5]]") == "8301820203820405");
+		test(w("{\"a\":1,\"b\":[2,3]}") == "a26161016162820203");
+		test(w("[\"a\",{\"b\":\"c\"}]") == "826161a161626163");
+		test(w("\"\\u00fc\"") == "62c3bc");
+		test(w("[true,false,null,-1,1.5]") == "85f5f4f620fa3fc00000");
+
+		std::string long_string(20000, 'a');
+		auto long_string_cbor = w("[\"" + long_string + "\"]");
+		test(long_string_cbor.substr(0, 8) == "81794e20");
+		test(long_string_cbor.size() == 8 + long_string.size() * 2);
+
+		expect_exception<json::ill_formatted_json_data>([&] { w("[1 2]"); });
+	}
+
+	TEST_CASE(json_to_cbor_conversion)
+	{
+		auto w = [](const std::string& json) { return to_hex_string(json_to_cbor(stream::read_string_ref(json), stream::vector_writer{})); };
+		test(w("1") == "01");
+		test(w(" [ ] ") == "9fff");
+		test(w("[1,[2,3],{}]") == "9f019f0203ffbfffff");
+		test(w("{\"a\":1,\"b\":[true,false,null]}") == "bf61610161629ff5f4f6ffff");
+		test(w("[-1,1.5,18446744073709551615]") == "9f20fa3fc000001bffffffffffffffffff");
+		test(w("\"a\\u00fc\\n\\\"\"") == "6561c3bc0a22");
+		test(to_hex_string(json_to_cbor<cbor::compact_write_options>(stream::read_string_ref("[1.0,0.5]"), stream::vector_writer{})) == "9f01f93800ff");
+
+		// Same output as the conversion through the document layer
+		std::string json = R"({"name":"GoldFish","tags":["json","cbor",""],"values":[0,-12,3.25,1e300,{"nested":[[],{}]}],"escaped":"\t\u00e9\ud83d\ude00"})";
+		test(w(json) == to_hex_string(cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_string_ref(json)))));
+
+		// Long strings are written in chunks
+		std::string long_string(20000, 'a');
+		long_string[10000] = '\\';
+		long_string[10001] = 'n';
+		auto long_string_cbor = w("\"" + long_string + "\"");
+		test(long_string_cbor.substr(0, 8) == "7f792000");
+		test(long_string_cbor == to_hex_string(cbor::create_writer(stream::vector_writer{}).write(json::read(stream::read_string_ref("\"" + long_string + "\"")))));
+
+		expect_exception<json::ill_formatted_json_data>([&] { w("[1 2]"); });
+		expect_exception<json::ill_formatted_json_data>([&] { w("[1,]"); });
+		expect_exception<json::ill_formatted_json_data>([&] { w("{1:2}"); });
+		expect_exception<json::ill_formatted_json_data>([&] { w("{\"a\" 2}"); });
+		expect_exception<json::ill_formatted_json_data>([&] { w("[}"); });
+		expect_exception<json::ill_formatted_json_data>([&] { w("nuxl"); });
+
+		// Bytes that never appear in UTF-8 are rejected like json::read does, in short strings and in the middle of long ones
+		for (auto invalid : { "\"a\xF8" "b\"", "\"\xFF\"", "\"\x01\"" })
+		{
+			expect_exception<json::ill_formatted_json_data>([&] { stream::read_all(json::read(stream::read_string_ref(invalid)).as_string()); });
+			expect_exception<json::ill_formatted_json_data>([&] { w(invalid); });
+			expect_exception<json::ill_formatted_json_data>([&] { w("[" + std::string(invalid) + "]"); });
+		}
+		expect_exception<json::ill_formatted_json_data>([&] { w("\"" + std::string(100, 'a') + "\xFE" + std::string(100, 'a') + "\""); });
+		test(w("\"\xC3\xBC\xF4\x8F\xBF\xBF\"") == "66c3bcf48fbfbf");
+
+		expect_exception<stream::unexpected_end_of_stream>([&] { w("[1"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { w("\"abc"); });
+	}
+
+	TEST_CASE(cbor_to_json_conversion)
+	{
+		auto w = [](std::string_view hex) { return cbor_to_json(stream::read_buffer_ref(from_hex_string(hex)), stream::string_writer{}); };
+		test(w("01") == "1");
+		test(w("80") == "[]");
+		test(w("9f019f0203ffa0ff") == "[1,[2,3],{}]");
+		test(w("a2616101616283f5f4f6") == R"({"a":1,"b":[true,false,null]})");
+		test(w("8320fa3fc00000f93c00") == "[-1,1.5,1]");
+		test(w("6561c3bc0a22") == R"("aü\n\"")");
+		test(w("7f61616162ff") == R"("ab")");
+		test(w("43010203") == R"("AQID")");
+		test(w("c11a514b67b0") == "1363896240"); // tags are skipped
+		test(w("f7") == "null");
+
+		// Keys that are not strings are written in quotes
+		test(w("a401f520f5f5f4f6f6") == R"({"1":true,"-1":true,"true":false,"null":null})");
+
+		// Round trip through CBOR, and same output as the conversion through the document layer
+		std::string json = R"({"name":"GoldFish","tags":["json","cbor",""],"values":[0,-12,3.25,1e+300,{"nested":[[],{}]}],"escaped":"\t\u001f\u00e9"})";
+		auto cbor = json_to_cbor(stream::read_string_ref(json), stream::vector_writer{});
+		auto expected = json::create_writer(stream::string_writer{}).write(cbor::read(stream::read_buffer_ref(cbor)));
+		test(cbor_to_json(stream::read_buffer_ref(cbor), stream::string_writer{}) == expected);
+		test(cbor_to_json(stream::read_buffer_ref(json_to_definite_cbor(as_bytes(json), stream::vector_writer{})), stream::string_writer{}) == expected);
+
+		std::string long_string(20000, 'a');
+		test(cbor_to_json(stream::read_buffer_ref(json_to_cbor(stream::read_string_ref("\"" + long_string + "\""), stream::vector_writer{})), stream::string_writer{}) == "\"" + long_string + "\"");
+
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { w("ff"); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { w("81ff"); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { w("bf01ff"); });
+		expect_exception<cbor::ill_formatted_cbor_data>([&] { w("1c"); });
+		expect_exception<json::invalid_key_type>([&] { w("a18001"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { w("8201"); });
+		expect_exception<stream::unexpected_end_of_stream>([&] { w("6461"); });
+	}
+}